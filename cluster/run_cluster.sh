@@ -3,6 +3,8 @@
 BUILD_TYPE="Debug"
 PROCESSES=4
 EXECUTABLE="ScoreHiveCluster"
+PLACEMENT=""
+MPI_ARGS=()
 
 show_help() {
     echo "Uso: $0 [opciones]"
@@ -10,6 +12,7 @@ show_help() {
     echo "  -r, --release      Ejecutar versión Release"
     echo "  -d, --debug        Ejecutar versión Debug (por defecto)"
     echo "  -n, --processes N  Número de procesos MPI (por defecto: 4)"
+    echo "  -p, --placement M  Fijar los rangos a núcleos: core, numa o none"
     echo "  -h, --help         Mostrar esta ayuda"
     echo ""
 }
@@ -34,6 +37,16 @@ while [[ $# -gt 0 ]]; do
                 exit 1
             fi
             ;;
+        -p|--placement)
+            if [[ "$2" =~ ^(core|numa|none)$ ]]; then
+                PLACEMENT="$2"
+                shift 2
+            else
+                echo "Error: -p requiere core, numa o none"
+                show_help
+                exit 1
+            fi
+            ;;
         -h|--help)
             show_help
             exit 0
@@ -56,6 +69,12 @@ fi
 
 EXE_PATH="$BUILD_DIR/$EXECUTABLE"
 
+# El propio ejecutable fija los rangos, mpirun no debe hacerlo
+if [[ -n "$PLACEMENT" && "$PLACEMENT" != "none" ]]; then
+    export SH_PLACEMENT="$PLACEMENT"
+    MPI_ARGS+=(--bind-to none)
+fi
+
 if [[ ! -f "$EXE_PATH" ]]; then
     echo "┌─── ERROR ───┐"
     echo "│ Ejecutable no encontrado: $EXE_PATH"
@@ -93,22 +112,25 @@ if [[ "$BUILD_TYPE" == "Debug" ]]; then
 else
     echo "│ Debug Mode:    Desactivado"
 fi
+if [[ -n "$SH_PLACEMENT" ]]; then
+    echo "│ Placement:     $SH_PLACEMENT"
+fi
 echo "└────────────────────────────────────────┘"
 
 echo ""
 echo "┌─── COMANDO ───┐"
 if [[ "$BUILD_TYPE" == "Debug" ]]; then
-    echo "│ env DEBUG=1 mpirun -n $PROCESSES $EXE_PATH"
+    echo "│ env DEBUG=1 mpirun ${MPI_ARGS[*]} -n $PROCESSES $EXE_PATH"
 else
-    echo "│ mpirun -n $PROCESSES $EXE_PATH"
+    echo "│ mpirun ${MPI_ARGS[*]} -n $PROCESSES $EXE_PATH"
 fi
 echo "└───────────────┘"
 echo ""
 
 if [[ "$BUILD_TYPE" == "Debug" ]]; then
-    env DEBUG=1 mpirun -n "$PROCESSES" "$EXE_PATH"
+    env DEBUG=1 mpirun "${MPI_ARGS[@]}" -n "$PROCESSES" "$EXE_PATH"
 else
-    mpirun -n "$PROCESSES" "$EXE_PATH"
+    mpirun "${MPI_ARGS[@]}" -n "$PROCESSES" "$EXE_PATH"
 fi
 
 EXIT_CODE=$?
@@ -1,6 +1,13 @@
 #include "answers.hpp"
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <domain/codec.hpp>
+#include <domain/letters.hpp>
+#include <domain/packing.hpp>
 #include <mutex>
+#include <random>
+#include <stdexcept>
 
 std::unique_ptr<AnswersManager> AnswersManager::_instance = nullptr;
 
@@ -10,53 +17,190 @@ AnswersManager& AnswersManager::instance() {
   return *_instance;
 }
 
+AnswersManager::AnswersManager()
+    : _snapshot(std::make_shared<const AnswerSnapshot>()) {
+  std::random_device device;
+  auto now = std::chrono::system_clock::now().time_since_epoch().count();
+  auto seed = (static_cast<u64>(device()) << 32 | device()) ^
+              static_cast<u64>(now);
+  _epoch = std::max<u64>(seed & ((u64{1} << 53) - 1), 1);
+}
+
+const PackedKey& AnswerSnapshot::key(i32 stage) const {
+  static const PackedKey no_answers;
+  auto it = keys.find(stage);
+  return it == keys.end() ? no_answers : it->second->packed;
+}
+
 void AnswersManager::load_from_json(const json& answers_json) {
-  for (const auto& exam_answers : answers_json) {
-    auto ans = exam_answers.get<ExamAnswers>();
-    _answers[ans.stage] = ans;
+  std::lock_guard lock(_write_mutex);
+  auto next = std::make_shared<AnswerSnapshot>(*snapshot());
+  if (answers_json.is_object()) {
+    for (auto& key : LetterFormat::read_keys(answers_json)) {
+      ExamAnswers answers{next->stage_names.intern(key.exam_id), {}};
+      for (size_t i = 0; i < key.answers.size(); i++) {
+        if (key.answers[i] != 0) {
+          answers.answers.push_back(
+              {static_cast<i32>(i + 1), static_cast<i32>(key.answers[i])});
+        }
+      }
+      _store(*next, std::move(answers));
+    }
+  } else {
+    for (const auto& exam_answers : answers_json) {
+      auto answers = exam_answers.get<ExamAnswers>();
+      check_stage(answers);
+      _store(*next, std::move(answers));
+    }
+  }
+  _publish(std::move(next));
+}
+
+std::vector<i32> AnswersManager::patch_from_json(const json& patch) {
+  std::vector<ExamAnswers> changes;
+  std::lock_guard lock(_write_mutex);
+  auto next = std::make_shared<AnswerSnapshot>(*snapshot());
+  if (patch.is_object()) {
+    for (auto& key : LetterFormat::read_keys(patch)) {
+      auto& change = changes.emplace_back();
+      change.stage = next->stage_names.intern(key.exam_id);
+      for (size_t i = 0; i < key.answers.size(); i++) {
+        if (key.answers[i] != 0) {  // a blank keeps the key
+          change.answers.push_back(
+              {static_cast<i32>(i + 1), static_cast<i32>(key.answers[i])});
+        }
+      }
+    }
+  } else {
+    changes = patch.get<std::vector<ExamAnswers>>();
+    std::ranges::for_each(changes, check_stage);
+  }
+  std::vector<i32> stages;
+  for (auto& change : changes) {
+    std::map<i32, i32> merged;
+    auto current = next->keys.find(change.stage);
+    if (current != next->keys.end()) {
+      for (const auto& answer : current->second->answers.answers) {
+        merged[answer.qst_idx] = answer.rans_idx;
+      }
+    }
+    for (const auto& answer : change.answers) {
+      merged[answer.qst_idx] = answer.rans_idx;
+    }
+    ExamAnswers answers{change.stage, {}};
+    for (const auto& [question, choice] : merged) {
+      if (choice != 0) {
+        answers.answers.push_back({question, choice});
+      }
+    }
+    _store(*next, std::move(answers));
+    stages.push_back(change.stage);
+  }
+  _publish(std::move(next));
+  std::ranges::sort(stages);
+  stages.erase(std::ranges::unique(stages).begin(), stages.end());
+  return stages;
+}
+
+void AnswersManager::_store(AnswerSnapshot& next,
+                            ExamAnswers&& answers) const {
+  // Keys are packed once here, every batch of the version reuses them
+  std::vector<u8> correct_answers;
+  for (const auto& answer : answers.answers) {
+    if (answer.qst_idx < 1 || answer.qst_idx > MAX_QUESTIONS ||
+        answer.rans_idx < 0 || answer.rans_idx > 255) {
+      throw std::runtime_error("Answer key of stage " +
+                               std::to_string(answers.stage) +
+                               " is out of range");
+    }
+    if (correct_answers.size() < static_cast<size_t>(answer.qst_idx)) {
+      correct_answers.resize(answer.qst_idx, 0);
+    }
+    correct_answers[answer.qst_idx - 1] = static_cast<u8>(answer.rans_idx);
+  }
+  auto key = std::make_shared<StageKey>();
+  key->packed.fits_narrow =
+      AnswerPacking::bits_for(correct_answers) == AnswerPacking::NARROW_BITS;
+  if (key->packed.fits_narrow) {
+    key->packed.narrow =
+        AnswerPacking::pack(correct_answers, AnswerPacking::NARROW_BITS);
+  }
+  key->packed.wide =
+      AnswerPacking::pack(correct_answers, AnswerPacking::WIDE_BITS);
+  auto stage = answers.stage;
+  key->answers = std::move(answers);
+  key->version = next.version + 1;  // the version _publish gives it
+  next.keys[stage] = std::move(key);
+}
+
+void AnswersManager::check_stage(const ExamAnswers& answers) {
+  if (answers.stage > MAX_STAGE) {
+    throw std::runtime_error("Stage " + std::to_string(answers.stage) +
+                             " is out of range");
+  }
+}
+
+void AnswersManager::_publish(std::shared_ptr<AnswerSnapshot> next) {
+  next->version++;
+  _snapshot.store(std::move(next), std::memory_order_release);
+}
+
+void AnswersManager::load_from_string(std::string_view answers_json) {
+  std::vector<ExamAnswers> answers;
+  if (!JsonCodec::read_answers(answers_json, answers)) {
+    // Forma no trivial: nlohmann valida y reporta el error
+    load_from_json(json::parse(answers_json));
+    return;
   }
+  std::lock_guard lock(_write_mutex);
+  auto next = std::make_shared<AnswerSnapshot>(*snapshot());
+  for (auto& ans : answers) {
+    _store(*next, std::move(ans));
+  }
+  _publish(std::move(next));
 }
 
 std::string AnswersManager::serialize_for_mpi(
     const std::vector<i32>& required_stages) const {
-  json serialized = json::array();
+  auto current = snapshot();
+  std::vector<const ExamAnswers*> serialized;
   for (const auto& stage : required_stages) {
-    auto it = _answers.find(stage);
-    if (it != _answers.end()) {
-      serialized.push_back(it->second);
+    auto it = current->keys.find(stage);
+    if (it != current->keys.end()) {
+      serialized.push_back(&it->second->answers);
     }
   }
-  return serialized.dump();
+  std::string output;
+  JsonCodec::write_answers(serialized, output);
+  return output;
 }
 
 void AnswersManager::deserialize_from_mpi(const std::string& serialized_data) {
-  json answers_json = json::parse(serialized_data);
-  load_from_json(answers_json);
+  load_from_string(serialized_data);
 }
 
-std::map<i32, i32> AnswersManager::get_answers(i32 stage) {
-  auto it = _cache_answers.find(stage);
-  if (it != _cache_answers.end()) {
-    return it->second;
-  }
-  // cache miss
-  auto it_answers = _answers.find(stage);
-  if (it_answers == _answers.end()) {
-    return std::map<i32, i32>();
+std::string AnswersManager::save_to_json(const AnswerSnapshot& answers) const {
+  std::lock_guard lock(_json_mutex);
+  if (_json && _json_version == answers.version) {
+    return *_json;
   }
-  auto vec_answers = it_answers->second.answers;
-  std::map<i32, i32> correct_answers;
-  for (const auto& answer : vec_answers) {
-    correct_answers[answer.qst_idx] = answer.rans_idx;
+  auto output = save_changes(answers, 0);
+  if (!_json || answers.version > _json_version) {
+    _json = std::make_shared<const std::string>(output);
+    _json_version = answers.version;
   }
-  _cache_answers[stage] = correct_answers;
-  return correct_answers;
+  return output;
 }
 
-std::string AnswersManager::save_to_json() const {
-  json answers_json = json::array();
-  for (const auto& [stage, answers] : _answers) {
-    answers_json.push_back(answers);
+std::string AnswersManager::save_changes(const AnswerSnapshot& answers,
+                                         u64 since) const {
+  std::vector<const ExamAnswers*> answers_json;
+  for (const auto& [stage, key] : answers.keys) {
+    if (key->version > since) {
+      answers_json.push_back(&key->answers);
+    }
   }
-  return answers_json.dump();
-}
\ No newline at end of file
+  std::string output;
+  JsonCodec::write_answers(answers_json, output, &answers.stage_names);
+  return output;
+}
@@ -2,11 +2,15 @@
 #ifndef ANSWERS_HPP
 #define ANSWERS_HPP
 
+#include <atomic>
+#include <domain/ids.hpp>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <system/aliases.hpp>
 #include <vector>
 
@@ -24,21 +28,131 @@ struct ExamAnswers {
   NLOHMANN_DEFINE_TYPE_INTRUSIVE(ExamAnswers, stage, answers)
 };
 
+/**
+ * @brief Answer key of a stage, packed as the exams are
+ * @see AnswerPacking
+ */
+struct PackedKey {
+  std::vector<u64> narrow; /** NARROW_BITS per question, if the key fits */
+  std::vector<u64> wide;   /** WIDE_BITS per question */
+  bool fits_narrow = true; /** Every choice of the key fits NARROW_BITS */
+};
+
+/**
+ * @brief Keys of a stage, in the JSON form and packed
+ */
+struct StageKey {
+  ExamAnswers answers;
+  PackedKey packed;
+  u64 version = 0; /** Version of the snapshot that stored it */
+};
+
+/**
+ * @brief Immutable version of every answer key
+ * @details Updates never modify a published snapshot: the next version is
+ *          built aside, sharing the keys of the stages it does not change,
+ *          and replaces it as a whole. Whoever holds a snapshot keeps
+ *          reading the same keys until it lets it go.
+ */
+struct AnswerSnapshot {
+  u64 version = 0;                                     /** 0 before loads */
+  std::map<i32, std::shared_ptr<const StageKey>> keys; /** Keys by stage */
+  IdTable stage_names;                                 /** Named stages */
+
+  /**
+   * @brief Packed key of a stage
+   * @return Lane q - 1 is the correct choice of question q, 0 if it has no
+   *         key; empty if the stage has no keys
+   */
+  const PackedKey& key(i32 stage) const;
+
+  /**
+   * @brief Stage named by the letter keys of an exam id
+   */
+  std::optional<i32> stage_of(std::string_view exam_id) const {
+    return stage_names.find(exam_id);
+  }
+};
+
+/**
+ * @brief Answer keys, published as RCU snapshots
+ * @details Readers pin the current snapshot with snapshot() without taking
+ *          a lock, and score a whole batch against it. Writers serialize on
+ *          a mutex, build the next snapshot off to the side and publish it
+ *          with an atomic store, so an update never stalls a reader and a
+ *          failed update publishes nothing. A snapshot is freed when its
+ *          last reader drops it.
+ */
 class AnswersManager {
  public:
   static AnswersManager& instance();
   ~AnswersManager() = default;
+  /**
+   * @brief Check that a numeric key does not take the stage of a named one
+   * @throw std::runtime_error If the stage is over MAX_STAGE
+   */
+  static void check_stage(const ExamAnswers& answers);
+  /**
+   * @brief Load answer keys: an array of ExamAnswers, or an object with
+   *        letter keys whose exam ids become named stages
+   * @throw std::runtime_error If a key is out of range
+   * @see LetterFormat
+   */
   void load_from_json(const json& answers_json);
+  void load_from_string(std::string_view answers_json);
+  /**
+   * @brief Change single questions of the keys: an array of ExamAnswers
+   *        whose answers replace those of the same question (rans_idx 0
+   *        drops it), or letter keys whose non-blank letters replace the
+   *        key of their question
+   * @return Stages whose keys the patch touches
+   * @throw std::runtime_error If a key is out of range
+   */
+  std::vector<i32> patch_from_json(const json& patch);
   std::string serialize_for_mpi(const std::vector<i32>& required_stages) const;
   void deserialize_from_mpi(const std::string& serialized_data);
-  std::map<i32, i32> get_answers(i32 stage);
-  std::string save_to_json() const;
+  /**
+   * @brief Pin the current snapshot
+   */
+  std::shared_ptr<const AnswerSnapshot> snapshot() const {
+    return _snapshot.load(std::memory_order_acquire);
+  }
+  /**
+   * @brief Every key, as an array of ExamAnswers
+   * @details The array is serialized once per version and kept until an
+   *          update publishes the next one. Named stages are written with
+   *          their exam id.
+   */
+  std::string save_to_json() const { return save_to_json(*snapshot()); }
+  std::string save_to_json(const AnswerSnapshot& answers) const;
+  /**
+   * @brief Keys a snapshot stored after version `since`, as an array of
+   *        ExamAnswers
+   * @details Named stages are written with their exam id, see
+   *          JsonCodec::write_answers.
+   */
+  std::string save_changes(const AnswerSnapshot& answers, u64 since) const;
+  /**
+   * @brief Epoch of the versions
+   * @details Versions only compare within an epoch. A process picks a new
+   *          one at random, so the version a client kept from another
+   *          process (before a restart or a hand-off) is never taken for
+   *          one of this process. It fits in 53 bits, as JSON numbers do.
+   */
+  u64 epoch() const { return _epoch; }
+  void set_epoch(u64 epoch) { _epoch = epoch; }
 
  private:
-  AnswersManager() = default;
+  AnswersManager();
   static std::unique_ptr<AnswersManager> _instance;
-  std::map<i32, ExamAnswers> _answers;
-  std::map<i32, std::map<i32, i32>> _cache_answers;
+  void _store(AnswerSnapshot& next, ExamAnswers&& answers) const;
+  void _publish(std::shared_ptr<AnswerSnapshot> next);
+  std::atomic<std::shared_ptr<const AnswerSnapshot>> _snapshot;
+  std::mutex _write_mutex;  // Un escritor a la vez construye la versión
+  mutable std::mutex _json_mutex;
+  mutable std::shared_ptr<const std::string> _json; /** Last serialized */
+  mutable u64 _json_version = 0;                     /** Its version */
+  u64 _epoch;
 };
 
-#endif  // ANSWERS_HPP
\ No newline at end of file
+#endif  // ANSWERS_HPP
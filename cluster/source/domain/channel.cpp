@@ -0,0 +1,98 @@
+#include "channel.hpp"
+#include <domain/shared.hpp>
+#include <stdexcept>
+#include <system/tracer.hpp>
+
+WorkerChannel::WorkerChannel(i32 master_rank) : _master_rank(master_rank) {
+  auto& coordinator = MPICoordinator::instance();
+  auto tag = coordinator.config().mpi_tag_command;
+  for (auto& slot : _slots) {
+    auto init_result = MPI_Recv_init(
+        &slot.header, MPI_BATCH_HEADER_INTS, MPI_INT, _master_rank, tag,
+        coordinator.communicator(), &slot.header_request);
+    if (init_result != MPI_SUCCESS) {
+      throw std::runtime_error("Failed to init batch header receive");
+    }
+  }
+  // Both headers are preposted; they match batches in the order started
+  for (auto& slot : _slots) {
+    MPI_Start(&slot.header_request);
+    slot.header_armed = true;
+  }
+}
+
+WorkerChannel::~WorkerChannel() {
+  for (auto& slot : _slots) {
+    if (slot.payload_posted) {
+      MPI_Cancel(&slot.payload_request);
+      MPI_Wait(&slot.payload_request, MPI_STATUS_IGNORE);
+    }
+    if (slot.header_armed) {
+      MPI_Cancel(&slot.header_request);
+      MPI_Wait(&slot.header_request, MPI_STATUS_IGNORE);
+    }
+    MPI_Request_free(&slot.header_request);
+  }
+}
+
+const MPIWork& WorkerChannel::next() {
+  auto& slot = _slots[_current];
+  if (slot.header_armed) {
+    MPI_Wait(&slot.header_request, MPI_STATUS_IGNORE);
+    slot.header_armed = false;
+  }
+  // Waiting for the header is idle time, the span starts once it is here
+  auto& tracer = Tracer::instance();
+  tracer.set_current(slot.header.trace);
+  TraceScope span("worker_recv");
+  if (!slot.payload_posted) {
+    _post_payload(slot);
+  }
+  if (slot.payload_posted) {
+    MPI_Wait(&slot.payload_request, MPI_STATUS_IGNORE);
+    slot.payload_posted = false;
+  }
+  auto payload_size = MPICoordinator::batch_payload_size(slot.header);
+  auto& region = NodeSharedRegion::instance();
+  region.acquire();
+  std::span<const char> payload(slot.payload.data(), payload_size);
+  if (slot.header.shared_payload >= 0) {
+    payload = region.view(slot.header.shared_payload, payload_size);
+  }
+  MPICoordinator::instance().unpack_batch(slot.header, payload, _work);
+  if (_work.command == MPICommand::SHUTDOWN) {
+    return _work;
+  }
+  MPI_Start(&slot.header_request);
+  slot.header_armed = true;
+  _current = (_current + 1) % _slots.size();
+  // Prefetch the payload of the next batch if its header already arrived
+  auto& next_slot = _slots[_current];
+  i32 arrived = 0;
+  MPI_Test(&next_slot.header_request, &arrived, MPI_STATUS_IGNORE);
+  if (arrived) {
+    next_slot.header_armed = false;
+    _post_payload(next_slot);
+  }
+  return _work;
+}
+
+void WorkerChannel::_post_payload(Slot& slot) {
+  auto payload_size = MPICoordinator::batch_payload_size(slot.header);
+  if (payload_size == 0 || slot.header.shared_payload >= 0) {
+    return;  // nothing to receive, or read from the shared region
+  }
+  if (slot.payload.size() < payload_size) {
+    slot.payload.resize(payload_size);
+  }
+  auto& coordinator = MPICoordinator::instance();
+  auto tag = coordinator.config().mpi_tag_exams;
+  auto recv_result =
+      MPI_Irecv(slot.payload.data(), static_cast<i32>(payload_size), MPI_BYTE,
+                _master_rank, tag, coordinator.communicator(),
+                &slot.payload_request);
+  if (recv_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to post batch payload receive");
+  }
+  slot.payload_posted = true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef CHANNEL_HPP
+#define CHANNEL_HPP
+
+#include <mpi.h>
+#include <array>
+#include <domain/coordinator.hpp>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Receiving side of the master -> worker batches
+ * @details Keeps two batch headers preposted as persistent receives, so the
+ *          header of the next batch is matched as soon as it arrives. When it
+ *          is already there once the current batch has been unpacked, its
+ *          payload receive is posted too and the data streams in while the
+ *          current batch is evaluated.
+ *          Payload buffers grow to the largest batch seen and are never
+ *          shrunk, so a steady stream of batches does not allocate. Batches
+ *          placed in the NodeSharedRegion are read in place.
+ *          The channel must be destroyed before MPI_Finalize.
+ */
+class WorkerChannel {
+ public:
+  explicit WorkerChannel(i32 master_rank);
+  ~WorkerChannel();
+  WorkerChannel(const WorkerChannel&) = delete;
+  WorkerChannel& operator=(const WorkerChannel&) = delete;
+
+  /**
+   * @brief Wait for the next batch
+   * @details The returned work, and the exams it points to, are valid until
+   *          the following call.
+   */
+  const MPIWork& next();
+
+ private:
+  struct Slot {
+    MPIBatchHeader header{};
+    MPI_Request header_request = MPI_REQUEST_NULL;
+    bool header_armed = false; /** Header receive started, not completed */
+    std::vector<char> payload;
+    MPI_Request payload_request = MPI_REQUEST_NULL;
+    bool payload_posted = false;
+  };
+
+  void _post_payload(Slot& slot);
+
+  i32 _master_rank;
+  std::array<Slot, 2> _slots;
+  size_t _current = 0;
+  MPIWork _work{};
+};
+
+#endif  // CHANNEL_HPP
@@ -0,0 +1,544 @@
+#include "codec.hpp"
+#include <array>
+#include <charconv>
+#include <cctype>
+#include <cmath>
+#include <nlohmann/json.hpp>
+
+namespace {
+
+/**
+ * @brief Cursor over a JSON text for the plain-form readers
+ */
+class Reader {
+ public:
+  explicit Reader(std::string_view text)
+      : _it(text.data()), _end(text.data() + text.size()) {}
+
+  void skip_whitespace() {
+    while (_it != _end &&
+           (*_it == ' ' || *_it == '\n' || *_it == '\r' || *_it == '\t')) {
+      _it++;
+    }
+  }
+
+  bool consume(char c) {
+    skip_whitespace();
+    if (_it == _end || *_it != c) {
+      return false;
+    }
+    _it++;
+    return true;
+  }
+
+  bool peek(char c) {
+    skip_whitespace();
+    return _it != _end && *_it == c;
+  }
+
+  bool at_end() {
+    skip_whitespace();
+    return _it == _end;
+  }
+
+  /** Read a key without escapes and the ':' after it */
+  bool key(std::string_view& key) {
+    if (!consume('"')) {
+      return false;
+    }
+    const auto* begin = _it;
+    while (_it != _end && *_it != '"') {
+      if (*_it == '\\' || static_cast<u8>(*_it) < 0x20) {
+        return false;
+      }
+      _it++;
+    }
+    if (_it == _end) {
+      return false;
+    }
+    key = std::string_view(begin, _it - begin);
+    _it++;
+    return consume(':');
+  }
+
+  /** Read a string without escapes */
+  bool string(std::string_view& value) {
+    if (!consume('"')) {
+      return false;
+    }
+    const auto* begin = _it;
+    while (_it != _end && *_it != '"') {
+      if (*_it == '\\' || static_cast<u8>(*_it) < 0x20) {
+        return false;
+      }
+      _it++;
+    }
+    if (_it == _end) {
+      return false;
+    }
+    value = std::string_view(begin, _it - begin);
+    _it++;
+    return true;
+  }
+
+  /** Read a null literal */
+  bool null() {
+    skip_whitespace();
+    if (_end - _it < 4 || std::string_view(_it, 4) != "null") {
+      return false;
+    }
+    _it += 4;
+    return true;
+  }
+
+  /** Read an integer that fits an i32 */
+  bool integer(i32& value) {
+    skip_whitespace();
+    const auto* first = _it != _end && *_it == '-' ? _it + 1 : _it;
+    if (_end - first > 1 && first[0] == '0' && first[1] >= '0' &&
+        first[1] <= '9') {
+      return false;  // leading zeros
+    }
+    auto [ptr, ec] = std::from_chars(_it, _end, value);
+    if (ec != std::errc() || ptr == _end || *ptr == '.' || *ptr == 'e' ||
+        *ptr == 'E') {
+      return false;
+    }
+    _it = ptr;
+    return true;
+  }
+
+  /** Skip a value of a key we do not read */
+  bool skip_value() {
+    skip_whitespace();
+    if (_it == _end) {
+      return false;
+    }
+    if (*_it == '"') {
+      for (_it++; _it != _end && *_it != '"'; _it++) {
+        if (static_cast<u8>(*_it) < 0x20) {
+          return false;  // control characters must be escaped
+        }
+        if (*_it == '\\' && !escape()) {
+          return false;
+        }
+      }
+      return _it != _end && ++_it;
+    }
+    if (*_it == '[' || *_it == '{') {
+      auto close = *_it == '[' ? ']' : '}';
+      _it++;
+      if (consume(close)) {
+        return true;
+      }
+      do {
+        if (close == '}') {
+          std::string_view ignored;
+          if (!key(ignored)) {
+            return false;
+          }
+        }
+        if (!skip_value()) {
+          return false;
+        }
+      } while (consume(','));
+      return consume(close);
+    }
+    return word("true") || word("false") || null() || number();
+  }
+
+  /** Read a literal */
+  bool word(std::string_view literal) {
+    if (static_cast<size_t>(_end - _it) < literal.size() ||
+        std::string_view(_it, literal.size()) != literal) {
+      return false;
+    }
+    _it += literal.size();
+    return true;
+  }
+
+  /** Read a number of any form */
+  bool number() {
+    if (_it != _end && *_it == '-') {
+      _it++;
+    }
+    if (_it != _end && *_it == '0') {
+      _it++;
+    } else if (!digits()) {
+      return false;
+    }
+    if (_it != _end && *_it == '.') {
+      _it++;
+      if (!digits()) {
+        return false;
+      }
+    }
+    if (_it != _end && (*_it == 'e' || *_it == 'E')) {
+      _it++;
+      if (_it != _end && (*_it == '+' || *_it == '-')) {
+        _it++;
+      }
+      return digits();
+    }
+    return true;
+  }
+
+  /**
+   * @brief Read an object calling `field(key)` for every key
+   * @details `field` returns false to abort.
+   */
+  template <typename Field>
+  bool object(Field&& field) {
+    if (!consume('{')) {
+      return false;
+    }
+    if (consume('}')) {
+      return true;
+    }
+    do {
+      std::string_view name;
+      if (!key(name) || !field(name)) {
+        return false;
+      }
+    } while (consume(','));
+    return consume('}');
+  }
+
+  /**
+   * @brief Read an array calling `element()` for every element
+   */
+  template <typename Element>
+  bool array(Element&& element) {
+    if (!consume('[')) {
+      return false;
+    }
+    if (consume(']')) {
+      return true;
+    }
+    do {
+      if (!element()) {
+        return false;
+      }
+    } while (consume(','));
+    return consume(']');
+  }
+
+ private:
+  bool digits() {
+    const auto* begin = _it;
+    while (_it != _end && *_it >= '0' && *_it <= '9') {
+      _it++;
+    }
+    return _it != begin;
+  }
+
+  /** Step over the escape at `_it`, leaving `_it` on its last character */
+  bool escape() {
+    if (++_it == _end) {
+      return false;
+    }
+    if (*_it != 'u') {
+      return std::string_view("\"\\/bfnrt").find(*_it) !=
+             std::string_view::npos;
+    }
+    for (i32 i = 0; i < 4; i++) {
+      if (++_it == _end || !std::isxdigit(static_cast<u8>(*_it))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const char* _it;
+  const char* _end;
+};
+
+/**
+ * @brief Read a required i32 field once
+ */
+bool read_field(Reader& reader, bool& seen, i32& value) {
+  if (seen) {
+    return false;  // duplicated key
+  }
+  seen = true;
+  return reader.integer(value);
+}
+
+void append_integer(std::string& output, i32 value) {
+  std::array<char, 16> buffer;
+  auto [end, ec] = std::to_chars(buffer.begin(), buffer.end(), value);
+  output.append(buffer.data(), end);
+}
+
+/**
+ * @brief Append a JSON string, escaped as nlohmann does
+ */
+void append_string(std::string& output, std::string_view value) {
+  static constexpr char hex[] = "0123456789abcdef";
+  output.push_back('"');
+  for (auto c : value) {
+    switch (c) {
+      case '"':
+        output.append("\\\"");
+        break;
+      case '\\':
+        output.append("\\\\");
+        break;
+      case '\b':
+        output.append("\\b");
+        break;
+      case '\f':
+        output.append("\\f");
+        break;
+      case '\n':
+        output.append("\\n");
+        break;
+      case '\r':
+        output.append("\\r");
+        break;
+      case '\t':
+        output.append("\\t");
+        break;
+      default:
+        if (static_cast<u8>(c) < 0x20) {
+          output.append("\\u00");
+          output.push_back(hex[static_cast<u8>(c) >> 4]);
+          output.push_back(hex[c & 0xf]);
+        } else {
+          output.push_back(c);
+        }
+    }
+  }
+  output.push_back('"');
+}
+
+void append_double(std::string& output, double value) {
+  if (!std::isfinite(value)) {
+    output.append("null");
+    return;
+  }
+  std::array<char, 64> buffer;
+  // Same routine as nlohmann's serializer, so the output is identical
+  auto* end =
+      nlohmann::detail::to_chars(buffer.data(), buffer.data() + 64, value);
+  output.append(buffer.data(), end);
+}
+
+}  // namespace
+
+void JsonCodec::write_results(std::span<const MPIResult> results,
+                              std::string& output) {
+  output.reserve(output.size() + results.size() * 128 + 2);
+  output.push_back('[');
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& result = results[i];
+    output.append(i == 0 ? "{\"correct_answers\":" : ",{\"correct_answers\":");
+    append_integer(output, result.correct_answers);
+    output.append(",\"id_exam\":");
+    append_integer(output, result.id_exam);
+    output.append(",\"score\":");
+    append_double(output, result.score);
+    output.append(",\"stage\":");
+    append_integer(output, result.stage);
+    output.append(",\"unscored_answers\":");
+    append_integer(output, result.unscored_answers);
+    output.append(",\"wrong_answers\":");
+    append_integer(output, result.wrong_answers);
+    output.push_back('}');
+  }
+  output.push_back(']');
+}
+
+void JsonCodec::write_sheet_results(std::span<const MPIResult> results,
+                                    std::span<const AnswerSheet> sheets,
+                                    std::string& output) {
+  output.reserve(output.size() + results.size() * 160 + 2);
+  output.push_back('[');
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& result = results[i];
+    output.append(i == 0 ? "{\"correct_answers\":" : ",{\"correct_answers\":");
+    append_integer(output, result.correct_answers);
+    output.append(",\"exam_id\":");
+    append_string(output, sheets[i].exam_id);
+    output.append(",\"score\":");
+    append_double(output, result.score);
+    output.append(",\"student_id\":");
+    append_string(output, sheets[i].student_id);
+    output.append(",\"unscored_answers\":");
+    append_integer(output, result.unscored_answers);
+    output.append(",\"wrong_answers\":");
+    append_integer(output, result.wrong_answers);
+    output.push_back('}');
+  }
+  output.push_back(']');
+}
+
+void JsonCodec::write_answers(std::span<const ExamAnswers* const> answers,
+                              std::string& output, const IdTable* names) {
+  output.push_back('[');
+  for (size_t i = 0; i < answers.size(); i++) {
+    const auto& exam_answers = *answers[i];
+    output.reserve(output.size() + exam_answers.answers.size() * 32 + 32);
+    output.append(i == 0 ? "{\"answers\":[" : ",{\"answers\":[");
+    for (size_t j = 0; j < exam_answers.answers.size(); j++) {
+      const auto& answer = exam_answers.answers[j];
+      output.append(j == 0 ? "{\"qst_idx\":" : ",{\"qst_idx\":");
+      append_integer(output, answer.qst_idx);
+      output.append(",\"rans_idx\":");
+      append_integer(output, answer.rans_idx);
+      output.push_back('}');
+    }
+    auto stage = exam_answers.stage;
+    if (names != nullptr && stage >= IdTable::FIRST_ID &&
+        static_cast<size_t>(stage - IdTable::FIRST_ID) < names->size()) {
+      output.append("],\"exam_id\":");
+      append_string(output, names->name(stage));
+    } else {
+      output.append("],\"stage\":");
+      append_integer(output, stage);
+    }
+    output.push_back('}');
+  }
+  output.push_back(']');
+}
+
+bool JsonCodec::read_exams(std::string_view text,
+                           std::vector<MPIExam>& exams) {
+  Reader reader(text);
+  exams.clear();
+  auto exam = [&]() {
+    auto& current = exams.emplace_back();
+    bool stage = false, id_exam = false, answers = false;
+    auto answer = [&]() {
+      i32 qst = 0, ans = 0;
+      bool qst_idx = false, ans_idx = false;
+      return reader.object([&](std::string_view key) {
+        if (key == "qst_idx") {
+          return read_field(reader, qst_idx, qst);
+        }
+        if (key == "ans_idx") {
+          return read_field(reader, ans_idx, ans);
+        }
+        return reader.skip_value();
+      }) && qst_idx && ans_idx && current.answer(qst, ans);
+    };
+    return reader.object([&](std::string_view key) {
+      if (key == "stage") {
+        return read_field(reader, stage, current.stage);
+      }
+      if (key == "id_exam") {
+        return read_field(reader, id_exam, current.id_exam);
+      }
+      if (key == "answers") {
+        if (answers) {
+          return false;
+        }
+        answers = true;
+        return reader.array(answer);
+      }
+      return reader.skip_value();
+    }) && stage && id_exam && answers && current.stage <= MAX_STAGE;
+  };
+  return reader.array(exam) && reader.at_end();
+}
+
+bool JsonCodec::read_answers(std::string_view text,
+                             std::vector<ExamAnswers>& answers) {
+  Reader reader(text);
+  answers.clear();
+  auto exam_answers = [&]() {
+    auto& current = answers.emplace_back();
+    bool stage = false, keys = false;
+    auto answer = [&]() {
+      auto& key = current.answers.emplace_back();
+      bool qst_idx = false, rans_idx = false;
+      return reader.object([&](std::string_view name) {
+        if (name == "qst_idx") {
+          return read_field(reader, qst_idx, key.qst_idx);
+        }
+        if (name == "rans_idx") {
+          return read_field(reader, rans_idx, key.rans_idx);
+        }
+        return reader.skip_value();
+      }) && qst_idx && rans_idx;
+    };
+    return reader.object([&](std::string_view name) {
+      if (name == "stage") {
+        return read_field(reader, stage, current.stage);
+      }
+      if (name == "answers") {
+        if (keys) {
+          return false;
+        }
+        keys = true;
+        return reader.array(answer);
+      }
+      return reader.skip_value();
+    }) && stage && keys;
+  };
+  return reader.array(exam_answers) && reader.at_end();
+}
+
+bool JsonCodec::read_sheets(std::string_view text,
+                            std::vector<AnswerSheet>& sheets) {
+  Reader reader(text);
+  sheets.clear();
+  auto sheet = [&]() {
+    auto& current = sheets.emplace_back();
+    bool student_id = false, exam_id = false, answers = false;
+    auto name = [&](bool& seen, std::string& value) {
+      std::string_view text;
+      if (seen || !reader.string(text)) {
+        return false;
+      }
+      seen = true;
+      value = text;
+      return true;
+    };
+    auto answer = [&]() {
+      std::string_view letter;
+      if (reader.null()) {
+        current.answers.push_back(0);
+        return true;
+      }
+      auto choice = reader.string(letter) ? LetterFormat::choice(letter) : -1;
+      if (choice < 0 || current.answers.size() >=
+                            static_cast<size_t>(MAX_QUESTIONS)) {
+        return false;
+      }
+      current.answers.push_back(static_cast<u8>(choice));
+      return true;
+    };
+    return reader.object([&](std::string_view key) {
+      if (key == "student_id") {
+        return name(student_id, current.student_id);
+      }
+      if (key == "exam_id") {
+        return name(exam_id, current.exam_id);
+      }
+      if (key == "answers") {
+        if (answers) {
+          return false;
+        }
+        answers = true;
+        return reader.array(answer);
+      }
+      return reader.skip_value();
+    }) && student_id && exam_id && answers;
+  };
+  if (!reader.peek('{')) {
+    return reader.array(sheet) && reader.at_end();
+  }
+  bool exams = false;
+  return reader.object([&](std::string_view key) {
+    if (key == "exams") {
+      if (exams) {
+        return false;
+      }
+      exams = true;
+      return reader.array(sheet);
+    }
+    // The sink writes exams of the numeric form
+    return key != "sink" && reader.skip_value();
+  }) && exams && !sheets.empty() && reader.at_end();
+}
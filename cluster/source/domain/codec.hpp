@@ -0,0 +1,82 @@
+#pragma once
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <domain/answers.hpp>
+#include <domain/coordinator.hpp>
+#include <domain/letters.hpp>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief JSON encoder and decoder specialized for the hot message types
+ * @details The writers append straight to the output string and produce the
+ *          same bytes as `nlohmann::json(value).dump()`: keys in sorted
+ *          order, no whitespace and doubles formatted by the same Grisu2
+ *          routine nlohmann uses.
+ *          The readers scan the text once without building a DOM. They only
+ *          accept the plain form of each document (integers that fit an i32,
+ *          keys without escapes, no duplicated keys); anything else, and
+ *          any text nlohmann would reject, makes them return false so the
+ *          caller can fall back to nlohmann, which keeps the previous
+ *          behavior and error messages for unusual input.
+ */
+class JsonCodec {
+ public:
+  JsonCodec() = delete;
+  ~JsonCodec() = delete;
+
+  /**
+   * @brief Append an array of results, as `json(results).dump()`
+   */
+  static void write_results(std::span<const MPIResult> results,
+                            std::string& output);
+
+  /**
+   * @brief Append an array of answer keys, as `json(answers).dump()`
+   * @param names Names of the named stages, whose keys are written with
+   *        "exam_id" in place of "stage"
+   */
+  static void write_answers(std::span<const ExamAnswers* const> answers,
+                            std::string& output,
+                            const IdTable* names = nullptr);
+
+  /**
+   * @brief Append the results of letter sheets, in the order of the sheets:
+   *        [{"correct_answers", "exam_id", "score", "student_id",
+   *        "unscored_answers", "wrong_answers"}, ...]
+   */
+  static void write_sheet_results(std::span<const MPIResult> results,
+                                  std::span<const AnswerSheet> sheets,
+                                  std::string& output);
+
+  /**
+   * @brief Read an array of exams: [{"stage", "id_exam", "answers":
+   *        [{"qst_idx", "ans_idx"}, ...]}, ...]
+   * @return false if the text is not in the plain form, a stage is over
+   *         MAX_STAGE or an answer is out of the range of MPIExam::answer
+   */
+  static bool read_exams(std::string_view text, std::vector<MPIExam>& exams);
+
+  /**
+   * @brief Read an array of answer keys: [{"stage", "answers":
+   *        [{"qst_idx", "rans_idx"}, ...]}, ...]
+   * @return false if the text is not in the plain form
+   */
+  static bool read_answers(std::string_view text,
+                           std::vector<ExamAnswers>& answers);
+
+  /**
+   * @brief Read letter sheets: an array of sheets or {"exams": [...]}
+   * @return false if the text is not in the plain form (names without
+   *         escapes, letters A..Z, "" or null) or it has a sink
+   * @see LetterFormat
+   */
+  static bool read_sheets(std::string_view text,
+                          std::vector<AnswerSheet>& sheets);
+};
+
+#endif  // CODEC_HPP
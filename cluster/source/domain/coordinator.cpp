@@ -1,6 +1,16 @@
 #include "coordinator.hpp"
 #include <spdlog/spdlog.h>
+#include <algorithm>
 #include <domain/answers.hpp>
+#include <domain/packing.hpp>
+#include <domain/queue.hpp>
+#include <domain/shared.hpp>
+#include <domain/similarity.hpp>
+#include <domain/sink.hpp>
+#include <numeric>
+#include <system/environment.hpp>
+#include <system/logger.hpp>
+#include <system/tracer.hpp>
 
 std::unique_ptr<MPICoordinator> MPICoordinator::_instance = nullptr;
 
@@ -11,7 +21,9 @@ MPICoordinator& MPICoordinator::instance() {
   return *_instance;
 }
 
-MPICoordinator::MPICoordinator() {
+MPICoordinator::MPICoordinator()
+    : _resident_capacity(
+          Environment::get_or<u64>("SH_RESIDENT_MAX_EXAMS", 1 << 20)) {
   create_types();
   set_config(CoordinatorConfig());
 }
@@ -20,21 +32,100 @@ void MPICoordinator::set_config(const CoordinatorConfig& config) {
   _config = config;
 }
 
+void MPICoordinator::set_communicator(MPI_Comm comm) {
+  _comm = comm;
+  MPI_Comm_size(_comm, &_comm_size);
+  std::vector<i32> ranks(_comm_size);
+  std::iota(ranks.begin(), ranks.end(), 0);
+  std::vector<i32> world_ranks(_comm_size);
+  MPI_Group group, world_group;
+  MPI_Comm_group(_comm, &group);
+  MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+  MPI_Group_translate_ranks(group, _comm_size, ranks.data(), world_group,
+                            world_ranks.data());
+  MPI_Group_free(&group);
+  MPI_Group_free(&world_group);
+  _workers.clear();
+  for (i32 rank = 1; rank < _comm_size; rank++) {  // 0 is master
+    _workers[rank] = {_comm, MPI_COMM_NULL, rank, world_ranks[rank], false};
+  }
+}
+
+i32 MPICoordinator::world_rank(i32 worker) const {
+  auto it = _workers.find(worker);
+  return it == _workers.end() ? worker : it->second.world_rank;
+}
+
+std::pair<MPI_Comm, i32> MPICoordinator::_route(i32 id) const {
+  auto it = _workers.find(id);
+  if (it == _workers.end()) {
+    return {_comm, id};
+  }
+  return {it->second.comm, it->second.rank};
+}
+
+void MPICoordinator::set_spawn_command(const std::string& command,
+                                       i32 first_rank, i32 stride) {
+  _spawn_command = command;
+  _spawn_first_rank = first_rank;
+  _spawn_stride = stride;
+  // A failed spawn is reported to the caller instead of aborting the job
+  MPI_Comm_set_errhandler(MPI_COMM_SELF, MPI_ERRORS_RETURN);
+}
+
+i32 MPICoordinator::spawn_worker() {
+  if (_spawn_command.empty()) {
+    throw std::runtime_error("Workers cannot be spawned");
+  }
+  MPI_Comm intercomm;
+  i32 error_code = MPI_SUCCESS;
+  auto spawn_result =
+      MPI_Comm_spawn(_spawn_command.c_str(), MPI_ARGV_NULL, 1, MPI_INFO_NULL,
+                     0, MPI_COMM_SELF, &intercomm, &error_code);
+  if (spawn_result != MPI_SUCCESS || error_code != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to spawn a worker");
+  }
+  // Master low, worker high: the master is rank 0 as in _comm
+  MPI_Comm comm;
+  MPI_Intercomm_merge(intercomm, 0, &comm);
+  auto world_rank = _spawn_first_rank + _spawn_count * _spawn_stride;
+  MPI_Bcast(&world_rank, 1, MPI_INT, 0, comm);
+  auto id = _comm_size + _spawn_count;
+  _spawn_count++;
+  _spawned++;
+  _workers[id] = {comm, intercomm, 1, world_rank, true};
+  spdlog::info("Spawned worker {} ({} spawned)", world_rank, _spawned);
+  return id;
+}
+
+void MPICoordinator::_release(WorkerPeer& peer) {
+  // Disconnecting the merged communicator itself does not return, the
+  // spawn intercommunicator is the one both sides disconnect
+  MPI_Comm_free(&peer.comm);
+  MPI_Comm_disconnect(&peer.intercomm);
+}
+
+bool MPICoordinator::retire_worker() {
+  auto newest = std::ranges::find_if(
+      _workers.rbegin(), _workers.rend(),
+      [](const auto& member) { return member.second.spawned; });
+  if (newest == _workers.rend() || _resident) {
+    return false;  // its kept exams would be lost
+  }
+  auto id = newest->first;
+  auto peer = newest->second;
+  send_batch(MPICommand::SHUTDOWN, {}, "", "", id);
+  _release(peer);
+  _workers.erase(id);
+  _spawned--;
+  spdlog::info("Retired worker {} ({} spawned)", peer.world_rank, _spawned);
+  return true;
+}
+
 void MPICoordinator::create_types() {
   if (_types_created) {
     return;
   }
-  {
-    i32 count = 2;
-    i32 block_lengths[] = {1, 1};
-    MPI_Aint displacements[] = {offsetof(MPIQuestion, qst_idx),
-                                offsetof(MPIQuestion, ans_idx)};
-    MPI_Datatype types[] = {MPI_INT, MPI_INT};
-
-    MPI_Type_create_struct(count, block_lengths, displacements, types,
-                           &_mpi_question_type);
-    MPI_Type_commit(&_mpi_question_type);
-  }
   {
     i32 count = 6;
     i32 block_lengths[] = {1, 1, 1, 1, 1, 1};
@@ -52,23 +143,54 @@ void MPICoordinator::create_types() {
     MPI_Type_commit(&_mpi_result_type);
   }
   {
-    i32 count = 3;
-    i32 block_lengths[] = {1, 1, 1};
+    i32 count = 4;
+    i32 block_lengths[] = {1, 1, 1, 1};
     MPI_Aint displacements[] = {offsetof(MPIExamHeader, stage),
                                 offsetof(MPIExamHeader, id_exam),
-                                offsetof(MPIExamHeader, answers_size)};
-    MPI_Datatype types[] = {MPI_INT, MPI_INT, MPI_INT};
+                                offsetof(MPIExamHeader, answers_size),
+                                offsetof(MPIExamHeader, answer_bits)};
+    MPI_Datatype types[] = {MPI_INT, MPI_INT, MPI_INT, MPI_INT};
     MPI_Type_create_struct(count, block_lengths, displacements, types,
                            &_mpi_exam_header_type);
     MPI_Type_commit(&_mpi_exam_header_type);
   }
+  {
+    i32 count = 6;
+    i32 block_lengths[] = {1, 1, 1, 1, 1, 1};
+    MPI_Aint displacements[] = {offsetof(MPISinkSummary, rows),
+                                offsetof(MPISinkSummary, bytes),
+                                offsetof(MPISinkSummary, correct_answers),
+                                offsetof(MPISinkSummary, wrong_answers),
+                                offsetof(MPISinkSummary, unscored_answers),
+                                offsetof(MPISinkSummary, score_sum)};
+    MPI_Datatype types[] = {MPI_INT64_T, MPI_INT64_T, MPI_INT64_T,
+                            MPI_INT64_T, MPI_INT64_T, MPI_DOUBLE};
+    MPI_Type_create_struct(count, block_lengths, displacements, types,
+                           &_mpi_sink_summary_type);
+    MPI_Type_commit(&_mpi_sink_summary_type);
+  }
+  {
+    i32 count = 5;
+    i32 block_lengths[] = {1, 1, 1, 1, 1};
+    MPI_Aint displacements[] = {offsetof(MPISimilarPair, stage),
+                                offsetof(MPISimilarPair, id_exam_a),
+                                offsetof(MPISimilarPair, id_exam_b),
+                                offsetof(MPISimilarPair, matching_wrong),
+                                offsetof(MPISimilarPair, matching_answers)};
+    MPI_Datatype types[] = {MPI_INT, MPI_INT, MPI_INT, MPI_INT, MPI_INT};
+    MPI_Type_create_struct(count, block_lengths, displacements, types,
+                           &_mpi_similar_pair_type);
+    MPI_Type_commit(&_mpi_similar_pair_type);
+  }
   _types_created = true;
 }
 
 void MPICoordinator::free_types() {
   if (_types_created) {
-    MPI_Type_free(&_mpi_question_type);
     MPI_Type_free(&_mpi_result_type);
+    MPI_Type_free(&_mpi_exam_header_type);
+    MPI_Type_free(&_mpi_sink_summary_type);
+    MPI_Type_free(&_mpi_similar_pair_type);
     _types_created = false;
   }
 }
@@ -77,145 +199,258 @@ MPICoordinator::~MPICoordinator() {
   free_types();
 }
 
-void MPICoordinator::send_exam_batch(const std::vector<MPIExam>& exams,
-                                     i32 dest_rank, i32 tag) {
-  i32 exams_size = exams.size();
-  auto send_result =
-      MPI_Send(&exams_size, 1, MPI_INT, dest_rank, tag, MPI_COMM_WORLD);
+void MPICoordinator::send_results(const std::vector<MPIResult>& results,
+                                  i32 dest_rank, i32 tag) {
+  auto [comm, rank] = _route(dest_rank);
+  i32 results_size = results.size();
+  auto send_result = MPI_Send(&results_size, 1, MPI_INT, rank, tag, comm);
   if (send_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to send exam batch size");
+    throw std::runtime_error("Failed to send results size");
   }
-  MPIExamHeader header;
-  i32 size = 0;
-  for (const auto& exam : exams) {
-    size = static_cast<i32>(exam.answers.size());
-    header = {exam.stage, exam.id_exam, size};
-    send_result = MPI_Send(&header, 1, _mpi_exam_header_type, dest_rank, tag,
-                           MPI_COMM_WORLD);
-    if (send_result != MPI_SUCCESS) {
-      throw std::runtime_error("Failed to send exam header");
-    }
-    if (!exam.answers.empty()) {
-      send_result = MPI_Send(exam.answers.data(), size, _mpi_question_type,
-                             dest_rank, tag, MPI_COMM_WORLD);
-      if (send_result != MPI_SUCCESS) {
-        throw std::runtime_error("Failed to send exam answers");
-      }
-    }
+  if (results_size == 0) {
+    return;  // a RESCORE may change nothing
+  }
+  send_result = MPI_Send(results.data(), results_size, _mpi_result_type,
+                         rank, tag, comm);
+  if (send_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to send results");
   }
 }
 
-std::vector<MPIExam> MPICoordinator::receive_exam_batch(i32 source_rank,
-                                                        i32 tag) {
-  i32 batch_size = 0;
-  auto recv_result = MPI_Recv(&batch_size, 1, MPI_INT, source_rank, tag,
-                              MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+std::vector<MPIResult> MPICoordinator::receive_results(i32 source_rank,
+                                                       i32 tag) {
+  auto [comm, rank] = _route(source_rank);
+  i32 results_size = 0;
+  auto recv_result = MPI_Recv(&results_size, 1, MPI_INT, rank, tag, comm,
+                              MPI_STATUS_IGNORE);
   if (recv_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to receive exam batch size");
+    throw std::runtime_error("Failed to receive results size");
+  }
+  if (results_size < 0) {
+    throw std::runtime_error("Invalid results size");
   }
-  if (batch_size <= 0 || batch_size > std::numeric_limits<i32>::max()) {
-    throw std::runtime_error("Invalid exam batch size");
+  std::vector<MPIResult> results(results_size);
+  if (results_size == 0) {
+    return results;
   }
-  std::vector<MPIExam> exams(batch_size);
-  MPIExamHeader header;
-  for (auto& exam : exams) {
-    recv_result = MPI_Recv(&header, 1, _mpi_exam_header_type, source_rank, tag,
-                           MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    if (recv_result != MPI_SUCCESS) {
-      throw std::runtime_error("Failed to receive exam header");
-    }
-    if (header.answers_size > 0) {
-      exam.answers.resize(header.answers_size);
-      recv_result =
-          MPI_Recv(exam.answers.data(), header.answers_size, _mpi_question_type,
-                   source_rank, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      if (recv_result != MPI_SUCCESS) {
-        throw std::runtime_error("Failed to receive exam answers");
-      }
-    }
-    exam.stage = header.stage;
-    exam.id_exam = header.id_exam;
+  recv_result = MPI_Recv(results.data(), results_size, _mpi_result_type,
+                         rank, tag, comm, MPI_STATUS_IGNORE);
+  if (recv_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to receive results");
   }
-  return exams;
+  return results;
 }
 
-void MPICoordinator::send_answers(const std::string& answers, i32 dest_rank,
-                                  i32 tag) {
-  i32 answers_size = answers.size();
-  auto send_result =
-      MPI_Send(&answers_size, 1, MPI_INT, dest_rank, tag, MPI_COMM_WORLD);
+void MPICoordinator::send_batch(MPICommand command,
+                                const std::vector<MPIExam>& exams,
+                                const std::string& answers,
+                                const std::string& sink, i32 dest_rank,
+                                i32 shared_answers, i32 part, i32 parts,
+                                i32 top_k) {
+  auto [comm, rank] = _route(dest_rank);
+  MPIBatchHeader header{static_cast<i32>(command),
+                        0,
+                        0,
+                        0,
+                        0,
+                        -1,
+                        -1,
+                        0,
+                        Tracer::instance().current(),
+                        part,
+                        parts,
+                        top_k};
+  header.exams = static_cast<i32>(exams.size());
+  _answer_bits.clear();
+  for (const auto& exam : exams) {
+    auto bits = AnswerPacking::bits_for(exam.answers);
+    _answer_bits.push_back(bits);
+    header.answer_words +=
+        static_cast<i32>(AnswerPacking::words(exam.answers.size(), bits));
+  }
+  header.answers_bytes = static_cast<i32>(answers.size());
+  header.sink_bytes = static_cast<i32>(sink.size());
+  header.shared_answers = shared_answers;
+  auto payload_size = batch_payload_size(header);
+  auto& region = NodeSharedRegion::instance();
+  auto slot = region.slot(dest_rank);
+  if (payload_size > 0 && payload_size <= slot.size()) {
+    // Intra-node worker: write the batch where the worker will read it
+    _pack_batch(header, exams, answers, sink, slot.data());
+    header.shared_payload = region.offset_of(slot.data());
+    payload_size = 0;
+  }
+  region.publish();
+  auto send_result = MPI_Send(&header, MPI_BATCH_HEADER_INTS, MPI_INT, rank,
+                              _config.mpi_tag_command, comm);
   if (send_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to send answers size");
+    throw std::runtime_error("Failed to send batch header");
   }
-  send_result = MPI_Send(answers.data(), answers_size, MPI_CHAR, dest_rank, tag,
-                         MPI_COMM_WORLD);
+  if (payload_size == 0) {
+    return;
+  }
+  _send_buffer.resize(payload_size);
+  _pack_batch(header, exams, answers, sink, _send_buffer.data());
+  send_result = MPI_Send(_send_buffer.data(), static_cast<i32>(payload_size),
+                         MPI_BYTE, rank, _config.mpi_tag_exams, comm);
   if (send_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to send answers");
+    throw std::runtime_error("Failed to send batch payload");
   }
 }
 
-std::string MPICoordinator::receive_answers(i32 source_rank, i32 tag) {
-  i32 answers_size = 0;
-  auto recv_result = MPI_Recv(&answers_size, 1, MPI_INT, source_rank, tag,
-                              MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  if (recv_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to receive answers size");
+void MPICoordinator::send_queue_job(MPICommand command, i32 exams,
+                                    i32 answer_words,
+                                    const std::string& answers,
+                                    const std::string& sink, i32 dest_rank) {
+  auto [comm, rank] = _route(dest_rank);
+  MPIBatchHeader header{static_cast<i32>(command),
+                        exams,
+                        answer_words,
+                        static_cast<i32>(answers.size()),
+                        static_cast<i32>(sink.size()),
+                        -1,
+                        -1,
+                        RMAWorkQueue::instance().chunk(),
+                        Tracer::instance().current(),
+                        0,
+                        0,
+                        0};
+  auto send_result = MPI_Send(&header, MPI_BATCH_HEADER_INTS, MPI_INT, rank,
+                              _config.mpi_tag_command, comm);
+  if (send_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to send queue job header");
   }
-  if (answers_size <= 0 || answers_size > std::numeric_limits<i32>::max()) {
-    throw std::runtime_error("Invalid answers size");
+  _send_buffer.assign(answers.begin(), answers.end());
+  _send_buffer.insert(_send_buffer.end(), sink.begin(), sink.end());
+  if (_send_buffer.empty()) {
+    return;
   }
-  std::string answers(answers_size, '\0');
-  recv_result = MPI_Recv(answers.data(), answers_size, MPI_CHAR, source_rank,
-                         tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  if (recv_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to receive answers");
+  send_result = MPI_Send(_send_buffer.data(),
+                         static_cast<i32>(_send_buffer.size()), MPI_BYTE,
+                         rank, _config.mpi_tag_exams, comm);
+  if (send_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to send queue job payload");
   }
-  return answers;
 }
 
-void MPICoordinator::send_results(const std::vector<MPIResult>& results,
-                                  i32 dest_rank, i32 tag) {
-  i32 results_size = results.size();
-  auto send_result =
-      MPI_Send(&results_size, 1, MPI_INT, dest_rank, tag, MPI_COMM_WORLD);
-  if (send_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to send results size");
+void MPICoordinator::_pack_batch(const MPIBatchHeader& header,
+                                 const std::vector<MPIExam>& exams,
+                                 const std::string& answers,
+                                 const std::string& sink, char* output) const {
+  // Payload: exam headers, packed answers, answer keys and sink target
+  auto* exam_headers = reinterpret_cast<MPIExamHeader*>(output);
+  auto* words = reinterpret_cast<u64*>(
+      output + header.exams * sizeof(MPIExamHeader));
+  for (size_t i = 0; i < exams.size(); i++) {
+    const auto& exam = exams[i];
+    auto size = static_cast<i32>(exam.answers.size());
+    *exam_headers++ = {exam.stage, exam.id_exam, size, _answer_bits[i]};
+    words = AnswerPacking::pack(exam.answers, _answer_bits[i], words);
   }
-  for (const auto& result : results) {
-    send_result =
-        MPI_Send(&result, 1, _mpi_result_type, dest_rank, tag, MPI_COMM_WORLD);
-    if (send_result != MPI_SUCCESS) {
-      throw std::runtime_error("Failed to send results");
-    }
+  auto* tail = reinterpret_cast<char*>(words);
+  if (header.shared_answers < 0) {
+    tail = std::copy(answers.begin(), answers.end(), tail);
   }
+  std::copy(sink.begin(), sink.end(), tail);
 }
 
-std::vector<MPIResult> MPICoordinator::receive_results(i32 source_rank,
-                                                       i32 tag) {
-  i32 results_size = 0;
-  auto recv_result = MPI_Recv(&results_size, 1, MPI_INT, source_rank, tag,
-                              MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  if (recv_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to receive results size");
+size_t MPICoordinator::batch_payload_size(const MPIBatchHeader& header) {
+  size_t answers_bytes = header.shared_answers < 0 ? header.answers_bytes : 0;
+  if (header.queue_chunk > 0) {
+    return answers_bytes + header.sink_bytes;
   }
-  if (results_size <= 0 || results_size > std::numeric_limits<i32>::max()) {
-    throw std::runtime_error("Invalid results size");
+  return header.exams * sizeof(MPIExamHeader) +
+         header.answer_words * sizeof(u64) + answers_bytes +
+         header.sink_bytes;
+}
+
+void MPICoordinator::unpack_batch(const MPIBatchHeader& header,
+                                  std::span<const char> payload,
+                                  MPIWork& work) {
+  if (header.exams < 0 || header.answer_words < 0 ||
+      header.answers_bytes < 0 ||
+      header.sink_bytes < 0 || payload.size() < batch_payload_size(header)) {
+    throw std::runtime_error("Invalid batch header");
   }
-  std::vector<MPIResult> results(results_size);
-  for (auto& result : results) {
-    recv_result = MPI_Recv(&result, 1, _mpi_result_type, source_rank, tag,
-                           MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    if (recv_result != MPI_SUCCESS) {
-      throw std::runtime_error("Failed to receive results");
+  work.command = static_cast<MPICommand>(header.command);
+  work.queue_chunk = header.queue_chunk;
+  work.part = header.part;
+  work.parts = header.parts;
+  work.top_k = header.top_k;
+  work.queue_exams = 0;
+  work.queue_words = 0;
+  work.exams = {};
+  const char* tail = payload.data();
+  if (header.queue_chunk > 0) {
+    // The exams are claimed from the work queue
+    work.queue_exams = header.exams;
+    work.queue_words = header.answer_words;
+  } else {
+    const auto* exam_headers = reinterpret_cast<const MPIExamHeader*>(tail);
+    const auto* words = reinterpret_cast<const u64*>(
+        tail + header.exams * sizeof(MPIExamHeader));
+    work.exams.headers = {exam_headers, static_cast<size_t>(header.exams)};
+    work.exams.answers = {words, static_cast<size_t>(header.answer_words)};
+    size_t total_words = 0;
+    for (const auto& exam_header : work.exams.headers) {
+      if (exam_header.answers_size < 0 ||
+          (exam_header.answer_bits != AnswerPacking::NARROW_BITS &&
+           exam_header.answer_bits != AnswerPacking::WIDE_BITS)) {
+        throw std::runtime_error("Invalid exam header");
+      }
+      total_words += AnswerPacking::words(exam_header.answers_size,
+                                          exam_header.answer_bits);
+    }
+    if (total_words != static_cast<size_t>(header.answer_words)) {
+      throw std::runtime_error("Invalid exam header");
     }
+    tail = reinterpret_cast<const char*>(words + header.answer_words);
   }
-  return results;
+  if (header.answers_bytes > 0) {
+    const char* answers = tail;
+    if (header.shared_answers >= 0) {
+      answers = NodeSharedRegion::instance()
+                    .view(header.shared_answers, header.answers_bytes)
+                    .data();
+    } else {
+      tail += header.answers_bytes;
+    }
+    AnswersManager::instance().load_from_string(
+        std::string_view(answers, header.answers_bytes));
+  }
+  std::string_view sink(tail, header.sink_bytes);
+  auto separator = sink.find('\0');
+  work.sink_directory = sink.substr(0, separator);
+  work.sink_job =
+      separator == std::string_view::npos ? "" : sink.substr(separator + 1);
+}
+
+void MPICoordinator::send_sink_summary(const MPISinkSummary& summary,
+                                       i32 dest_rank, i32 tag) {
+  auto [comm, rank] = _route(dest_rank);
+  auto send_result =
+      MPI_Send(&summary, 1, _mpi_sink_summary_type, rank, tag, comm);
+  if (send_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to send sink summary");
+  }
+}
+
+MPISinkSummary MPICoordinator::receive_sink_summary(i32 source_rank,
+                                                    i32 tag) {
+  auto [comm, rank] = _route(source_rank);
+  MPISinkSummary summary{};
+  auto recv_result = MPI_Recv(&summary, 1, _mpi_sink_summary_type, rank,
+                              tag, comm, MPI_STATUS_IGNORE);
+  if (recv_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to receive sink summary");
+  }
+  return summary;
 }
 
 std::vector<std::vector<MPIExam>> MPICoordinator::_slice_exams(
-    const json& exams, i32 mpi_size) {
+    const json& exams) {
   try {
-    i32 workers_size = mpi_size - 1;  // 0 is master
+    auto workers_size = static_cast<i32>(_workers.size());
     i32 total_exams = static_cast<i32>(exams.size());
 
     // Si no hay exámenes, devolver vector vacío
@@ -232,7 +467,8 @@ std::vector<std::vector<MPIExam>> MPICoordinator::_slice_exams(
     // Solo crear slices para workers activos
     std::vector<std::vector<MPIExam>> exams_slices(active_workers);
 
-    spdlog::info(
+    SH_LOG_EVERY_MS(
+        spdlog::level::info, 1000,
         "Distributing {} exams among {} active workers ({} exams per worker)",
         total_exams, active_workers, exams_per_worker);
 
@@ -270,6 +506,10 @@ std::vector<std::vector<MPIExam>> MPICoordinator::_slice_exams(
 
         mpi_exam.stage = exam["stage"];
         mpi_exam.id_exam = exam["id_exam"];
+        if (mpi_exam.stage > MAX_STAGE) {
+          spdlog::error("Exam {} stage out of range", j);
+          throw std::runtime_error("Invalid exam format");
+        }
 
         // Validar que answers sea un array
         if (!exam["answers"].is_array()) {
@@ -277,15 +517,17 @@ std::vector<std::vector<MPIExam>> MPICoordinator::_slice_exams(
           throw std::runtime_error("Answers must be an array");
         }
 
-        mpi_exam.answers.resize(exam["answers"].size());
         for (size_t k = 0; k < exam["answers"].size(); k++) {
           auto& answer = exam["answers"][k];
           if (!answer.contains("qst_idx") || !answer.contains("ans_idx")) {
             spdlog::error("Answer {} in exam {} missing required fields", k, j);
             throw std::runtime_error("Invalid answer format");
           }
-          mpi_exam.answers[k].qst_idx = answer["qst_idx"];
-          mpi_exam.answers[k].ans_idx = answer["ans_idx"];
+          if (!mpi_exam.answer(answer["qst_idx"].get<i32>(),
+                             answer["ans_idx"].get<i32>())) {
+            spdlog::error("Answer {} in exam {} out of range", k, j);
+            throw std::runtime_error("Invalid answer format");
+          }
         }
       }
     }
@@ -296,9 +538,69 @@ std::vector<std::vector<MPIExam>> MPICoordinator::_slice_exams(
   }
 }
 
+std::vector<std::vector<MPIExam>> MPICoordinator::_slice_exams(
+    std::vector<MPIExam>&& exams) {
+  // Mismo reparto que la versión json, moviendo los exámenes ya decodificados
+  i32 total_exams = static_cast<i32>(exams.size());
+  if (total_exams == 0) {
+    spdlog::warn("No exams to slice");
+    return std::vector<std::vector<MPIExam>>();
+  }
+  i32 active_workers =
+      std::min(static_cast<i32>(_workers.size()), total_exams);
+  i32 exams_per_worker =
+      std::ceil(static_cast<double>(total_exams) / active_workers);
+  SH_LOG_EVERY_MS(
+      spdlog::level::info, 1000,
+      "Distributing {} exams among {} active workers ({} exams per worker)",
+      total_exams, active_workers, exams_per_worker);
+  std::vector<std::vector<MPIExam>> exams_slices(active_workers);
+  for (i32 i = 0; i < active_workers; i++) {
+    auto start_idx = std::min(i * exams_per_worker, total_exams);
+    auto end_idx = std::min(start_idx + exams_per_worker, total_exams);
+    if (start_idx == end_idx) {
+      spdlog::warn("Worker {} has no exams to process", i + 1);
+      continue;
+    }
+    exams_slices[i].assign(std::make_move_iterator(exams.begin() + start_idx),
+                           std::make_move_iterator(exams.begin() + end_idx));
+  }
+  return exams_slices;
+}
+
+void MPICoordinator::send_to_workers(const json& exams_to_review) {
+  std::vector<std::vector<MPIExam>> slices;
+  {
+    TraceScope span("slice");
+    slices = _slice_exams(exams_to_review);
+  }
+  _dispatch(slices, nullptr);
+}
+
 void MPICoordinator::send_to_workers(const json& exams_to_review,
-                                     i32 mpi_size) {
-  auto exams_slices = _slice_exams(exams_to_review, mpi_size);
+                                     const SinkTarget& target) {
+  std::vector<std::vector<MPIExam>> slices;
+  {
+    TraceScope span("slice");
+    slices = _slice_exams(exams_to_review);
+  }
+  _dispatch(slices, &target);
+}
+
+void MPICoordinator::send_to_workers(
+    std::vector<MPIExam>&& exams_to_review) {
+  std::vector<std::vector<MPIExam>> slices;
+  {
+    TraceScope span("slice");
+    slices = _slice_exams(std::move(exams_to_review));
+  }
+  _dispatch(slices, nullptr);
+}
+
+void MPICoordinator::_dispatch(
+    const std::vector<std::vector<MPIExam>>& exams_slices,
+    const SinkTarget* target) {
+  TraceScope span("send");
   auto active_workers = exams_slices.size();
 
   // Limpiar la lista de workers activos
@@ -309,15 +611,48 @@ void MPICoordinator::send_to_workers(const json& exams_to_review,
     return;
   }
 
-  spdlog::info("Sending work to {} active workers out of {} available",
-               active_workers, mpi_size - 1);
+  SH_LOG_EVERY_MS(spdlog::level::info, 1000,
+                  "Sending work to {} active workers out of {} available",
+                  active_workers, _workers.size());
+
+  // Kept exams must stay on the worker that got them, and spawned workers
+  // cannot reach the queue window, so neither is queued
+  auto resident = _resident && target == nullptr;
+  _queued_job = !resident && _spawned == 0 &&
+                RMAWorkQueue::instance().publish(exams_slices);
+  if (_queued_job) {
+    _dispatch_queue(exams_slices, target);
+    return;
+  }
+
+  // Answer keys of every stage in the request, shared by the local workers
+  auto& region = NodeSharedRegion::instance();
+  i32 shared_answers = -1;
+  std::string shared_keys;
+  if (region.enabled()) {
+    std::vector<i32> required_stages;
+    for (const auto& slice : exams_slices) {
+      for (const auto& exam : slice) {
+        required_stages.push_back(exam.stage);
+      }
+    }
+    std::ranges::sort(required_stages);
+    required_stages.erase(std::ranges::unique(required_stages).begin(),
+                          required_stages.end());
+    shared_keys = AnswersManager::instance().serialize_for_mpi(required_stages);
+    shared_answers = region.publish_answers(shared_keys);
+  }
 
-  for (size_t i = 0; i < active_workers; i++) {
-    auto exam_slice = exams_slices[i];
+  // Slice i goes to the i-th member
+  auto member = _workers.begin();
+  for (size_t i = 0; i < active_workers; i++, member++) {
+    const auto& exam_slice = exams_slices[i];
+    auto worker_rank = member->first;
 
     // Validar que el slice no esté vacío
     if (exam_slice.empty()) {
-      spdlog::warn("Worker {} received empty exam slice, skipping", i + 1);
+      spdlog::warn("Worker {} received empty exam slice, skipping",
+                   worker_rank);
       continue;
     }
 
@@ -325,89 +660,287 @@ void MPICoordinator::send_to_workers(const json& exams_to_review,
     std::transform(exam_slice.begin(), exam_slice.end(),
                    required_stages.begin(),
                    [](const MPIExam& exam) { return exam.stage; });
+    auto worker_answers =
+        region.slot(worker_rank).empty() ? -1 : shared_answers;
     auto answer_keys_serialized =
-        AnswersManager::instance().serialize_for_mpi(required_stages);
-    auto worker_rank = i + 1;  // 0 is master
+        worker_answers < 0
+            ? AnswersManager::instance().serialize_for_mpi(required_stages)
+            : shared_keys;
 
-    spdlog::info("Sending {} exams to worker {}", exam_slice.size(),
-                 worker_rank);
+    SH_LOG_EVERY_MS(spdlog::level::debug, 1000, "Sending {} exams to worker {}",
+                    exam_slice.size(), worker_rank);
 
     // Registrar este worker como activo
     _active_workers.push_back(worker_rank);
 
-    send_command(MPICommand::REVIEW, worker_rank, _config.mpi_tag_command);
-    send_answers(answer_keys_serialized, worker_rank, _config.mpi_tag_answers);
-    send_exam_batch(exam_slice, worker_rank, _config.mpi_tag_exams);
+    if (resident) {
+      _track_resident(exam_slice, worker_rank);
+      send_batch(MPICommand::REVIEW_RESIDENT, exam_slice,
+                 answer_keys_serialized, "", worker_rank, worker_answers);
+    } else if (target == nullptr) {
+      send_batch(MPICommand::REVIEW, exam_slice, answer_keys_serialized, "",
+                 worker_rank, worker_answers);
+    } else {
+      auto sink = target->directory + '\0' + target->job;
+      send_batch(MPICommand::REVIEW_SINK, exam_slice, answer_keys_serialized,
+                 sink, worker_rank, worker_answers);
+    }
   }
 }
 
-void MPICoordinator::send_shutdown_signal(i32 mpi_size) {
-  for (i32 i = 0; i < mpi_size - 1; i++) {
-    auto worker_rank = i + 1;  // 0 is master
-    send_command(MPICommand::SHUTDOWN, worker_rank, _config.mpi_tag_command);
+void MPICoordinator::_track_resident(const std::vector<MPIExam>& exams,
+                                     i32 worker_rank) {
+  auto& kept = _resident_kept[worker_rank];
+  auto& stale = _resident_stale[worker_rank];
+  for (const auto& exam : exams) {
+    auto key = static_cast<u64>(static_cast<u32>(exam.stage)) << 32 |
+               static_cast<u32>(exam.id_exam);
+    // A copy the worker still has is replaced, so it does not count twice
+    auto held = stale.erase(key) > 0;
+    auto owner = _resident_owners.find(key);
+    if (owner != _resident_owners.end()) {
+      if (owner->second == worker_rank) {
+        held = true;
+      } else {
+        // The previous worker drops its copy with the next RESCORE
+        _resident_stale[owner->second].insert(key);
+        _resident_owners.erase(owner);
+      }
+    }
+    if (!held && kept >= _resident_capacity) {
+      continue;  // the worker is full and does not keep it either
+    }
+    if (!held) {
+      kept++;
+    }
+    _resident_owners[key] = worker_rank;
   }
 }
 
-json MPICoordinator::receive_results_from_workers(i32 /* mpi_size */) {
+void MPICoordinator::_dispatch_queue(
+    const std::vector<std::vector<MPIExam>>& exams_slices,
+    const SinkTarget* target) {
+  i64 exams = 0;
+  std::vector<i32> required_stages;
+  for (const auto& slice : exams_slices) {
+    exams += slice.size();
+    for (const auto& exam : slice) {
+      required_stages.push_back(exam.stage);
+    }
+  }
+  std::ranges::sort(required_stages);
+  required_stages.erase(std::ranges::unique(required_stages).begin(),
+                        required_stages.end());
+  auto answer_keys_serialized =
+      AnswersManager::instance().serialize_for_mpi(required_stages);
+  std::string sink;
+  auto command = MPICommand::REVIEW;
+  if (target != nullptr) {
+    command = MPICommand::REVIEW_SINK;
+    sink = target->directory + '\0' + target->job;
+  }
+  // Every worker that can claim at least one chunk takes part
+  auto chunk = RMAWorkQueue::instance().chunk();
+  auto chunks = (exams + chunk - 1) / chunk;
+  auto workers = std::min<i64>(_comm_size - 1, chunks);
+  SH_LOG_EVERY_MS(spdlog::level::debug, 1000,
+                  "Queued {} exams in {} chunks for {} workers", exams, chunks,
+                  workers);
+  for (i32 worker_rank = 1; worker_rank <= workers; worker_rank++) {
+    _active_workers.push_back(worker_rank);
+    send_queue_job(command, static_cast<i32>(exams),
+                   RMAWorkQueue::instance().answer_words(),
+                   answer_keys_serialized, sink, worker_rank);
+  }
+}
+
+void MPICoordinator::send_rescore(const std::string& answer_keys) {
+  TraceScope span("send");
+  _active_workers.clear();
+  _queued_job = false;
+  for (const auto& [worker_rank, peer] : _workers) {
+    _active_workers.push_back(worker_rank);
+    auto& stale = _resident_stale[worker_rank];
+    std::vector<MPIExam> dropped;
+    dropped.reserve(stale.size());
+    for (auto key : stale) {
+      dropped.push_back({static_cast<i32>(key >> 32),
+                         static_cast<i32>(static_cast<u32>(key)), {}});
+    }
+    send_batch(MPICommand::RESCORE, dropped, answer_keys, "", worker_rank);
+    _resident_kept[worker_rank] -= stale.size();
+    stale.clear();
+  }
+}
+
+bool MPICoordinator::replies_ready() const {
+  for (auto worker_rank : _active_workers) {
+    auto [comm, rank] = _route(worker_rank);
+    i32 flag = 0;
+    if (MPI_Iprobe(rank, _config.mpi_tag_results, comm, &flag,
+                   MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+      return true;  // the receive reports the error
+    }
+    if (!flag) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void MPICoordinator::send_shutdown_signal() {
+  for (const auto& [worker_rank, peer] : _workers) {
+    send_batch(MPICommand::SHUTDOWN, {}, "", "", worker_rank);
+  }
+  for (auto it = _workers.begin(); it != _workers.end();) {
+    if (!it->second.spawned) {
+      ++it;
+      continue;
+    }
+    _release(it->second);
+    it = _workers.erase(it);
+  }
+  _spawned = 0;
+}
+
+std::vector<MPIResult> MPICoordinator::receive_results_from_workers() {
+  TraceScope span("gather");
   std::vector<MPIResult> results;
 
   if (_active_workers.empty()) {
     spdlog::warn("No active workers to receive results from");
-    return json(results);
+    return results;
   }
 
-  spdlog::info("Waiting for results from {} active workers",
-               _active_workers.size());
+  SH_LOG_EVERY_MS(spdlog::level::debug, 1000,
+                  "Waiting for results from {} active workers",
+                  _active_workers.size());
+
+  if (_queued_job) {
+    // The workers already wrote their results into the queue window
+    i64 rows = 0;
+    for (auto worker_rank : _active_workers) {
+      rows += receive_sink_summary(worker_rank, _config.mpi_tag_results).rows;
+    }
+    results = RMAWorkQueue::instance().results();
+    if (rows != static_cast<i64>(results.size())) {
+      throw std::runtime_error("Work queue results are incomplete");
+    }
+    return results;
+  }
 
   // Solo esperar resultados de workers activos
   for (auto worker_rank : _active_workers) {
-    spdlog::info("Receiving results from worker {}", worker_rank);
+    SH_LOG_EVERY_MS(spdlog::level::debug, 1000,
+                    "Receiving results from worker {}", worker_rank);
     auto worker_results = receive_results(worker_rank, _config.mpi_tag_results);
     results.insert(results.end(), worker_results.begin(), worker_results.end());
   }
 
-  spdlog::info("Received {} total results from all active workers",
-               results.size());
-  json results_json = results;
-  return results_json;
+  SH_LOG_EVERY_MS(spdlog::level::info, 1000,
+                  "Received {} total results from all active workers",
+                  results.size());
+  return results;
 }
 
-std::pair<std::vector<MPIExam>, MPICommand> MPICoordinator::receive_from_master(
-    i32 master_rank) {
-  auto command = receive_command(master_rank, _config.mpi_tag_command);
-  if (command == MPICommand::SHUTDOWN) {
-    return {std::vector<MPIExam>(), MPICommand::SHUTDOWN};
-  }
-  if (command != MPICommand::REVIEW) {
-    throw std::runtime_error("Invalid command received from master");
+std::vector<std::pair<i32, MPISinkSummary>>
+MPICoordinator::receive_sink_summaries() {
+  TraceScope span("gather");
+  std::vector<std::pair<i32, MPISinkSummary>> summaries;
+  for (auto worker_rank : _active_workers) {
+    summaries.emplace_back(
+        world_rank(worker_rank),
+        receive_sink_summary(worker_rank, _config.mpi_tag_results));
   }
-  auto answers = receive_answers(master_rank, _config.mpi_tag_answers);
-  AnswersManager::instance().load_from_json(json::parse(answers));
-  auto exams = receive_exam_batch(master_rank, _config.mpi_tag_exams);
-  return {exams, command};
+  return summaries;
 }
 
 void MPICoordinator::send_to_master(const std::vector<MPIResult>& results,
                                     i32 master_rank) {
-  spdlog::debug("Sending results to master: {}", results.size());
+  TraceScope span("worker_send");
+  SH_LOG_EVERY_MS(spdlog::level::debug, 1000,
+                  "Sending results to master: {}", results.size());
   send_results(results, master_rank, _config.mpi_tag_results);
 }
 
-void MPICoordinator::send_command(MPICommand command, i32 dest_rank, i32 tag) {
-  auto command_num = static_cast<u8>(command);
-  auto send_result = MPI_Send(&command_num, 1, MPI_UNSIGNED_CHAR, dest_rank,
-                              tag, MPI_COMM_WORLD);
+void MPICoordinator::send_to_master(const MPISinkSummary& summary,
+                                    i32 master_rank) {
+  TraceScope span("worker_send");
+  SH_LOG_EVERY_MS(spdlog::level::debug, 1000,
+                  "Sending sink summary to master: {} rows", summary.rows);
+  send_sink_summary(summary, master_rank, _config.mpi_tag_results);
+}
+
+void MPICoordinator::send_to_master(const std::vector<MPISimilarPair>& pairs,
+                                    i32 master_rank) {
+  TraceScope span("worker_send");
+  auto [comm, rank] = _route(master_rank);
+  i32 pairs_size = static_cast<i32>(pairs.size());
+  auto send_result = MPI_Send(&pairs_size, 1, MPI_INT, rank,
+                              _config.mpi_tag_results, comm);
+  if (send_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to send similar pairs size");
+  }
+  if (pairs_size == 0) {
+    return;
+  }
+  send_result = MPI_Send(pairs.data(), pairs_size, _mpi_similar_pair_type,
+                         rank, _config.mpi_tag_results, comm);
   if (send_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to send command");
+    throw std::runtime_error("Failed to send similar pairs");
   }
 }
 
-MPICommand MPICoordinator::receive_command(i32 source_rank, i32 tag) {
-  u8 command_num = 0;
-  auto recv_result = MPI_Recv(&command_num, 1, MPI_UNSIGNED_CHAR, source_rank,
-                              tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  if (recv_result != MPI_SUCCESS) {
-    throw std::runtime_error("Failed to receive command");
+void MPICoordinator::send_similarity(const std::vector<MPIExam>& exams,
+                                     i32 top_k) {
+  TraceScope span("send");
+  _active_workers.clear();
+  _queued_job = false;
+  std::vector<i32> required_stages;
+  for (const auto& exam : exams) {
+    required_stages.push_back(exam.stage);
   }
-  return static_cast<MPICommand>(command_num);
-}
\ No newline at end of file
+  std::ranges::sort(required_stages);
+  required_stages.erase(std::ranges::unique(required_stages).begin(),
+                        required_stages.end());
+  auto answer_keys_serialized =
+      AnswersManager::instance().serialize_for_mpi(required_stages);
+  // A worker without tile pairs would only receive the exams
+  auto parts = static_cast<i32>(
+      std::min(_workers.size(), SimilarityScan::tile_pairs(exams)));
+  SH_LOG_EVERY_MS(spdlog::level::info, 1000,
+                  "Comparing {} exams on {} workers", exams.size(), parts);
+  auto member = _workers.begin();
+  for (i32 part = 0; part < parts; part++, member++) {
+    _active_workers.push_back(member->first);
+    send_batch(MPICommand::SIMILARITY, exams, answer_keys_serialized, "",
+               member->first, -1, part, parts, top_k);
+  }
+}
+
+std::vector<MPISimilarPair> MPICoordinator::receive_similar_pairs() {
+  TraceScope span("gather");
+  std::vector<MPISimilarPair> pairs;
+  for (auto worker_rank : _active_workers) {
+    auto [comm, rank] = _route(worker_rank);
+    i32 pairs_size = 0;
+    auto recv_result = MPI_Recv(&pairs_size, 1, MPI_INT, rank,
+                                _config.mpi_tag_results, comm,
+                                MPI_STATUS_IGNORE);
+    if (recv_result != MPI_SUCCESS || pairs_size < 0) {
+      throw std::runtime_error("Failed to receive similar pairs size");
+    }
+    if (pairs_size == 0) {
+      continue;
+    }
+    auto first = pairs.size();
+    pairs.resize(first + pairs_size);
+    recv_result = MPI_Recv(pairs.data() + first, pairs_size,
+                           _mpi_similar_pair_type, rank,
+                           _config.mpi_tag_results, comm, MPI_STATUS_IGNORE);
+    if (recv_result != MPI_SUCCESS) {
+      throw std::runtime_error("Failed to receive similar pairs");
+    }
+  }
+  return pairs;
+}
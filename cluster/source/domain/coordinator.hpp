@@ -3,40 +3,120 @@
 #define COORDINATOR_HPP
 
 #include <mpi.h>
+#include <map>
 #include <memory>
 #include <nlohmann/json.hpp>
+#include <span>
+#include <string>
 #include <system/aliases.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 using json = nlohmann::json;
 
 struct CoordinatorConfig {
-  i32 mpi_tag_answers = 100;
   i32 mpi_tag_exams = 101;
   i32 mpi_tag_results = 102;
   i32 mpi_tag_command = 103;
 };
 
-struct MPIQuestion {
-  i32 qst_idx;
-  i32 ans_idx;
-};
+static constexpr i32 MAX_QUESTIONS = 4096; /** Questions of an exam */
+static constexpr i32 MAX_STAGE =
+    (1 << 24) - 1; /** Numeric stages, the next ones are named stages */
 
+/**
+ * @brief Exam in its dense form
+ * @details `answers[q - 1]` is the choice (1..255) of question q and 0 marks
+ *          a blank question, so the position is the question index and an
+ *          answer takes one byte.
+ */
 struct MPIExam {
   i32 stage;
   i32 id_exam;
-  std::vector<MPIQuestion> answers;
+  std::vector<u8> answers;
+
+  /**
+   * @brief Record the choice of a question
+   * @return false if the question or the choice is out of range
+   */
+  bool answer(i32 qst_idx, i32 ans_idx) {
+    if (qst_idx < 1 || qst_idx > MAX_QUESTIONS || ans_idx < 0 ||
+        ans_idx > 255) {
+      return false;
+    }
+    if (answers.size() < static_cast<size_t>(qst_idx)) {
+      answers.resize(qst_idx, 0);
+    }
+    answers[qst_idx - 1] = static_cast<u8>(ans_idx);
+    return true;
+  }
 };
 
 struct MPIExamHeader {
   i32 stage;
   i32 id_exam;
-  i32 answers_size;
+  i32 answers_size; /** Questions of the exam */
+  i32 answer_bits;  /** Bits per packed answer, see AnswerPacking */
 };
 
+/**
+ * @brief Exams of a batch in their packed layout, read in place
+ */
+struct MPIPackedExams {
+  std::span<const MPIExamHeader> headers;
+  std::span<const u64> answers; /** Packed answers of every exam in order */
+  size_t size() const { return headers.size(); }
+};
+
+/**
+ * @brief Header of a batch sent from the master to a worker
+ * @details Sent on the command tag, followed (on the exams tag) by a single
+ *          payload message holding `exams` MPIExamHeader, `answer_words`
+ *          words of packed answers, `answers_bytes` of answer keys (JSON)
+ *          and `sink_bytes` of sink target ("<directory>\0<job>"), in that
+ *          order.
+ *          A SHUTDOWN header has no payload.
+ *          When `shared_payload` is not -1 the payload is not sent: it is at
+ *          that offset of the NodeSharedRegion. When `shared_answers` is not
+ *          -1 the answer keys are left out of the payload and read from that
+ *          offset of the region.
+ *          When `queue_chunk` is not 0 the exams stay in the RMAWorkQueue
+ *          window and are claimed `queue_chunk` at a time; `exams` and
+ *          `answer_words` describe the whole queued batch and the payload
+ *          only holds the answer keys and the sink target.
+ *          `trace` is the id of the request the batch belongs to, so the
+ *          spans of the worker join those of the ingress rank.
+ *          A SIMILARITY batch carries every exam to every worker, which
+ *          compares the tile pairs `part`, `part + parts`, ... and keeps the
+ *          `top_k` most similar pairs.
+ */
+struct MPIBatchHeader {
+  i32 command;
+  i32 exams;
+  i32 answer_words;
+  i32 answers_bytes;
+  i32 sink_bytes;
+  i32 shared_payload;
+  i32 shared_answers;
+  i32 queue_chunk;
+  i32 trace;
+  i32 part;
+  i32 parts;
+  i32 top_k;
+};
+
+static constexpr i32 MPI_BATCH_HEADER_INTS =
+    sizeof(MPIBatchHeader) / sizeof(i32);
+
 enum class MPICommand : u8 {
   SHUTDOWN = 0,
   REVIEW = 1,
+  REVIEW_SINK = 2,
+  REVIEW_RESIDENT = 3, /** REVIEW, and the worker keeps the exams */
+  RESCORE = 4, /** Drop the sent exams, re-score the kept ones with the keys */
+  SIMILARITY = 5, /** Compare the exams pairwise, see SimilarityScan */
 };
 
 struct MPIResult {
@@ -50,42 +130,206 @@ struct MPIResult {
                                  wrong_answers, unscored_answers, score)
 };
 
+/**
+ * @brief Two exams of a stage and the answers they share
+ */
+struct MPISimilarPair {
+  i32 stage;
+  i32 id_exam_a;
+  i32 id_exam_b;
+  i32 matching_wrong;   /** Questions with the same wrong choice in both */
+  i32 matching_answers; /** Questions with the same choice in both */
+};
+
+struct MPISinkSummary {
+  i64 rows;
+  i64 bytes;
+  i64 correct_answers;
+  i64 wrong_answers;
+  i64 unscored_answers;
+  double score_sum;
+};
+
+struct SinkTarget;
+
+/**
+ * @brief Worker known to the master
+ * @details The workers started by mpirun share the communicator of the
+ *          master; a spawned worker shares with it the intracommunicator
+ *          merged from the intercommunicator of its spawn.
+ */
+struct WorkerPeer {
+  MPI_Comm comm;      /** Communicator of the master and the worker */
+  MPI_Comm intercomm; /** Intercommunicator of its spawn, if spawned */
+  i32 rank;           /** Rank of the worker in comm */
+  i32 world_rank; /** Rank of the worker in logs and sink files */
+  bool spawned;   /** Started by spawn_worker */
+};
+
+struct MPIWork {
+  MPICommand command;
+  MPIPackedExams exams; /** Valid until the next batch is received */
+  std::string sink_directory;
+  std::string sink_job;
+  i32 queue_chunk = 0;     /** Exams to claim at once from the work queue */
+  i32 queue_exams = 0;     /** Exams of the queued batch */
+  i32 queue_words = 0;     /** Answer words of the queued batch */
+  i32 part = 0;            /** SIMILARITY: tile pairs of this worker */
+  i32 parts = 0;
+  i32 top_k = 0;           /** SIMILARITY: pairs to answer */
+};
+
 class MPICoordinator {
  public:
   static MPICoordinator& instance();
   void set_config(const CoordinatorConfig& config);
+  /**
+   * @brief Communicator of the master (rank 0) and its workers
+   */
+  void set_communicator(MPI_Comm comm);
+  MPI_Comm communicator() const { return _comm; }
+  /**
+   * @brief Rank in MPI_COMM_WORLD of a worker, as its files are named
+   */
+  i32 world_rank(i32 worker) const;
+  /**
+   * @brief Workers by id. The workers started by mpirun keep their rank in
+   *        the communicator as id; spawned workers get the following ids.
+   */
+  const std::map<i32, WorkerPeer>& workers() const { return _workers; }
+  size_t spawned_workers() const { return _spawned; }
+  /**
+   * @brief Let spawn_worker start `command` (master)
+   * @details Spawned workers are named first_rank, first_rank + stride, ...
+   *          in logs and sink files, after every rank of MPI_COMM_WORLD.
+   */
+  void set_spawn_command(const std::string& command, i32 first_rank,
+                         i32 stride);
+  /**
+   * @brief Start one more worker with MPI_Comm_spawn (master)
+   * @details Blocks until the worker has started and joined the master.
+   * @return Id of the new worker
+   * @throw std::runtime_error If it could not be started
+   */
+  i32 spawn_worker();
+  /**
+   * @brief Shut down the newest spawned worker (master)
+   * @return false if there is none, or it keeps resident exams
+   */
+  bool retire_worker();
   ~MPICoordinator();
   void create_types();
   void free_types();
-  void send_exam_batch(const std::vector<MPIExam>& exams, int dest_rank,
-                       int tag);
-  std::vector<MPIExam> receive_exam_batch(int source_rank, int tag);
-  void send_answers(const std::string& answers, int dest_rank, int tag);
-  std::string receive_answers(int source_rank, int tag);
+  void send_batch(MPICommand command, const std::vector<MPIExam>& exams,
+                  const std::string& answers, const std::string& sink,
+                  int dest_rank, i32 shared_answers = -1, i32 part = 0,
+                  i32 parts = 0, i32 top_k = 0);
+  void send_queue_job(MPICommand command, i32 exams, i32 answer_words,
+                      const std::string& answers, const std::string& sink,
+                      int dest_rank);
+  static size_t batch_payload_size(const MPIBatchHeader& header);
+  void unpack_batch(const MPIBatchHeader& header, std::span<const char> payload,
+                    MPIWork& work);
   void send_results(const std::vector<MPIResult>& results, int dest_rank,
                     int tag);
   std::vector<MPIResult> receive_results(int source_rank, int tag);
-  void send_to_workers(const json& exams_to_review, i32 mpi_size);
-  json receive_results_from_workers(i32 mpi_size);
-  std::pair<std::vector<MPIExam>, MPICommand> receive_from_master(
-      i32 master_rank);
+  void send_sink_summary(const MPISinkSummary& summary, int dest_rank,
+                         int tag);
+  MPISinkSummary receive_sink_summary(int source_rank, int tag);
+  void send_to_workers(const json& exams_to_review);
+  void send_to_workers(const json& exams_to_review, const SinkTarget& target);
+  void send_to_workers(std::vector<MPIExam>&& exams_to_review);
+  std::vector<MPIResult> receive_results_from_workers();
+  /**
+   * @brief Send every exam to the workers to compare them pairwise
+   * @details Each worker takes its share of the tile pairs and answers its
+   *          `top_k` most similar pairs, see receive_similar_pairs.
+   */
+  void send_similarity(const std::vector<MPIExam>& exams, i32 top_k);
+  /**
+   * @brief Pairs answered by the workers of the last send_similarity, not
+   *        merged
+   */
+  std::vector<MPISimilarPair> receive_similar_pairs();
+  // Pares (rango en MPI_COMM_WORLD, resumen) de cada worker activo
+  std::vector<std::pair<i32, MPISinkSummary>> receive_sink_summaries();
   void send_to_master(const std::vector<MPIResult>& results, i32 master_rank);
-  void send_command(MPICommand command, i32 dest_rank, i32 tag);
-  MPICommand receive_command(int source_rank, int tag);
-  void send_shutdown_signal(i32 mpi_size);
+  void send_to_master(const MPISinkSummary& summary, i32 master_rank);
+  void send_to_master(const std::vector<MPISimilarPair>& pairs,
+                      i32 master_rank);
+  const CoordinatorConfig& config() const { return _config; }
+  void send_shutdown_signal();
+  /**
+   * @brief Whether the workers keep the reviewed exams for rescore_workers
+   * @details Set from SH_RESIDENT (default off) and the resident_exams
+   *          setting. These reviews bypass the RMA queue, so every exam is
+   *          kept by the worker it was sent to. With several ingress ranks
+   *          each one re-scores the exams kept by its own workers.
+   *          The master tracks the owner of every kept exam, and counts the
+   *          exams of each worker against SH_RESIDENT_MAX_EXAMS as the
+   *          worker does, so the exams a full worker refuses are not
+   *          tracked and the tracking is bounded by the kept exams.
+   * @see ResidentExams
+   */
+  bool resident() const { return _resident; }
+  void set_resident(bool resident) { _resident = resident; }
+  /**
+   * @brief Send updated answer keys to every worker, which answer the
+   *        results of the kept exams that changed
+   * @see receive_results_from_workers
+   */
+  void send_rescore(const std::string& answer_keys);
+  /**
+   * @brief Whether every worker of the last batch has started answering,
+   *        so gathering its replies will not wait for their work
+   * @details Probes the replies without receiving them, for an event loop
+   *          that keeps serving while the workers compute.
+   */
+  bool replies_ready() const;
 
  private:
   MPICoordinator();
   static std::unique_ptr<MPICoordinator> _instance;
-  MPI_Datatype _mpi_question_type = MPI_DATATYPE_NULL;
   MPI_Datatype _mpi_result_type = MPI_DATATYPE_NULL;
   MPI_Datatype _mpi_exam_header_type = MPI_DATATYPE_NULL;
+  MPI_Datatype _mpi_sink_summary_type = MPI_DATATYPE_NULL;
+  MPI_Datatype _mpi_similar_pair_type = MPI_DATATYPE_NULL;
   CoordinatorConfig _config;
+  MPI_Comm _comm = MPI_COMM_WORLD;
+  i32 _comm_size = 1;                 // Master y workers de mpirun
+  std::map<i32, WorkerPeer> _workers;  // Miembros actuales por id
+  size_t _spawned = 0;                 // Workers lanzados vivos
+  i32 _spawn_count = 0;                // Workers lanzados en total
+  std::string _spawn_command;
+  i32 _spawn_first_rank = 0;
+  i32 _spawn_stride = 1;
   bool _types_created = false;
   std::vector<i32> _active_workers;  // Rastrea qué workers recibieron trabajo
+  std::vector<char> _send_buffer;    // Payload de los lotes enviados
+  std::vector<i32> _answer_bits;     // Ancho empaquetado de cada examen
+  bool _queued_job = false;          // El lote actual está en la cola RMA
+  bool _resident = false;            // Los workers guardan los exámenes
+  std::unordered_map<u64, i32> _resident_owners;  // Worker de cada examen
+  // Copias que cada worker suelta con el próximo RESCORE
+  std::unordered_map<i32, std::unordered_set<u64>> _resident_stale;
+  std::unordered_map<i32, size_t> _resident_kept;  // Guardados por worker
+  size_t _resident_capacity;                       // SH_RESIDENT_MAX_EXAMS
 
-  std::vector<std::vector<MPIExam>> _slice_exams(const json& exams,
-                                                 i32 mpi_size);
+  void _pack_batch(const MPIBatchHeader& header,
+                   const std::vector<MPIExam>& exams,
+                   const std::string& answers, const std::string& sink,
+                   char* output) const;
+  /** Communicator and rank of a worker, or of the master on a worker */
+  std::pair<MPI_Comm, i32> _route(i32 id) const;
+  /** Free the communicators of a spawned worker */
+  void _release(WorkerPeer& peer);
+  std::vector<std::vector<MPIExam>> _slice_exams(const json& exams);
+  std::vector<std::vector<MPIExam>> _slice_exams(std::vector<MPIExam>&& exams);
+  void _dispatch(const std::vector<std::vector<MPIExam>>& exams_slices,
+                 const SinkTarget* target);
+  void _dispatch_queue(const std::vector<std::vector<MPIExam>>& exams_slices,
+                       const SinkTarget* target);
+  void _track_resident(const std::vector<MPIExam>& exams, i32 worker_rank);
 };
 
 #endif  // COORDINATOR_HPP
\ No newline at end of file
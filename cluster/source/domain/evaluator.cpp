@@ -1,6 +1,7 @@
 #include "evaluator.hpp"
 
 #include <domain/answers.hpp>
+#include <domain/packing.hpp>
 
 std::unique_ptr<Evaluator> Evaluator::_instance = nullptr;
 
@@ -16,45 +17,46 @@ Evaluator::Evaluator() {
 }
 
 std::vector<MPIResult> Evaluator::evaluate_exam_batch(
-    const std::vector<MPIExam>& exams) {
+    const MPIPackedExams& exams) {
   std::vector<MPIResult> results;
   results.resize(exams.size());
+  // The whole batch is scored against one version of the keys
+  auto answers = AnswersManager::instance().snapshot();
+  size_t word = 0;
   for (size_t i = 0; i < exams.size(); i++) {
-    results[i] = _evaluate_exam(exams[i]);
+    const auto& exam = exams.headers[i];
+    auto words = AnswerPacking::words(exam.answers_size, exam.answer_bits);
+    results[i] = _evaluate_exam(exam, exams.answers.subspan(word, words),
+                                answers->key(exam.stage));
+    word += words;
   }
   return results;
 }
 
-MPIResult Evaluator::_evaluate_exam(const MPIExam& exam) {
-  auto student_answers = exam.answers;
-  auto correct_answers = AnswersManager::instance().get_answers(exam.stage);
-  if (correct_answers.empty()) {
-    return MPIResult{exam.stage,
-                     exam.id_exam,
-                     0,
-                     0,
-                     static_cast<i32>(student_answers.size()),
-                     0.0};
+MPIResult Evaluator::_evaluate_exam(const MPIExamHeader& exam,
+                                    std::span<const u64> student_answers,
+                                    const PackedKey& key) {
+  AnswerCounts counts;
+  if (exam.answer_bits == AnswerPacking::WIDE_BITS) {
+    counts = AnswerPacking::score(student_answers, key.wide,
+                                  AnswerPacking::WIDE_BITS);
+  } else if (key.fits_narrow) {
+    counts = AnswerPacking::score(student_answers, key.narrow,
+                                  AnswerPacking::NARROW_BITS);
+  } else {
+    // The key has choices the narrow lanes cannot hold
+    AnswerPacking::widen(student_answers, exam.answers_size, _widened);
+    counts = AnswerPacking::score(_widened, key.wide,
+                                  AnswerPacking::WIDE_BITS);
   }
-  i32 correct_answers_count = 0;
-  i32 wrong_answers_count = 0;
-  i32 unscored_answers_count = 0;
-  for (auto& answer : student_answers) {
-    auto correct_answer_it = correct_answers.find(answer.qst_idx);
-    if (correct_answer_it == correct_answers.end()) {
-      unscored_answers_count++;
-      continue;
-    }
-    if (correct_answer_it->second == answer.ans_idx) {
-      correct_answers_count++;
-    } else {
-      wrong_answers_count++;
-    }
-  }
-  double score = correct_answers_count * _scores.correct_answer +
-                 wrong_answers_count * _scores.wrong_answer +
-                 unscored_answers_count * _scores.unscored_answer;
-  return MPIResult{
-      exam.stage,          exam.id_exam,           correct_answers_count,
-      wrong_answers_count, unscored_answers_count, score};
-}
\ No newline at end of file
+  return result(exam.stage, exam.id_exam, counts);
+}
+
+MPIResult Evaluator::result(i32 stage, i32 id_exam,
+                            const AnswerCounts& counts) const {
+  double score = counts.correct * _scores.correct_answer +
+                 counts.wrong * _scores.wrong_answer +
+                 counts.unscored * _scores.unscored_answer;
+  return MPIResult{stage,        id_exam,         counts.correct,
+                   counts.wrong, counts.unscored, score};
+}
@@ -2,9 +2,12 @@
 #ifndef EVALUATOR_HPP
 #define EVALUATOR_HPP
 
+#include <domain/answers.hpp>
 #include <domain/coordinator.hpp>
+#include <domain/packing.hpp>
 #include <map>
 #include <nlohmann/json.hpp>
+#include <span>
 #include <string>
 #include <system/aliases.hpp>
 
@@ -14,18 +17,35 @@ struct AnswersScores {
   double unscored_answer = 0.0;
 };
 
+/**
+ * @brief Scores the exams of a batch against the keys of their stages
+ * @details Answers and keys are packed one lane per question (see
+ *          AnswerPacking), where lane value 0 means "no choice":
+ *          - An ans_idx of 0 is a blank: neither correct, wrong nor unscored.
+ *          - A repeated qst_idx keeps its last answer and counts once.
+ *          - A key rans_idx of 0 leaves the question without key.
+ *          Any other answer is correct if it matches the key, wrong if it
+ *          does not, and unscored if its question has no key.
+ */
 class Evaluator {
  public:
   static Evaluator& instance();
   ~Evaluator() = default;
-  std::vector<MPIResult> evaluate_exam_batch(const std::vector<MPIExam>& exams);
+  std::vector<MPIResult> evaluate_exam_batch(const MPIPackedExams& exams);
+  /**
+   * @brief Result of an exam with the given counts
+   */
+  MPIResult result(i32 stage, i32 id_exam, const AnswerCounts& counts) const;
 
  private:
   Evaluator();
   static std::unique_ptr<Evaluator> _instance;
   AnswersScores _scores;
+  std::vector<u64> _widened;  // Examen angosto reempaquetado a lanes anchos
 
-  MPIResult _evaluate_exam(const MPIExam& exam);
+  MPIResult _evaluate_exam(const MPIExamHeader& exam,
+                           std::span<const u64> student_answers,
+                           const PackedKey& key);
 };
 
 #endif  // EVALUATOR_HPP
\ No newline at end of file
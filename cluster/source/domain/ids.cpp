@@ -0,0 +1,26 @@
+#include "ids.hpp"
+#include <limits>
+#include <stdexcept>
+
+i32 IdTable::intern(std::string_view name) {
+  auto it = _ids.find(name);
+  if (it != _ids.end()) {
+    return it->second;
+  }
+  if (_names.size() >=
+      static_cast<size_t>(std::numeric_limits<i32>::max() - FIRST_ID)) {
+    throw std::runtime_error("Id table is full");
+  }
+  auto id = static_cast<i32>(FIRST_ID + _names.size());
+  _names.emplace_back(name);
+  _ids.emplace(_names.back(), id);
+  return id;
+}
+
+std::optional<i32> IdTable::find(std::string_view name) const {
+  auto it = _ids.find(name);
+  if (it == _ids.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef IDS_HPP
+#define IDS_HPP
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Interned table of string ids
+ * @details Gives every distinct name a dense i32 id, in order of first
+ *          appearance, so exams travel and are scored with numeric ids and
+ *          the names are only looked up again to answer. Ids start at
+ *          FIRST_ID so they do not collide with the numeric ids clients
+ *          send.
+ */
+class IdTable {
+ public:
+  static constexpr i32 FIRST_ID = 1 << 24;
+
+  /**
+   * @brief Id of a name, added to the table if it is new
+   */
+  i32 intern(std::string_view name);
+
+  /**
+   * @brief Id of a name already in the table
+   */
+  std::optional<i32> find(std::string_view name) const;
+
+  /**
+   * @brief Name of an id given by this table
+   */
+  const std::string& name(i32 id) const { return _names.at(id - FIRST_ID); }
+
+  size_t size() const { return _names.size(); }
+
+ private:
+  struct Hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view name) const {
+      return std::hash<std::string_view>{}(name);
+    }
+  };
+
+  std::unordered_map<std::string, i32, Hash, std::equal_to<>> _ids;
+  std::vector<std::string> _names;
+};
+
+#endif  // IDS_HPP
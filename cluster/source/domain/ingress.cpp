@@ -0,0 +1,220 @@
+#include "ingress.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <domain/answers.hpp>
+#include <mutex>
+#include <stdexcept>
+#include <system/environment.hpp>
+
+std::unique_ptr<IngressGroup> IngressGroup::_instance = nullptr;
+
+IngressGroup& IngressGroup::instance() {
+  static std::once_flag flag;
+  std::call_once(flag, []() { _instance.reset(new IngressGroup()); });
+  return *_instance;
+}
+
+void IngressGroup::init() {
+  i32 rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  if (rank == 0) {
+    auto ingress = Environment::get("SH_INGRESS");
+    if (ingress) {
+      _count = std::stoi(*ingress);
+    }
+    // Every ingress rank needs at least one worker
+    _count = std::clamp(_count, 1, std::max(1, size / 2));
+  }
+  MPI_Bcast(&_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  // Every ingress rank publishes the same versions, in the epoch of rank 0
+  auto epoch = AnswersManager::instance().epoch();
+  MPI_Bcast(&epoch, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+  AnswersManager::instance().set_epoch(epoch);
+  bool ingress = rank < _count;
+  _index = ingress ? rank : (rank - _count) % _count;
+  // The ingress rank is rank 0 of its group
+  MPI_Comm_split(MPI_COMM_WORLD, _index, ingress ? 0 : rank, &_group_comm);
+  MPI_Comm_split(MPI_COMM_WORLD, ingress ? 0 : MPI_UNDEFINED, rank,
+                 &_ingress_comm);
+  if (rank == 0 && _count > 1) {
+    spdlog::info("Running {} ingress ranks", _count);
+  }
+}
+
+void IngressGroup::free() {
+  if (is_ingress() && _count > 1) {
+    // Keep receiving until every ingress rank has completed its sends
+    MPI_Request barrier = MPI_REQUEST_NULL;
+    while (true) {
+      i32 pending = 0;
+      MPI_Status status;
+      MPI_Iprobe(MPI_ANY_SOURCE, _tag, _ingress_comm, &pending, &status);
+      if (pending) {
+        _receive(status);  // the server is gone, drop it
+        continue;
+      }
+      _reap();
+      if (barrier == MPI_REQUEST_NULL && _outgoing.empty()) {
+        MPI_Ibarrier(_ingress_comm, &barrier);
+      }
+      if (barrier != MPI_REQUEST_NULL) {
+        i32 done = 0;
+        MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+        if (done) {
+          break;
+        }
+      }
+    }
+  }
+  if (_ingress_comm != MPI_COMM_NULL) {
+    MPI_Comm_free(&_ingress_comm);
+  }
+  if (_group_comm != MPI_COMM_NULL) {
+    MPI_Comm_free(&_group_comm);
+  }
+}
+
+void IngressGroup::replicate_answers(const std::string& answers,
+                                     IngressMessage kind) {
+  if (_count == 1 || _index == 0) {
+    _incoming.assign(2 * sizeof(i32), '\0');
+    _incoming.insert(_incoming.end(), answers.begin(), answers.end());
+    _load(kind);
+    if (_count > 1) {
+      _forward(kind, 0, true);
+    }
+    return;
+  }
+  _send(kind, _index, answers.data(), answers.size(), 0);
+  // Apply the updates ordered before ours, then ours
+  while (true) {
+    MPI_Status status;
+    MPI_Probe(0, _tag, _ingress_comm, &status);
+    auto [kind, origin] = _receive(status);
+    _apply(kind);
+    if (kind == IngressMessage::SHUTDOWN) {
+      throw std::runtime_error("Cluster is shutting down");
+    }
+    if (origin == _index) {
+      break;
+    }
+  }
+  _reap();
+}
+
+void IngressGroup::replicate_shutdown() {
+  if (_count == 1 || _shutdown) {
+    return;
+  }
+  _shutdown = true;
+  if (_index == 0) {
+    _incoming.assign(2 * sizeof(i32), '\0');
+    _forward(IngressMessage::SHUTDOWN, 0, false);
+  } else {
+    _send(IngressMessage::SHUTDOWN, _index, nullptr, 0, 0);
+  }
+}
+
+bool IngressGroup::poll() {
+  if (_count == 1) {
+    return false;
+  }
+  _reap();
+  while (true) {
+    i32 pending = 0;
+    MPI_Status status;
+    MPI_Iprobe(MPI_ANY_SOURCE, _tag, _ingress_comm, &pending, &status);
+    if (!pending) {
+      break;
+    }
+    auto [kind, origin] = _receive(status);
+    if (kind == IngressMessage::SHUTDOWN && _shutdown) {
+      continue;  // already shutting down
+    }
+    _apply(kind);
+    if (_index == 0 && status.MPI_SOURCE != 0) {
+      // The origin waits for its own update, not for its own shutdown
+      _forward(kind, origin, kind != IngressMessage::SHUTDOWN);
+    }
+  }
+  return _shutdown;
+}
+
+void IngressGroup::_send(IngressMessage kind, i32 origin, const char* data,
+                         size_t size, i32 dest) {
+  auto& outgoing = _outgoing.emplace_back();
+  outgoing.buffer.resize(2 * sizeof(i32) + size);
+  auto kind_value = static_cast<i32>(kind);
+  std::memcpy(outgoing.buffer.data(), &kind_value, sizeof(i32));
+  std::memcpy(outgoing.buffer.data() + sizeof(i32), &origin, sizeof(i32));
+  if (size > 0) {
+    std::memcpy(outgoing.buffer.data() + 2 * sizeof(i32), data, size);
+  }
+  // Non-blocking, a busy ingress rank must not stall the sender
+  auto send_result =
+      MPI_Isend(outgoing.buffer.data(), static_cast<i32>(outgoing.buffer.size()),
+                MPI_BYTE, dest, _tag, _ingress_comm, &outgoing.request);
+  if (send_result != MPI_SUCCESS) {
+    _outgoing.pop_back();
+    throw std::runtime_error("Failed to send ingress message");
+  }
+}
+
+std::pair<IngressMessage, i32> IngressGroup::_receive(
+    const MPI_Status& status) {
+  i32 size = 0;
+  MPI_Get_count(&status, MPI_BYTE, &size);
+  _incoming.resize(size);
+  MPI_Recv(_incoming.data(), size, MPI_BYTE, status.MPI_SOURCE, _tag,
+           _ingress_comm, MPI_STATUS_IGNORE);
+  if (size < static_cast<i32>(2 * sizeof(i32))) {
+    throw std::runtime_error("Invalid ingress message");
+  }
+  i32 kind, origin;
+  std::memcpy(&kind, _incoming.data(), sizeof(i32));
+  std::memcpy(&origin, _incoming.data() + sizeof(i32), sizeof(i32));
+  return {static_cast<IngressMessage>(kind), origin};
+}
+
+void IngressGroup::_apply(IngressMessage kind) {
+  if (kind == IngressMessage::SHUTDOWN) {
+    _shutdown = true;
+    return;
+  }
+  try {
+    _load(kind);
+  } catch (const std::exception& e) {
+    spdlog::error("Failed to apply replicated answers: {}", e.what());
+  }
+}
+
+void IngressGroup::_load(IngressMessage kind) {
+  const char* begin = _incoming.data() + 2 * sizeof(i32);
+  const char* end = _incoming.data() + _incoming.size();
+  std::string_view answers(begin, end - begin);
+  if (kind == IngressMessage::PATCH_ANSWERS) {
+    AnswersManager::instance().patch_from_json(json::parse(answers));
+  } else {
+    AnswersManager::instance().load_from_string(answers);
+  }
+}
+
+void IngressGroup::_forward(IngressMessage kind, i32 origin, bool to_origin) {
+  const auto* data = _incoming.data() + 2 * sizeof(i32);
+  auto size = _incoming.size() - 2 * sizeof(i32);
+  for (i32 dest = 1; dest < _count; dest++) {
+    if (dest != origin || to_origin) {
+      _send(kind, origin, data, size, dest);
+    }
+  }
+}
+
+void IngressGroup::_reap() {
+  std::erase_if(_outgoing, [](Outgoing& outgoing) {
+    i32 done = 0;
+    MPI_Test(&outgoing.request, &done, MPI_STATUS_IGNORE);
+    return done != 0;
+  });
+}
@@ -0,0 +1,107 @@
+#pragma once
+#ifndef INGRESS_HPP
+#define INGRESS_HPP
+
+#include <mpi.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <system/aliases.hpp>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Message kinds exchanged between ingress ranks
+ */
+enum class IngressMessage : i32 {
+  SET_ANSWERS = 0,   /** Answer keys update (JSON) */
+  SHUTDOWN = 1,      /** Cluster shutdown */
+  PATCH_ANSWERS = 2, /** Answer keys patch (JSON) */
+};
+
+/**
+ * @brief Layout of the ingress (front end) ranks
+ * @details Ranks 0 .. count - 1 run a Server; every other rank is a worker
+ *          of ingress `(rank - count) % count`. Each ingress rank and its
+ *          workers get their own communicator, where the ingress is rank 0,
+ *          so they are driven exactly like a single front end.
+ *          Answer key updates and shutdowns are replicated to every ingress
+ *          rank. Ingress 0 orders them: the other ingress ranks forward
+ *          their updates to it and apply them only when ingress 0 sends them
+ *          back, so every ingress applies the same updates in the same order.
+ *          Environment (read on rank 0):
+ *          - SH_INGRESS: number of ingress ranks (default 1).
+ */
+class IngressGroup {
+ public:
+  static IngressGroup& instance();
+  ~IngressGroup() = default;
+
+  /**
+   * @brief Split the ranks. Collective over MPI_COMM_WORLD.
+   */
+  void init();
+
+  /**
+   * @brief Deliver the pending messages and free the communicators.
+   *        Collective, must be called before MPI_Finalize.
+   */
+  void free();
+
+  MPI_Comm comm() const { return _group_comm; }
+  bool is_ingress() const { return _ingress_comm != MPI_COMM_NULL; }
+  i32 index() const { return _index; }
+  i32 count() const { return _count; }
+
+  /**
+   * @brief Apply an answer keys update (SET_ANSWERS or PATCH_ANSWERS) on
+   *        every ingress rank
+   * @details Returns once the update has been applied locally, in the order
+   *          decided by ingress 0.
+   * @throw std::runtime_error If the cluster shuts down meanwhile
+   */
+  void replicate_answers(
+      const std::string& answers,
+      IngressMessage kind = IngressMessage::SET_ANSWERS);
+
+  /**
+   * @brief Ask every other ingress rank to shut down
+   */
+  void replicate_shutdown();
+
+  /**
+   * @brief Apply the updates received from the other ingress ranks
+   * @return true if a shutdown was received
+   */
+  bool poll();
+
+ private:
+  IngressGroup() = default;
+  static std::unique_ptr<IngressGroup> _instance;
+  static constexpr i32 _tag = 100;
+
+  struct Outgoing {
+    std::vector<char> buffer;
+    MPI_Request request = MPI_REQUEST_NULL;
+  };
+
+  MPI_Comm _group_comm = MPI_COMM_NULL;
+  MPI_Comm _ingress_comm = MPI_COMM_NULL;
+  i32 _index = 0;
+  i32 _count = 1;
+  bool _shutdown = false;
+  std::list<Outgoing> _outgoing; /** Sends not completed yet */
+  std::vector<char> _incoming;
+
+  void _send(IngressMessage kind, i32 origin, const char* data, size_t size,
+             i32 dest);
+  /** Receive a message, returning its kind and origin */
+  std::pair<IngressMessage, i32> _receive(const MPI_Status& status);
+  void _apply(IngressMessage kind);
+  /** Load the answer keys of the message in _incoming */
+  void _load(IngressMessage kind);
+  void _forward(IngressMessage kind, i32 origin, bool to_origin);
+  void _reap();
+};
+
+#endif  // INGRESS_HPP
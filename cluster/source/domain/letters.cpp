@@ -0,0 +1,91 @@
+#include "letters.hpp"
+#include <domain/coordinator.hpp>
+#include <stdexcept>
+
+namespace {
+
+std::string read_name(const json& sheet, const char* field, size_t index) {
+  if (!sheet.contains(field)) {
+    throw std::runtime_error("Sheet " + std::to_string(index) + " has no " +
+                             field);
+  }
+  const auto& name = sheet[field];
+  if (name.is_string()) {
+    return name.get<std::string>();
+  }
+  if (name.is_number_integer()) {
+    return name.dump();
+  }
+  throw std::runtime_error(std::string(field) + " of sheet " +
+                           std::to_string(index) + " must be a string");
+}
+
+std::vector<u8> read_letters(const json& letters, const std::string& where) {
+  if (!letters.is_array()) {
+    throw std::runtime_error("Answers of " + where + " must be an array");
+  }
+  if (letters.size() > static_cast<size_t>(MAX_QUESTIONS)) {
+    throw std::runtime_error(where + " has more than " +
+                             std::to_string(MAX_QUESTIONS) + " questions");
+  }
+  std::vector<u8> answers(letters.size(), 0);
+  for (size_t i = 0; i < letters.size(); i++) {
+    const auto& letter = letters[i];
+    if (letter.is_null()) {
+      continue;
+    }
+    auto choice =
+        letter.is_string() ? LetterFormat::choice(letter.get<std::string>())
+                           : -1;
+    if (choice < 0) {
+      throw std::runtime_error("Invalid answer " + letter.dump() + " of " +
+                               where);
+    }
+    answers[i] = static_cast<u8>(choice);
+  }
+  return answers;
+}
+
+}  // namespace
+
+bool LetterFormat::is_sheets(const json& body) {
+  if (body.is_object()) {
+    // Objects with a sink are reviews of exams in the numeric form
+    return body.contains("exams") && !body.contains("sink") &&
+           is_sheets(body["exams"]);
+  }
+  return body.is_array() && !body.empty() && body[0].is_object() &&
+         body[0].contains("student_id");
+}
+
+std::vector<AnswerSheet> LetterFormat::read_sheets(const json& body) {
+  const auto& sheets_json = body.is_object() ? body.at("exams") : body;
+  if (!sheets_json.is_array()) {
+    throw std::runtime_error("Exams must be an array");
+  }
+  std::vector<AnswerSheet> sheets(sheets_json.size());
+  for (size_t i = 0; i < sheets.size(); i++) {
+    const auto& sheet = sheets_json[i];
+    if (!sheet.is_object() || !sheet.contains("answers")) {
+      throw std::runtime_error("Sheet " + std::to_string(i) +
+                               " has no answers");
+    }
+    sheets[i].student_id = read_name(sheet, "student_id", i);
+    sheets[i].exam_id = read_name(sheet, "exam_id", i);
+    sheets[i].answers =
+        read_letters(sheet["answers"], "sheet " + std::to_string(i));
+  }
+  return sheets;
+}
+
+std::vector<LetterKey> LetterFormat::read_keys(const json& keys) {
+  const auto& map = keys.contains("answer_keys") ? keys["answer_keys"] : keys;
+  if (!map.is_object()) {
+    throw std::runtime_error("Answer keys must be an object");
+  }
+  std::vector<LetterKey> letter_keys;
+  for (const auto& [exam_id, letters] : map.items()) {
+    letter_keys.push_back({exam_id, read_letters(letters, "key " + exam_id)});
+  }
+  return letter_keys;
+}
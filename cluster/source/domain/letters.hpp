@@ -0,0 +1,87 @@
+#pragma once
+#ifndef LETTERS_HPP
+#define LETTERS_HPP
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <utility>
+#include <vector>
+
+using json = nlohmann::json;
+
+/**
+ * @brief Answer sheet in the letter format
+ */
+struct AnswerSheet {
+  std::string student_id;  /** Name of the student */
+  std::string exam_id;     /** Name of the exam, the stage of its key */
+  std::vector<u8> answers; /** Dense answers, as in MPIExam */
+};
+
+/**
+ * @brief Answer key of a named exam in the letter format
+ */
+struct LetterKey {
+  std::string exam_id;     /** Name of the exam */
+  std::vector<u8> answers; /** Dense key, 0 for questions without key */
+};
+
+/**
+ * @brief Letter format of the answer sheets and keys
+ * @details A sheet is {"student_id": "...", "exam_id": "...", "answers":
+ *          ["C", "A", "", ...]}: the position of an answer is its question
+ *          (the first one is question 1), the letters A..Z (in any case)
+ *          are the choices 1..26 and an empty string or null is a blank.
+ *          A REVIEW takes an array of sheets or {"exams": [...]}.
+ *          Keys are {"answer_keys": {<exam_id>: ["C", "A", ...]}} or the
+ *          bare map; every exam_id names a stage.
+ *          These readers take a parsed document and report what is wrong
+ *          with it; JsonCodec::read_sheets is the fast path for plain text.
+ */
+class LetterFormat {
+ public:
+  LetterFormat() = delete;
+  ~LetterFormat() = delete;
+
+  /**
+   * @brief Choice of a letter, 0 for a blank
+   * @return -1 if the text is not a letter
+   */
+  static i32 choice(std::string_view letter) {
+    if (letter.empty()) {
+      return 0;
+    }
+    if (letter.size() != 1) {
+      return -1;
+    }
+    auto c = letter[0];
+    if (c >= 'A' && c <= 'Z') {
+      return c - 'A' + 1;
+    }
+    if (c >= 'a' && c <= 'z') {
+      return c - 'a' + 1;
+    }
+    return -1;
+  }
+
+  /**
+   * @brief Whether a REVIEW body holds letter sheets
+   */
+  static bool is_sheets(const json& body);
+
+  /**
+   * @brief Read the sheets of a REVIEW body
+   * @throw std::runtime_error If a sheet is not valid
+   */
+  static std::vector<AnswerSheet> read_sheets(const json& body);
+
+  /**
+   * @brief Read letter answer keys
+   * @throw std::runtime_error If a key is not valid
+   */
+  static std::vector<LetterKey> read_keys(const json& keys);
+};
+
+#endif  // LETTERS_HPP
@@ -0,0 +1,69 @@
+#include "packing.hpp"
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+template <i32 Bits>
+AnswerCounts score_words(std::span<const u64> answers,
+                         std::span<const u64> key) {
+  i32 correct = 0;
+  i32 wrong = 0;
+  i32 unscored = 0;
+  auto keyed_words = std::min(answers.size(), key.size());
+  for (size_t i = 0; i < keyed_words; i++) {
+    auto answered = AnswerPacking::non_zero_lanes<Bits>(answers[i]);
+    auto keyed = AnswerPacking::non_zero_lanes<Bits>(key[i]);
+    auto differ = AnswerPacking::non_zero_lanes<Bits>(answers[i] ^ key[i]);
+    correct += std::popcount(answered & keyed & ~differ);
+    wrong += std::popcount(answered & keyed & differ);
+    unscored += std::popcount(answered & ~keyed);
+  }
+  for (size_t i = keyed_words; i < answers.size(); i++) {
+    unscored += std::popcount(AnswerPacking::non_zero_lanes<Bits>(answers[i]));
+  }
+  return {correct, wrong, unscored};
+}
+
+}  // namespace
+
+i32 AnswerPacking::bits_for(std::span<const u8> answers) {
+  auto narrow = std::ranges::all_of(answers, [](u8 answer) {
+    return answer < (1 << NARROW_BITS);
+  });
+  return narrow ? NARROW_BITS : WIDE_BITS;
+}
+
+u64* AnswerPacking::pack(std::span<const u8> answers, i32 bits, u64* output) {
+  auto per_word = static_cast<size_t>(64 / bits);
+  for (size_t first = 0; first < answers.size(); first += per_word) {
+    auto last = std::min(first + per_word, answers.size());
+    u64 word = 0;
+    for (size_t i = first; i < last; i++) {
+      word |= static_cast<u64>(answers[i]) << ((i - first) * bits);
+    }
+    *output++ = word;
+  }
+  return output;
+}
+
+std::vector<u64> AnswerPacking::pack(std::span<const u8> answers, i32 bits) {
+  std::vector<u64> words(AnswerPacking::words(answers.size(), bits));
+  pack(answers, bits, words.data());
+  return words;
+}
+
+void AnswerPacking::widen(std::span<const u64> narrow, size_t questions,
+                          std::vector<u64>& wide) {
+  wide.assign(words(questions, WIDE_BITS), 0);
+  for (size_t i = 0; i < questions; i++) {
+    auto answer = (narrow[i / 16] >> (i % 16 * NARROW_BITS)) & 0xf;
+    wide[i / 8] |= answer << (i % 8 * WIDE_BITS);
+  }
+}
+
+AnswerCounts AnswerPacking::score(std::span<const u64> answers,
+                                  std::span<const u64> key, i32 bits) {
+  return bits == NARROW_BITS ? score_words<NARROW_BITS>(answers, key)
+                             : score_words<WIDE_BITS>(answers, key);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#ifndef PACKING_HPP
+#define PACKING_HPP
+
+#include <span>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Correct, wrong and unscored answers of an exam
+ */
+struct AnswerCounts {
+  i32 correct = 0;
+  i32 wrong = 0;
+  i32 unscored = 0;
+  bool operator==(const AnswerCounts&) const = default;
+};
+
+/**
+ * @brief Bit-packed answers, as they travel to the workers and are scored
+ * @details Question q takes lane q - 1 of a sequence of 64-bit words, the
+ *          first lanes in the low bits. A lane holds the choice and 0 marks
+ *          a blank, so no separate validity mask is needed: the mask of a
+ *          word is derived from its non-zero lanes. Exams whose choices fit
+ *          in 1..15 use NARROW_BITS (16 answers per word); the rest use
+ *          WIDE_BITS (8 per word). Unused lanes of the last word are 0.
+ *          An exam is scored against a key packed at the same width with
+ *          XOR and popcount, a word at a time.
+ */
+class AnswerPacking {
+ public:
+  AnswerPacking() = delete;
+  ~AnswerPacking() = delete;
+
+  static constexpr i32 NARROW_BITS = 4;
+  static constexpr i32 WIDE_BITS = 8;
+
+  /**
+   * @brief Narrowest width that holds every choice
+   */
+  static i32 bits_for(std::span<const u8> answers);
+
+  /**
+   * @brief Words of `questions` answers packed at `bits`
+   */
+  static size_t words(size_t questions, i32 bits) {
+    return (questions * static_cast<size_t>(bits) + 63) / 64;
+  }
+
+  /**
+   * @brief Pack dense answers at `bits`, which must hold every choice
+   * @return End of the written words
+   */
+  static u64* pack(std::span<const u8> answers, i32 bits, u64* output);
+
+  static std::vector<u64> pack(std::span<const u8> answers, i32 bits);
+
+  /**
+   * @brief Answer of question `index + 1`, 0 past the end of the words
+   */
+  static u8 lane(std::span<const u64> words, size_t index, i32 bits) {
+    auto bit = index * static_cast<size_t>(bits);
+    if (bit / 64 >= words.size()) {
+      return 0;
+    }
+    return static_cast<u8>((words[bit / 64] >> (bit % 64)) &
+                           ((u64{1} << bits) - 1));
+  }
+
+  /**
+   * @brief Low bit of every non-zero lane of a word, the rest cleared
+   */
+  template <i32 Bits>
+  static u64 non_zero_lanes(u64 word) {
+    constexpr u64 low_bits = ~u64{0} / ((u64{1} << Bits) - 1);
+    if constexpr (Bits == 8) {
+      word |= word >> 4;
+    }
+    word |= word >> 2;
+    word |= word >> 1;
+    return word & low_bits;
+  }
+
+  /**
+   * @brief Repack narrow words at WIDE_BITS
+   */
+  static void widen(std::span<const u64> narrow, size_t questions,
+                    std::vector<u64>& wide);
+
+  /**
+   * @brief Score packed answers against a key packed at the same width
+   * @details Answers past the end of the key are unscored.
+   */
+  static AnswerCounts score(std::span<const u64> answers,
+                            std::span<const u64> key, i32 bits);
+};
+
+#endif  // PACKING_HPP
@@ -0,0 +1,187 @@
+#include "queue.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <domain/evaluator.hpp>
+#include <domain/packing.hpp>
+#include <domain/sink.hpp>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <system/environment.hpp>
+
+std::unique_ptr<RMAWorkQueue> RMAWorkQueue::_instance = nullptr;
+
+RMAWorkQueue& RMAWorkQueue::instance() {
+  static std::once_flag flag;
+  std::call_once(flag, []() { _instance.reset(new RMAWorkQueue()); });
+  return *_instance;
+}
+
+void RMAWorkQueue::init(MPI_Comm comm) {
+  i32 rank;
+  MPI_Comm_rank(comm, &rank);
+  // Settings of rank 0 win, so every rank agrees on the collective calls
+  std::array<i64, 3> settings{0, 64 << 20, 256};
+  if (rank == 0) {
+    auto mode = Environment::get("SH_DISTRIBUTION");
+    auto bytes = Environment::get("SH_RMA_BYTES");
+    auto chunk = Environment::get("SH_RMA_CHUNK");
+    settings[0] = mode && *mode == "rma";
+    if (bytes) {
+      settings[1] = std::stoll(*bytes);
+    }
+    if (chunk) {
+      settings[2] = std::max(1LL, std::stoll(*chunk));
+    }
+  }
+  MPI_Bcast(settings.data(), settings.size(), MPI_INT64_T, 0, comm);
+  if (!settings[0]) {
+    return;
+  }
+  // Displacements of MPI_Get/MPI_Put are counted in i32 bytes
+  _capacity = std::min<i64>(settings[1], std::numeric_limits<i32>::max());
+  _chunk = static_cast<i32>(
+      std::min<i64>(settings[2], std::numeric_limits<i32>::max()));
+  MPI_Aint size = rank == 0 ? static_cast<MPI_Aint>(_capacity) : 0;
+  auto alloc_result =
+      MPI_Win_allocate(size, 1, MPI_INFO_NULL, comm, &_base, &_window);
+  if (alloc_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to allocate work queue window");
+  }
+  // Passive epoch for the whole run
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, _window);
+  if (rank == 0) {
+    spdlog::info("RMA work queue enabled: {} bytes, chunks of {} exams",
+                 _capacity, _chunk);
+  }
+}
+
+void RMAWorkQueue::free() {
+  if (_window != MPI_WIN_NULL) {
+    MPI_Win_unlock_all(_window);
+    MPI_Win_free(&_window);
+    _base = nullptr;
+  }
+}
+
+RMAJobLayout RMAWorkQueue::layout(i32 exams, i32 answer_words) {
+  auto align = [](size_t bytes) { return (bytes + 7) & ~size_t{7}; };
+  RMAJobLayout layout{};
+  layout.headers = 64;  // the cursor (i64) lives at offset 0
+  layout.offsets = align(layout.headers + exams * sizeof(MPIExamHeader));
+  layout.answers = layout.offsets + (exams + 1) * sizeof(i64);
+  layout.results = align(layout.answers + answer_words * sizeof(u64));
+  layout.total = layout.results + exams * sizeof(MPIResult);
+  return layout;
+}
+
+bool RMAWorkQueue::publish(const std::vector<std::vector<MPIExam>>& slices) {
+  i64 exams = 0;
+  i64 answer_words = 0;
+  _answer_bits.clear();
+  for (const auto& slice : slices) {
+    exams += slice.size();
+    for (const auto& exam : slice) {
+      auto bits = AnswerPacking::bits_for(exam.answers);
+      _answer_bits.push_back(bits);
+      answer_words += AnswerPacking::words(exam.answers.size(), bits);
+    }
+  }
+  if (!enabled() || exams > std::numeric_limits<i32>::max() ||
+      answer_words > std::numeric_limits<i32>::max()) {
+    return false;
+  }
+  auto job = layout(static_cast<i32>(exams), static_cast<i32>(answer_words));
+  if (job.total > _capacity) {
+    return false;
+  }
+  auto* headers = reinterpret_cast<MPIExamHeader*>(_base + job.headers);
+  auto* offsets = reinterpret_cast<i64*>(_base + job.offsets);
+  auto* words = reinterpret_cast<u64*>(_base + job.answers);
+  auto* bits = _answer_bits.data();
+  i64 offset = 0;
+  for (const auto& slice : slices) {
+    for (const auto& exam : slice) {
+      auto size = static_cast<i32>(exam.answers.size());
+      *headers++ = {exam.stage, exam.id_exam, size, *bits};
+      *offsets++ = offset;
+      auto* end = AnswerPacking::pack(exam.answers, *bits++, words);
+      offset += end - words;
+      words = end;
+    }
+  }
+  *offsets = offset;
+  i64 cursor = 0;
+  std::memcpy(_base, &cursor, sizeof(cursor));
+  _exams = static_cast<i32>(exams);
+  _answer_words = static_cast<i32>(answer_words);
+  _job = job;
+  // Visible to the workers once they receive the job header
+  MPI_Win_sync(_window);
+  return true;
+}
+
+std::vector<MPIResult> RMAWorkQueue::results() const {
+  MPI_Win_sync(_window);
+  const auto* begin = reinterpret_cast<const MPIResult*>(_base + _job.results);
+  return {begin, begin + _exams};
+}
+
+MPISinkSummary RMAWorkQueue::drain(const MPIWork& work, i32 rank) {
+  auto job = layout(work.queue_exams, work.queue_words);
+  SinkTarget target{work.sink_directory, work.sink_job};
+  auto& evaluator = Evaluator::instance();
+  MPISinkSummary summary{};
+  const i64 increment = work.queue_chunk;
+  while (true) {
+    i64 begin = 0;
+    MPI_Fetch_and_op(&increment, &begin, MPI_INT64_T, 0, 0, MPI_SUM, _window);
+    MPI_Win_flush(0, _window);
+    if (begin >= work.queue_exams) {
+      break;
+    }
+    auto end = std::min<i64>(begin + increment, work.queue_exams);
+    auto count = static_cast<size_t>(end - begin);
+    _headers.resize(count);
+    _offsets.resize(count + 1);
+    _get(_headers.data(), count * sizeof(MPIExamHeader),
+         job.headers + begin * sizeof(MPIExamHeader));
+    _get(_offsets.data(), (count + 1) * sizeof(i64),
+         job.offsets + begin * sizeof(i64));
+    MPI_Win_flush(0, _window);
+    auto words = static_cast<size_t>(_offsets.back() - _offsets.front());
+    _answers.resize(words);
+    _get(_answers.data(), words * sizeof(u64),
+         job.answers + _offsets.front() * sizeof(u64));
+    MPI_Win_flush(0, _window);
+    MPIPackedExams exams{_headers, _answers};
+    if (work.command == MPICommand::REVIEW_SINK) {
+      auto appended = ResultSink::instance().append(target, rank, exams);
+      summary.rows += appended.rows;
+      summary.bytes += appended.bytes;
+      summary.correct_answers += appended.correct_answers;
+      summary.wrong_answers += appended.wrong_answers;
+      summary.unscored_answers += appended.unscored_answers;
+      summary.score_sum += appended.score_sum;
+      continue;
+    }
+    auto results = evaluator.evaluate_exam_batch(exams);
+    MPI_Put(results.data(), static_cast<i32>(count * sizeof(MPIResult)),
+            MPI_BYTE, 0, job.results + begin * sizeof(MPIResult),
+            static_cast<i32>(count * sizeof(MPIResult)), MPI_BYTE, _window);
+    MPI_Win_flush(0, _window);
+    summary.rows += static_cast<i64>(count);
+  }
+  return summary;
+}
+
+void RMAWorkQueue::_get(void* buffer, size_t bytes, size_t displacement) {
+  if (bytes == 0) {
+    return;
+  }
+  MPI_Get(buffer, static_cast<i32>(bytes), MPI_BYTE, 0,
+          static_cast<MPI_Aint>(displacement), static_cast<i32>(bytes),
+          MPI_BYTE, _window);
+}
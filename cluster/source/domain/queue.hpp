@@ -0,0 +1,101 @@
+#pragma once
+#ifndef QUEUE_HPP
+#define QUEUE_HPP
+
+#include <mpi.h>
+#include <algorithm>
+#include <domain/coordinator.hpp>
+#include <memory>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Byte layout of a queued job in the master's window
+ */
+struct RMAJobLayout {
+  size_t headers; /** MPIExamHeader x exams */
+  size_t offsets; /** i64 x (exams + 1), first answer word of every exam */
+  size_t answers; /** u64 x answer words, the packed answers */
+  size_t results; /** MPIResult x exams */
+  size_t total;
+};
+
+/**
+ * @brief One-sided work queue, an alternative to master-driven batches
+ * @details The master exposes the whole batch, an atomic cursor and a result
+ *          area in an RMA window. Workers claim chunks of `chunk` exams with
+ *          MPI_Fetch_and_op on the cursor, read them with MPI_Get and write
+ *          their results back with MPI_Put, so faster ranks simply claim
+ *          more chunks. The master only writes the batch and waits for one
+ *          completion message per worker.
+ *          Environment (read on rank 0):
+ *          - SH_DISTRIBUTION: "rma" enables the queue (default "send").
+ *          - SH_RMA_BYTES: size of the window (default 64 MiB). Batches that
+ *            do not fit are sent as usual.
+ *          - SH_RMA_CHUNK: exams claimed at once (default 256).
+ */
+class RMAWorkQueue {
+ public:
+  static RMAWorkQueue& instance();
+  ~RMAWorkQueue() = default;
+
+  /**
+   * @brief Create the window. Collective over `comm`, whose rank 0 is the
+   *        master.
+   */
+  void init(MPI_Comm comm);
+
+  /**
+   * @brief Free the window. Collective, must be called before MPI_Finalize.
+   */
+  void free();
+
+  bool enabled() const { return _window != MPI_WIN_NULL; }
+  i32 chunk() const { return _chunk; }
+  /** Chunk of the next jobs, it travels in their batch header (master) */
+  void set_chunk(i32 chunk) { _chunk = std::max(chunk, 1); }
+  static RMAJobLayout layout(i32 exams, i32 answer_words);
+
+  /**
+   * @brief Write a batch into the window and reset the cursor (master)
+   * @return false if the batch does not fit the window
+   */
+  bool publish(const std::vector<std::vector<MPIExam>>& slices);
+
+  /**
+   * @brief Answer words of the published batch (master)
+   */
+  i32 answer_words() const { return _answer_words; }
+
+  /**
+   * @brief Results written by the workers, in batch order (master)
+   */
+  std::vector<MPIResult> results() const;
+
+  /**
+   * @brief Claim and evaluate chunks until the queue is empty (worker)
+   * @return Summary of the evaluated exams; for REVIEW_SINK the results are
+   *         appended to the worker's sink file, for REVIEW they are written
+   *         to the master's window.
+   */
+  MPISinkSummary drain(const MPIWork& work, i32 rank);
+
+ private:
+  RMAWorkQueue() = default;
+  static std::unique_ptr<RMAWorkQueue> _instance;
+  MPI_Win _window = MPI_WIN_NULL;
+  char* _base = nullptr;
+  size_t _capacity = 0;
+  i32 _chunk = 256;
+  i32 _exams = 0;        /** Exams of the published batch */
+  i32 _answer_words = 0; /** Answer words of the published batch */
+  RMAJobLayout _job{};   /** Layout of the published batch */
+  std::vector<MPIExamHeader> _headers;
+  std::vector<i64> _offsets;
+  std::vector<u64> _answers;
+  std::vector<i32> _answer_bits;
+
+  void _get(void* buffer, size_t bytes, size_t displacement);
+};
+
+#endif  // QUEUE_HPP
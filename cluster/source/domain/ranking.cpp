@@ -0,0 +1,155 @@
+#include "ranking.hpp"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+std::unique_ptr<ScoreIndex> ScoreIndex::_instance = nullptr;
+
+ScoreIndex& ScoreIndex::instance() {
+  static std::once_flag flag;
+  std::call_once(flag, []() { _instance.reset(new ScoreIndex()); });
+  return *_instance;
+}
+
+bool ScoreIndex::_ranks_before(const MPIResult& lhs, const MPIResult& rhs) {
+  if (lhs.score != rhs.score) {
+    return lhs.score > rhs.score;
+  }
+  return lhs.id_exam < rhs.id_exam;
+}
+
+void ScoreIndex::update(const std::vector<MPIResult>& results) {
+  std::map<i32, std::vector<MPIResult>> runs;
+  for (const auto& result : results) {
+    runs[result.stage].push_back(result);
+  }
+  for (auto& [stage, run] : runs) {
+    _merge_run(_stages[stage], run);
+  }
+}
+
+void ScoreIndex::_merge_run(StageIndex& index, std::vector<MPIResult>& run) {
+  // Keep only the last result of every exam inside the run
+  std::unordered_map<i32, size_t> last_seen;
+  last_seen.reserve(run.size());
+  for (size_t i = 0; i < run.size(); i++) {
+    last_seen[run[i].id_exam] = i;
+  }
+  if (last_seen.size() != run.size()) {
+    std::vector<MPIResult> unique_run;
+    unique_run.reserve(last_seen.size());
+    for (size_t i = 0; i < run.size(); i++) {
+      if (last_seen[run[i].id_exam] == i) {
+        unique_run.push_back(run[i]);
+      }
+    }
+    run.swap(unique_run);
+  }
+  // Drop the entries replaced by this run (single linear pass)
+  bool replaces = false;
+  for (const auto& result : run) {
+    if (index.scores.contains(result.id_exam)) {
+      replaces = true;
+      break;
+    }
+  }
+  if (replaces) {
+    std::erase_if(index.ranked, [&last_seen](const MPIResult& result) {
+      return last_seen.contains(result.id_exam);
+    });
+  }
+  for (const auto& result : run) {
+    index.scores[result.id_exam] = result.score;
+  }
+  std::sort(run.begin(), run.end(), _ranks_before);
+  auto middle = index.ranked.size();
+  index.ranked.insert(index.ranked.end(), run.begin(), run.end());
+  std::inplace_merge(index.ranked.begin(), index.ranked.begin() + middle,
+                     index.ranked.end(), _ranks_before);
+}
+
+void ScoreIndex::clear() {
+  _stages.clear();
+}
+
+size_t ScoreIndex::size(i32 stage) const {
+  auto it = _stages.find(stage);
+  return it == _stages.end() ? 0 : it->second.ranked.size();
+}
+
+std::vector<MPIResult> ScoreIndex::top(i32 stage, size_t k) const {
+  auto it = _stages.find(stage);
+  if (it == _stages.end()) {
+    return std::vector<MPIResult>();
+  }
+  const auto& ranked = it->second.ranked;
+  auto count = std::min(k, ranked.size());
+  return std::vector<MPIResult>(ranked.begin(), ranked.begin() + count);
+}
+
+std::optional<RankedResult> ScoreIndex::rank_of(i32 stage,
+                                                i32 id_exam) const {
+  auto it = _stages.find(stage);
+  if (it == _stages.end()) {
+    return std::nullopt;
+  }
+  const auto& index = it->second;
+  auto score_it = index.scores.find(id_exam);
+  if (score_it == index.scores.end()) {
+    return std::nullopt;
+  }
+  MPIResult key{};
+  key.id_exam = id_exam;
+  key.score = score_it->second;
+  auto entry = std::lower_bound(index.ranked.begin(), index.ranked.end(), key,
+                                _ranks_before);
+  auto first_tie = std::lower_bound(
+      index.ranked.begin(), index.ranked.end(), key.score,
+      [](const MPIResult& result, double score) {
+        return result.score > score;
+      });
+  return RankedResult{
+      static_cast<size_t>(first_tie - index.ranked.begin()) + 1,
+      static_cast<size_t>(entry - index.ranked.begin()) + 1, *entry};
+}
+
+std::optional<MPIResult> ScoreIndex::at_percentile(i32 stage,
+                                                   double percentile) const {
+  auto it = _stages.find(stage);
+  if (it == _stages.end() || it->second.ranked.empty()) {
+    return std::nullopt;
+  }
+  if (percentile < 0.0 || percentile > 100.0) {
+    throw std::runtime_error("Percentile must be between 0 and 100");
+  }
+  // Nearest-rank method over the ascending order of scores
+  const auto& ranked = it->second.ranked;
+  auto total = ranked.size();
+  auto ordinal =
+      static_cast<size_t>(std::ceil(percentile / 100.0 * total));
+  ordinal = std::clamp<size_t>(ordinal, 1, total);
+  return ranked[total - ordinal];
+}
+
+i32 ScoreIndex::intern_student(i32 stage, std::string_view student_id) {
+  return _stages[stage].students.intern(student_id);
+}
+
+std::optional<i32> ScoreIndex::find_student(
+    i32 stage, std::string_view student_id) const {
+  auto it = _stages.find(stage);
+  if (it == _stages.end()) {
+    return std::nullopt;
+  }
+  return it->second.students.find(student_id);
+}
+
+std::string ScoreIndex::student_name(i32 stage, i32 id_exam) const {
+  auto it = _stages.find(stage);
+  if (it != _stages.end() && id_exam >= IdTable::FIRST_ID &&
+      static_cast<size_t>(id_exam - IdTable::FIRST_ID) <
+          it->second.students.size()) {
+    return it->second.students.name(id_exam);
+  }
+  return std::to_string(id_exam);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef RANKING_HPP
+#define RANKING_HPP
+
+#include <domain/coordinator.hpp>
+#include <domain/ids.hpp>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Position of an exam inside the ranking of its stage
+ */
+struct RankedResult {
+  size_t rank;      /** 1-based competition rank (ties share the rank) */
+  size_t position;  /** 1-based position in the ordering */
+  MPIResult result; /** Latest result of the exam */
+};
+
+/**
+ * @brief Score index of the latest results of every stage
+ * @details Lives on the master. Every review gathers one run of results per
+ *          worker; the runs are sorted per stage and merged into an ordering
+ *          by score (descending) and id_exam (ascending). A result for an
+ *          id_exam that is already indexed replaces the previous one.
+ *          The exams of a named stage (letter keys) are students: their
+ *          ids are interned in the stage, so they are kept and cleared with
+ *          the results they rank.
+ */
+class ScoreIndex {
+ public:
+  static ScoreIndex& instance();
+  ~ScoreIndex() = default;
+  void update(const std::vector<MPIResult>& results);
+  void clear();
+  size_t size(i32 stage) const;
+  std::vector<MPIResult> top(i32 stage, size_t k) const;
+  std::optional<RankedResult> rank_of(i32 stage, i32 id_exam) const;
+  std::optional<MPIResult> at_percentile(i32 stage, double percentile) const;
+
+  /**
+   * @brief Id of a student of a named stage, added if it is new
+   */
+  i32 intern_student(i32 stage, std::string_view student_id);
+
+  /**
+   * @brief Id of a student of a named stage, if it was interned
+   */
+  std::optional<i32> find_student(i32 stage,
+                                  std::string_view student_id) const;
+
+  /**
+   * @brief Student id of an exam of a named stage, or the number of the exam
+   *        if it was not interned
+   */
+  std::string student_name(i32 stage, i32 id_exam) const;
+
+ private:
+  struct StageIndex {
+    std::vector<MPIResult> ranked;
+    std::unordered_map<i32, double> scores;
+    IdTable students; /** Student ids of a named stage */
+  };
+
+  ScoreIndex() = default;
+  static std::unique_ptr<ScoreIndex> _instance;
+  std::map<i32, StageIndex> _stages;
+
+  static bool _ranks_before(const MPIResult& lhs, const MPIResult& rhs);
+  void _merge_run(StageIndex& index, std::vector<MPIResult>& run);
+};
+
+#endif  // RANKING_HPP
@@ -0,0 +1,222 @@
+#include "resident.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <bit>
+#include <domain/evaluator.hpp>
+#include <mutex>
+#include <system/environment.hpp>
+#include <system/logger.hpp>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief Key words at WIDE_BITS, empty for a stage without key
+ */
+std::span<const u64> key_words(const std::shared_ptr<const StageKey>& key) {
+  return key ? std::span<const u64>(key->packed.wide) : std::span<const u64>();
+}
+
+bool same_key(const std::shared_ptr<const StageKey>& lhs,
+              const std::shared_ptr<const StageKey>& rhs) {
+  return lhs == rhs || std::ranges::equal(key_words(lhs), key_words(rhs));
+}
+
+/**
+ * @brief Add (delta 1) or remove (delta -1) an answer from the counts
+ */
+void tally(AnswerCounts& counts, u8 key, u8 answer, i32 delta) {
+  if (key == 0) {
+    counts.unscored += delta;
+  } else if (key == answer) {
+    counts.correct += delta;
+  } else {
+    counts.wrong += delta;
+  }
+}
+
+}  // namespace
+
+std::unique_ptr<ResidentExams> ResidentExams::_instance = nullptr;
+
+ResidentExams& ResidentExams::instance() {
+  static std::once_flag flag;
+  std::call_once(flag, []() { _instance.reset(new ResidentExams()); });
+  return *_instance;
+}
+
+ResidentExams::ResidentExams()
+    : _capacity(Environment::get_or<u64>("SH_RESIDENT_MAX_EXAMS", 1 << 20)) {}
+
+void ResidentExams::keep(const MPIPackedExams& exams,
+                         std::span<const MPIResult> results) {
+  auto answers = AnswersManager::instance().snapshot();
+  size_t word = 0;
+  for (size_t i = 0; i < exams.size(); i++) {
+    const auto& header = exams.headers[i];
+    auto words = AnswerPacking::words(header.answers_size, header.answer_bits);
+    auto exam_words = exams.answers.subspan(word, words);
+    word += words;
+    auto& stage = _stages[header.stage];
+    _drop(stage, header.id_exam);  // the new answers replace the kept ones
+    if (_size >= _capacity) {
+      SH_LOG_EVERY_MS(spdlog::level::warn, 1000,
+                      "Resident exams are full ({}), exam {} is not kept",
+                      _capacity, header.id_exam);
+      continue;
+    }
+    auto key_it = answers->keys.find(header.stage);
+    std::shared_ptr<const StageKey> key =
+        key_it == answers->keys.end() ? nullptr : key_it->second;
+    auto segment = std::ranges::find_if(stage.segments, [&](const auto& s) {
+      return same_key(s.key, key);
+    });
+    if (segment == stage.segments.end()) {
+      segment = stage.segments.insert(segment, Segment{key, {}, {}, 0});
+    }
+    // Same contents: keep the newest version so rescore() skips it
+    segment->key = key;
+    const auto& result = results[i];
+    _append(*segment,
+            {header.id_exam,
+             header.answers_size,
+             header.answer_bits,
+             {result.correct_answers, result.wrong_answers,
+              result.unscored_answers},
+             0,
+             true},
+            exam_words);
+    stage.exams[header.id_exam] = {
+        static_cast<size_t>(segment - stage.segments.begin()),
+        segment->exams.size() - 1};
+    _size++;
+  }
+}
+
+void ResidentExams::drop(std::span<const MPIExamHeader> exams) {
+  for (const auto& header : exams) {
+    auto stage = _stages.find(header.stage);
+    if (stage != _stages.end()) {
+      _drop(stage->second, header.id_exam);
+    }
+  }
+}
+
+std::vector<MPIResult> ResidentExams::rescore() {
+  auto answers = AnswersManager::instance().snapshot();
+  auto& evaluator = Evaluator::instance();
+  std::vector<MPIResult> changed;
+  std::vector<size_t> questions;
+  for (auto& [stage_id, stage] : _stages) {
+    auto key_it = answers->keys.find(stage_id);
+    std::shared_ptr<const StageKey> key =
+        key_it == answers->keys.end() ? nullptr : key_it->second;
+    for (auto& segment : stage.segments) {
+      if (segment.key == key) {
+        continue;
+      }
+      // Questions whose key changed, in ascending order
+      auto previous = std::exchange(segment.key, key);
+      auto before = key_words(previous);
+      auto after = key_words(key);
+      questions.clear();
+      for (size_t w = 0; w < std::max(before.size(), after.size()); w++) {
+        auto diff = (w < before.size() ? before[w] : 0) ^
+                    (w < after.size() ? after[w] : 0);
+        while (diff != 0) {
+          auto lane = static_cast<size_t>(std::countr_zero(diff)) /
+                      AnswerPacking::WIDE_BITS;
+          questions.push_back(w * (64 / AnswerPacking::WIDE_BITS) + lane);
+          diff &= ~(u64{0xff} << (lane * AnswerPacking::WIDE_BITS));
+        }
+      }
+      if (questions.empty()) {
+        continue;
+      }
+      for (auto& exam : segment.exams) {
+        if (!exam.live) {
+          continue;
+        }
+        std::span<const u64> exam_words(
+            segment.words.data() + exam.offset,
+            AnswerPacking::words(exam.answers_size, exam.answer_bits));
+        auto counts = exam.counts;
+        for (auto question : questions) {
+          if (question >= static_cast<size_t>(exam.answers_size)) {
+            break;
+          }
+          auto answer =
+              AnswerPacking::lane(exam_words, question, exam.answer_bits);
+          if (answer == 0) {
+            continue;
+          }
+          tally(counts,
+                AnswerPacking::lane(before, question, AnswerPacking::WIDE_BITS),
+                answer, -1);
+          tally(counts,
+                AnswerPacking::lane(after, question, AnswerPacking::WIDE_BITS),
+                answer, 1);
+        }
+        if (counts != exam.counts) {
+          exam.counts = counts;
+          changed.push_back(evaluator.result(stage_id, exam.id_exam, counts));
+        }
+      }
+    }
+    if (stage.segments.size() > 1) {
+      _compact(stage);  // every segment has the current key now
+    }
+  }
+  return changed;
+}
+
+void ResidentExams::_drop(Stage& stage, i32 id_exam) {
+  auto kept = stage.exams.find(id_exam);
+  if (kept == stage.exams.end()) {
+    return;
+  }
+  auto& segment = stage.segments[kept->second.first];
+  segment.exams[kept->second.second].live = false;
+  segment.dead++;
+  stage.exams.erase(kept);
+  _size--;
+  if (segment.dead * 2 > segment.exams.size()) {
+    _compact(stage);
+  }
+}
+
+void ResidentExams::_append(Segment& segment, const Exam& exam,
+                            std::span<const u64> words) {
+  segment.exams.push_back(exam);
+  segment.exams.back().offset = segment.words.size();
+  segment.words.insert(segment.words.end(), words.begin(), words.end());
+}
+
+void ResidentExams::_compact(Stage& stage) {
+  // Drop the replaced exams and merge the segments with the same key
+  std::vector<Segment> segments;
+  stage.exams.clear();
+  for (auto& old : stage.segments) {
+    if (old.dead == old.exams.size()) {
+      continue;
+    }
+    auto segment = std::ranges::find_if(segments, [&](const auto& s) {
+      return same_key(s.key, old.key);
+    });
+    if (segment == segments.end()) {
+      segment = segments.insert(segment, Segment{old.key, {}, {}, 0});
+    }
+    auto index = static_cast<size_t>(segment - segments.begin());
+    for (const auto& exam : old.exams) {
+      if (!exam.live) {
+        continue;
+      }
+      _append(*segment, exam,
+              std::span<const u64>(
+                  old.words.data() + exam.offset,
+                  AnswerPacking::words(exam.answers_size, exam.answer_bits)));
+      stage.exams[exam.id_exam] = {index, segment->exams.size() - 1};
+    }
+  }
+  stage.segments = std::move(segments);
+}
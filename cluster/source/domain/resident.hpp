@@ -0,0 +1,96 @@
+#pragma once
+#ifndef RESIDENT_HPP
+#define RESIDENT_HPP
+
+#include <domain/answers.hpp>
+#include <domain/coordinator.hpp>
+#include <domain/packing.hpp>
+#include <map>
+#include <memory>
+#include <span>
+#include <system/aliases.hpp>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Scored exams kept on a worker for differential re-scoring
+ * @details After a REVIEW_RESIDENT batch the worker keeps every exam,
+ *          partitioned by stage, as its packed answers, its counts and the
+ *          key they were scored against. A RESCORE compares that key with
+ *          the current one question by question and only visits the changed
+ *          questions of every kept exam, so a key correction costs
+ *          O(changed questions x exams) and no exam is sent again.
+ *          An exam reviewed again in the same stage replaces the kept one;
+ *          if it went to another worker, the master has this one drop() its
+ *          copy with the next RESCORE.
+ *          Environment (read on every worker):
+ *          - SH_RESIDENT_MAX_EXAMS: exams a worker keeps (default 1048576);
+ *            the exams of later batches are not kept once it is reached.
+ */
+class ResidentExams {
+ public:
+  static ResidentExams& instance();
+  ~ResidentExams() = default;
+
+  /**
+   * @brief Keep the exams of a batch with the results they got
+   */
+  void keep(const MPIPackedExams& exams, std::span<const MPIResult> results);
+
+  /**
+   * @brief Forget the exams now kept by another worker
+   */
+  void drop(std::span<const MPIExamHeader> exams);
+
+  /**
+   * @brief Re-score the exams whose stage key changed since they were scored
+   * @return Results of the exams whose counts changed
+   */
+  std::vector<MPIResult> rescore();
+
+  /**
+   * @brief Exams kept
+   */
+  size_t size() const { return _size; }
+
+ private:
+  ResidentExams();
+  static std::unique_ptr<ResidentExams> _instance;
+
+  struct Exam {
+    i32 id_exam;
+    i32 answers_size;
+    i32 answer_bits;
+    AnswerCounts counts;
+    size_t offset; /** First word of the answers in the segment */
+    bool live;     /** false once the exam is reviewed again */
+  };
+
+  /**
+   * @brief Exams of a stage scored against the same key
+   */
+  struct Segment {
+    std::shared_ptr<const StageKey> key; /** null if the stage had no key */
+    std::vector<Exam> exams;
+    std::vector<u64> words; /** Packed answers of the exams */
+    size_t dead = 0;        /** Exams replaced by a later review */
+  };
+
+  struct Stage {
+    std::vector<Segment> segments;
+    /** Segment and position of every live exam */
+    std::unordered_map<i32, std::pair<size_t, size_t>> exams;
+  };
+
+  std::map<i32, Stage> _stages;
+  size_t _size = 0;
+  size_t _capacity;
+
+  void _drop(Stage& stage, i32 id_exam);
+  static void _append(Segment& segment, const Exam& exam,
+                      std::span<const u64> words);
+  static void _compact(Stage& stage);
+};
+
+#endif  // RESIDENT_HPP
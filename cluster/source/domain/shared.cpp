@@ -0,0 +1,120 @@
+#include "shared.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <system/environment.hpp>
+
+std::unique_ptr<NodeSharedRegion> NodeSharedRegion::_instance = nullptr;
+
+NodeSharedRegion& NodeSharedRegion::instance() {
+  static std::once_flag flag;
+  std::call_once(flag, []() { _instance.reset(new NodeSharedRegion()); });
+  return *_instance;
+}
+
+void NodeSharedRegion::init(MPI_Comm comm) {
+  i32 comm_rank, comm_size;
+  MPI_Comm_rank(comm, &comm_rank);
+  MPI_Comm_size(comm, &comm_size);
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, comm_rank, MPI_INFO_NULL,
+                      &_node_comm);
+  i32 node_size;
+  MPI_Comm_size(_node_comm, &node_size);
+  // Ranks of the node in `comm`, the master is node rank 0 if it is here
+  std::vector<i32> node_ranks(node_size), comm_ranks(node_size);
+  std::iota(node_ranks.begin(), node_ranks.end(), 0);
+  MPI_Group comm_group, node_group;
+  MPI_Comm_group(comm, &comm_group);
+  MPI_Comm_group(_node_comm, &node_group);
+  MPI_Group_translate_ranks(node_group, node_size, node_ranks.data(),
+                            comm_group, comm_ranks.data());
+  MPI_Group_free(&comm_group);
+  MPI_Group_free(&node_group);
+  auto shm_bytes = Environment::get("SH_SHM_BYTES");
+  size_t capacity = shm_bytes ? std::stoull(*shm_bytes) : 64 << 20;
+  // Offsets travel as i32 in the batch header
+  capacity = std::min<size_t>(capacity, std::numeric_limits<i32>::max());
+  // Every rank of a node takes the same decision, so skipping is collective
+  if (comm_ranks[0] != 0 || node_size < 2 || capacity == 0) {
+    return;
+  }
+  auto workers = static_cast<size_t>(node_size - 1);
+  auto align = [](size_t bytes) { return bytes & ~size_t{63}; };
+  _answers_capacity = align(capacity / 16);
+  _slot_capacity = align((capacity - _answers_capacity) / workers);
+  _capacity = _answers_capacity + _slot_capacity * workers;
+  i32 node_rank;
+  MPI_Comm_rank(_node_comm, &node_rank);
+  MPI_Aint size = node_rank == 0 ? static_cast<MPI_Aint>(capacity) : 0;
+  char* local = nullptr;
+  auto alloc_result = MPI_Win_allocate_shared(size, 1, MPI_INFO_NULL,
+                                              _node_comm, &local, &_window);
+  if (alloc_result != MPI_SUCCESS) {
+    throw std::runtime_error("Failed to allocate shared region");
+  }
+  MPI_Aint master_size;
+  i32 displacement_unit;
+  MPI_Win_shared_query(_window, 0, &master_size, &displacement_unit, &_base);
+  // Passive epoch for the whole run, ordered with MPI_Win_sync
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, _window);
+  _slot_of_rank.assign(comm_size, -1);
+  for (i32 i = 1; i < node_size; i++) {
+    _slot_of_rank[comm_ranks[i]] = i - 1;
+  }
+  if (comm_rank == 0) {
+    spdlog::info("Shared region of {} bytes for {} local workers", capacity,
+                 workers);
+  }
+}
+
+void NodeSharedRegion::free() {
+  if (_window != MPI_WIN_NULL) {
+    MPI_Win_unlock_all(_window);
+    MPI_Win_free(&_window);
+    _base = nullptr;
+  }
+  if (_node_comm != MPI_COMM_NULL) {
+    MPI_Comm_free(&_node_comm);
+  }
+}
+
+std::span<char> NodeSharedRegion::slot(i32 rank) const {
+  if (!enabled() || rank < 0 ||
+      rank >= static_cast<i32>(_slot_of_rank.size()) ||
+      _slot_of_rank[rank] < 0) {
+    return {};
+  }
+  auto* begin =
+      _base + _answers_capacity + _slot_of_rank[rank] * _slot_capacity;
+  return {begin, _slot_capacity};
+}
+
+i32 NodeSharedRegion::publish_answers(std::string_view answers) {
+  if (!enabled() || answers.size() > _answers_capacity) {
+    return -1;
+  }
+  std::copy(answers.begin(), answers.end(), _base);
+  return 0;
+}
+
+void NodeSharedRegion::publish() const {
+  if (enabled()) {
+    MPI_Win_sync(_window);
+  }
+}
+
+void NodeSharedRegion::acquire() const {
+  if (enabled()) {
+    MPI_Win_sync(_window);
+  }
+}
+
+std::span<const char> NodeSharedRegion::view(i32 offset, size_t size) const {
+  if (!enabled() || offset < 0 || static_cast<size_t>(offset) + size > _capacity) {
+    throw std::runtime_error("Invalid shared region offset");
+  }
+  return {_base + offset, size};
+}
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef SHARED_HPP
+#define SHARED_HPP
+
+#include <mpi.h>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Shared memory region of the ranks on the master's node
+ * @details The master (rank 0 of the coordinator communicator) allocates a
+ *          `MPI_Win_allocate_shared` window over its node communicator
+ *          (`MPI_COMM_TYPE_SHARED`). It holds one answer
+ *          keys area read by every local worker, followed by one batch slot
+ *          per local worker. The master writes a batch in place and only
+ *          sends its header; the worker evaluates it straight from the
+ *          window. Batches that do not fit keep using messages.
+ *          Ranks on other nodes do not join the region.
+ *          Environment:
+ *          - SH_SHM_BYTES: size of the region (default 64 MiB, 0 disables
+ *            the shared path).
+ */
+class NodeSharedRegion {
+ public:
+  static NodeSharedRegion& instance();
+  ~NodeSharedRegion() = default;
+
+  /**
+   * @brief Create the region. Collective over `comm`.
+   */
+  void init(MPI_Comm comm);
+
+  /**
+   * @brief Free the region. Collective over the node communicator, must be
+   *        called before MPI_Finalize.
+   */
+  void free();
+
+  bool enabled() const { return _base != nullptr; }
+
+  /**
+   * @brief Slot of a worker, empty if the worker is not on the master's node
+   * @param rank Rank of the worker in the communicator given to init
+   */
+  std::span<char> slot(i32 rank) const;
+
+  /**
+   * @brief Copy the answer keys into the shared area
+   * @return Offset of the keys in the region, or -1 if they do not fit
+   */
+  i32 publish_answers(std::string_view answers);
+
+  /**
+   * @brief Make the master's writes visible before the headers are sent
+   */
+  void publish() const;
+
+  /**
+   * @brief Make the master's writes visible after a header is received
+   */
+  void acquire() const;
+
+  /**
+   * @brief Bytes of the region at `offset`
+   */
+  std::span<const char> view(i32 offset, size_t size) const;
+
+  /**
+   * @brief Offset of a slot pointer in the region
+   */
+  i32 offset_of(const char* pointer) const {
+    return static_cast<i32>(pointer - _base);
+  }
+
+ private:
+  NodeSharedRegion() = default;
+  static std::unique_ptr<NodeSharedRegion> _instance;
+  MPI_Comm _node_comm = MPI_COMM_NULL;
+  MPI_Win _window = MPI_WIN_NULL;
+  char* _base = nullptr;
+  size_t _capacity = 0;
+  size_t _answers_capacity = 0;
+  size_t _slot_capacity = 0;
+  std::vector<i32> _slot_of_rank; /** Slot index by rank, -1 if none */
+};
+
+#endif  // SHARED_HPP
@@ -0,0 +1,197 @@
+#include "similarity.hpp"
+#include <algorithm>
+#include <bit>
+#include <domain/answers.hpp>
+#include <domain/packing.hpp>
+#include <map>
+#include <span>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+constexpr i32 BITS = AnswerPacking::WIDE_BITS;
+
+/**
+ * @brief Exams of a stage, `stride` words each
+ */
+struct StageExams {
+  i32 stage = 0;
+  size_t stride = 0;
+  std::vector<i32> ids;
+  std::vector<u64> answers;  /** Answers at WIDE_BITS, blanks past the end */
+  std::vector<u64> wrong;    /** Low bit of every lane answered wrong */
+  std::vector<u64> answered; /** Low bit of every lane answered */
+};
+
+u64 lanes(u64 word) {
+  return AnswerPacking::non_zero_lanes<BITS>(word);
+}
+
+/**
+ * @brief Widen the exams and group them by stage, in stage order
+ */
+std::vector<StageExams> group_by_stage(const MPIPackedExams& exams) {
+  std::map<i32, std::vector<size_t>> members;
+  std::vector<size_t> offsets(exams.size());
+  size_t offset = 0;
+  for (size_t i = 0; i < exams.size(); i++) {
+    const auto& header = exams.headers[i];
+    offsets[i] = offset;
+    offset += AnswerPacking::words(header.answers_size, header.answer_bits);
+    members[header.stage].push_back(i);
+  }
+  auto snapshot = AnswersManager::instance().snapshot();
+  std::vector<StageExams> stages;
+  std::vector<u64> wide;
+  for (const auto& [stage, indexes] : members) {
+    StageExams group;
+    group.stage = stage;
+    for (auto i : indexes) {
+      group.stride = std::max(
+          group.stride,
+          AnswerPacking::words(exams.headers[i].answers_size, BITS));
+    }
+    const auto& key = snapshot->key(stage).wide;
+    for (auto i : indexes) {
+      const auto& header = exams.headers[i];
+      auto words = exams.answers.subspan(
+          offsets[i],
+          AnswerPacking::words(header.answers_size, header.answer_bits));
+      if (header.answer_bits == AnswerPacking::NARROW_BITS) {
+        AnswerPacking::widen(words, header.answers_size, wide);
+      } else {
+        wide.assign(words.begin(), words.end());
+      }
+      wide.resize(group.stride, 0);
+      group.ids.push_back(header.id_exam);
+      for (size_t w = 0; w < group.stride; w++) {
+        auto key_word = w < key.size() ? key[w] : 0;
+        auto answered = lanes(wide[w]);
+        group.answers.push_back(wide[w]);
+        group.answered.push_back(answered);
+        group.wrong.push_back(answered & lanes(key_word) &
+                              lanes(wide[w] ^ key_word));
+      }
+    }
+    stages.push_back(std::move(group));
+  }
+  return stages;
+}
+
+/**
+ * @brief Most similar pairs seen, the least similar of them on top
+ */
+class TopPairs {
+ public:
+  explicit TopPairs(size_t top_k) : _top_k(top_k) {}
+
+  void offer(const MPISimilarPair& pair) {
+    if (_pairs.size() < _top_k) {
+      _pairs.push_back(pair);
+      std::ranges::push_heap(_pairs, SimilarityScan::more_similar);
+    } else if (_top_k > 0 &&
+               SimilarityScan::more_similar(pair, _pairs.front())) {
+      std::ranges::pop_heap(_pairs, SimilarityScan::more_similar);
+      _pairs.back() = pair;
+      std::ranges::push_heap(_pairs, SimilarityScan::more_similar);
+    }
+  }
+
+  std::vector<MPISimilarPair> take() {
+    std::ranges::sort_heap(_pairs, SimilarityScan::more_similar);
+    return std::move(_pairs);
+  }
+
+ private:
+  size_t _top_k;
+  std::vector<MPISimilarPair> _pairs;
+};
+
+void compare_tiles(const StageExams& group, size_t tile_a, size_t tile_b,
+                   TopPairs& top) {
+  constexpr auto tile = SimilarityScan::TILE_EXAMS;
+  auto size = group.ids.size();
+  auto stride = group.stride;
+  auto a_end = std::min(size, (tile_a + 1) * tile);
+  auto b_end = std::min(size, (tile_b + 1) * tile);
+  for (auto a = tile_a * tile; a < a_end; a++) {
+    const auto* answers_a = group.answers.data() + a * stride;
+    const auto* wrong_a = group.wrong.data() + a * stride;
+    const auto* answered_a = group.answered.data() + a * stride;
+    auto b_first = tile_a == tile_b ? a + 1 : tile_b * tile;
+    for (auto b = b_first; b < b_end; b++) {
+      const auto* answers_b = group.answers.data() + b * stride;
+      i32 matching_wrong = 0;
+      i32 matching_answers = 0;
+      for (size_t w = 0; w < stride; w++) {
+        // Lanes with the same choice; wrong_a and answered_a drop blanks
+        auto equal = ~lanes(answers_a[w] ^ answers_b[w]);
+        matching_wrong += std::popcount(equal & wrong_a[w]);
+        matching_answers += std::popcount(equal & answered_a[w]);
+      }
+      if (matching_wrong == 0 || group.ids[a] == group.ids[b]) {
+        continue;
+      }
+      auto [first, second] = std::minmax(group.ids[a], group.ids[b]);
+      top.offer(
+          {group.stage, first, second, matching_wrong, matching_answers});
+    }
+  }
+}
+
+size_t tiles(size_t exams) {
+  constexpr auto tile = SimilarityScan::TILE_EXAMS;
+  return (exams + tile - 1) / tile;
+}
+
+}  // namespace
+
+size_t SimilarityScan::tile_pairs(const std::vector<MPIExam>& exams) {
+  std::map<i32, size_t> stage_sizes;
+  for (const auto& exam : exams) {
+    stage_sizes[exam.stage]++;
+  }
+  size_t pairs = 0;
+  for (const auto& [stage, size] : stage_sizes) {
+    auto count = tiles(size);
+    pairs += count * (count + 1) / 2;
+  }
+  return pairs;
+}
+
+std::vector<MPISimilarPair> SimilarityScan::scan(const MPIPackedExams& exams,
+                                                 i32 part, i32 parts,
+                                                 size_t top_k) {
+  TopPairs top(top_k);
+  if (parts <= 0) {
+    return top.take();
+  }
+  size_t number = 0;
+  for (const auto& group : group_by_stage(exams)) {
+    auto count = tiles(group.ids.size());
+    for (size_t tile_a = 0; tile_a < count; tile_a++) {
+      for (size_t tile_b = tile_a; tile_b < count; tile_b++, number++) {
+        if (number % static_cast<size_t>(parts) ==
+            static_cast<size_t>(part)) {
+          compare_tiles(group, tile_a, tile_b, top);
+        }
+      }
+    }
+  }
+  return top.take();
+}
+
+void SimilarityScan::top(std::vector<MPISimilarPair>& pairs, size_t top_k) {
+  auto keep = std::min(top_k, pairs.size());
+  std::ranges::partial_sort(pairs, pairs.begin() + keep, more_similar);
+  pairs.resize(keep);
+}
+
+bool SimilarityScan::more_similar(const MPISimilarPair& lhs,
+                                  const MPISimilarPair& rhs) {
+  return std::tie(rhs.matching_wrong, rhs.matching_answers, lhs.stage,
+                  lhs.id_exam_a, lhs.id_exam_b) <
+         std::tie(lhs.matching_wrong, lhs.matching_answers, rhs.stage,
+                  rhs.id_exam_a, rhs.id_exam_b);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef SIMILARITY_HPP
+#define SIMILARITY_HPP
+
+#include <domain/coordinator.hpp>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief All-pairs comparison of the exams of each stage, to flag sheets
+ *        that share too many wrong answers
+ * @details The exams of a stage are split in tiles of TILE_EXAMS and compared
+ *          a tile pair at a time, so both tiles stay in cache while every
+ *          exam of one meets every exam of the other. The tile pairs of every
+ *          stage are numbered in stage order; a worker takes those whose
+ *          number modulo `parts` is its `part`.
+ *          Answers are widened to WIDE_BITS and compared eight questions at a
+ *          time with XOR and popcount, like the scoring; the lanes an exam
+ *          got wrong are found once per exam, against the key of its stage.
+ *          Pairs rank by matching_wrong, then matching_answers, then stage
+ *          and ids, so merging the top-K of every worker gives the same
+ *          pairs however the tiles were split.
+ */
+class SimilarityScan {
+ public:
+  SimilarityScan() = delete;
+  ~SimilarityScan() = delete;
+
+  static constexpr size_t TILE_EXAMS = 128;
+
+  /**
+   * @brief Tile pairs to compare for the exams
+   */
+  static size_t tile_pairs(const std::vector<MPIExam>& exams);
+
+  /**
+   * @brief Compare the tile pairs of a part
+   * @return The `top_k` most similar pairs sharing a wrong answer, most
+   *         similar first
+   */
+  static std::vector<MPISimilarPair> scan(const MPIPackedExams& exams,
+                                          i32 part, i32 parts, size_t top_k);
+
+  /**
+   * @brief Keep the `top_k` most similar pairs, most similar first
+   */
+  static void top(std::vector<MPISimilarPair>& pairs, size_t top_k);
+
+  static bool more_similar(const MPISimilarPair& lhs,
+                           const MPISimilarPair& rhs);
+};
+
+#endif  // SIMILARITY_HPP
@@ -0,0 +1,107 @@
+#include "sink.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <domain/evaluator.hpp>
+#include <domain/packing.hpp>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+
+std::unique_ptr<ResultSink> ResultSink::_instance = nullptr;
+
+ResultSink& ResultSink::instance() {
+  static std::once_flag flag;
+  std::call_once(flag, []() { _instance.reset(new ResultSink()); });
+  return *_instance;
+}
+
+std::string ResultSink::file_path(const SinkTarget& target, i32 rank) {
+  return target.directory + "/" + target.job + ".rank" + std::to_string(rank) +
+         SINK_EXTENSION;
+}
+
+std::string ResultSink::directory(const std::string& root,
+                                  const std::string& path) {
+  if (root.empty()) {
+    throw std::runtime_error("Result sinks are disabled, set SH_SINK_ROOT");
+  }
+  auto relative = std::filesystem::path(path).lexically_normal();
+  if (path.find('\0') != std::string::npos || relative.has_root_path()) {
+    throw std::runtime_error("Invalid sink path");
+  }
+  for (const auto& part : relative) {
+    if (part == "..") {
+      throw std::runtime_error("Invalid sink path");
+    }
+  }
+  return (std::filesystem::path(root) / relative).lexically_normal().string();
+}
+
+MPISinkSummary ResultSink::append(const SinkTarget& target, i32 rank,
+                                  const MPIPackedExams& exams) {
+  auto path = file_path(target, rank);
+  if (!_writer || _writer->path() != path) {
+    _writer.reset();  // flushes and closes the previous job
+    std::filesystem::create_directories(target.directory);
+    _writer = std::make_unique<AsyncFileWriter>(path);
+  }
+  MPISinkSummary summary{};
+  auto start_bytes = _writer->bytes_accepted();
+  auto& evaluator = Evaluator::instance();
+  // Evaluate chunk i + 1 while the I/O thread writes chunk i
+  size_t word = 0;
+  for (size_t begin = 0; begin < exams.size(); begin += _chunk_rows) {
+    auto end = std::min(begin + _chunk_rows, exams.size());
+    MPIPackedExams chunk{exams.headers.subspan(begin, end - begin), {}};
+    size_t words = 0;
+    for (const auto& exam : chunk.headers) {
+      words += AnswerPacking::words(exam.answers_size, exam.answer_bits);
+    }
+    chunk.answers = exams.answers.subspan(word, words);
+    word += words;
+    auto results = evaluator.evaluate_exam_batch(chunk);
+    for (const auto& result : results) {
+      summary.correct_answers += result.correct_answers;
+      summary.wrong_answers += result.wrong_answers;
+      summary.unscored_answers += result.unscored_answers;
+      summary.score_sum += result.score;
+    }
+    summary.rows += static_cast<i64>(results.size());
+    _encode_chunk(results);
+    _writer->write(_chunk);
+  }
+  _writer->flush();
+  summary.bytes = static_cast<i64>(_writer->bytes_accepted() - start_bytes);
+  return summary;
+}
+
+void ResultSink::close() {
+  _writer.reset();
+}
+
+void ResultSink::_encode_chunk(const std::vector<MPIResult>& results) {
+  auto rows = results.size();
+  auto padded = [](size_t bytes) { return (bytes + 7) & ~size_t{7}; };
+  auto i32_column = padded(rows * sizeof(i32));
+  auto f64_column = padded(rows * sizeof(f64));
+  _chunk.assign(sizeof(ColumnChunkHeader) + 5 * i32_column + f64_column, '\0');
+  ColumnChunkHeader header;
+  header.rows = static_cast<u32>(rows);
+  std::memcpy(_chunk.data(), &header, sizeof(header));
+  auto* base = _chunk.data() + sizeof(header);
+  auto* stage = reinterpret_cast<i32*>(base);
+  auto* id_exam = reinterpret_cast<i32*>(base + i32_column);
+  auto* correct = reinterpret_cast<i32*>(base + 2 * i32_column);
+  auto* wrong = reinterpret_cast<i32*>(base + 3 * i32_column);
+  auto* unscored = reinterpret_cast<i32*>(base + 4 * i32_column);
+  auto* score = reinterpret_cast<f64*>(base + 5 * i32_column);
+  for (size_t i = 0; i < rows; i++) {
+    stage[i] = results[i].stage;
+    id_exam[i] = results[i].id_exam;
+    correct[i] = results[i].correct_answers;
+    wrong[i] = results[i].wrong_answers;
+    unscored[i] = results[i].unscored_answers;
+    score[i] = results[i].score;
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef SINK_HPP
+#define SINK_HPP
+
+#include <domain/coordinator.hpp>
+#include <memory>
+#include <string>
+#include <system/aliases.hpp>
+#include <system/async_writer.hpp>
+#include <vector>
+
+/**
+ * @brief Columnar result file (".shcol") written by every worker
+ * @details A file is a sequence of chunks. Each chunk starts with a
+ *          `ColumnChunkHeader` followed by one fixed-width column per
+ *          `MPIResult` field, in declaration order:
+ *          stage (i32), id_exam (i32), correct_answers (i32),
+ *          wrong_answers (i32), unscored_answers (i32), score (f64).
+ *          Every column is padded to a multiple of 8 bytes so the f64 column
+ *          stays aligned. Values are stored in the host byte order.
+ */
+struct ColumnChunkHeader {
+  u32 magic = 0x4B434853; /** "SHCK" */
+  u32 rows = 0;           /** Rows in this chunk */
+};
+
+static constexpr const char* SINK_FORMAT = "shcol/1";
+static constexpr const char* SINK_EXTENSION = ".shcol";
+
+struct SinkTarget {
+  std::string directory; /** Output directory shared by all the workers */
+  std::string job;       /** Job name, used as the file prefix */
+};
+
+/**
+ * @brief Writes the results of a worker to its columnar file
+ */
+class ResultSink {
+ public:
+  static ResultSink& instance();
+  ~ResultSink() = default;
+  static std::string file_path(const SinkTarget& target, i32 rank);
+  /**
+   * @brief Directory of a sink under `root`
+   * @param path Directory asked by the client, relative to `root`
+   * @throw std::runtime_error If `root` is empty, or `path` is absolute or
+   *        leaves `root`
+   */
+  static std::string directory(const std::string& root,
+                               const std::string& path);
+  MPISinkSummary append(const SinkTarget& target, i32 rank,
+                        const MPIPackedExams& exams);
+  void close();
+
+ private:
+  ResultSink() = default;
+  static std::unique_ptr<ResultSink> _instance;
+  std::unique_ptr<AsyncFileWriter> _writer;
+  size_t _chunk_rows = 64 * 1024;
+  std::string _chunk;
+
+  void _encode_chunk(const std::vector<MPIResult>& results);
+};
+
+#endif  // SINK_HPP
@@ -1,39 +1,235 @@
 #include <mpi.h>
+#include <domain/channel.hpp>
 #include <domain/coordinator.hpp>
 #include <domain/evaluator.hpp>
+#include <domain/ingress.hpp>
+#include <domain/queue.hpp>
+#include <domain/resident.hpp>
+#include <domain/shared.hpp>
+#include <domain/similarity.hpp>
+#include <domain/sink.hpp>
+#include <filesystem>
 #include <iostream>
 #include <server/server.hpp>
 #include <system/aliases.hpp>
+#include <system/environment.hpp>
 #include <system/logger.hpp>
+#include <system/placement.hpp>
+#include <system/tracer.hpp>
+#include <system_error>
+
+namespace {
+
+/**
+ * @brief Server settings, overridden by the SH_* environment variables
+ */
+ServerConfig server_config(const IngressGroup& ingress) {
+  ServerConfig config;
+  config.port = Environment::get_or<u16>("SH_PORT", config.port);
+  config.http_port = Environment::get_or<u16>("SH_HTTP_PORT", 0);
+  config.http_allow_origin =
+      Environment::get("SH_HTTP_ORIGIN").value_or(config.http_allow_origin);
+  config.backlog = Environment::get_or<u16>("SH_BACKLOG", config.backlog);
+  config.max_message_size =
+      Environment::get_or<u32>("SH_MAX_MESSAGE_SIZE", config.max_message_size);
+  config.keep_alive =
+      Environment::get_or<bool>("SH_KEEP_ALIVE", config.keep_alive);
+  config.compression_min_bytes = Environment::get_or<u32>(
+      "SH_COMPRESSION_MIN_BYTES", config.compression_min_bytes);
+  config.compression_level = Environment::get_or<i32>(
+      "SH_COMPRESSION_LEVEL", config.compression_level);
+  auto& admission = config.admission;
+  admission.max_inflight_exams = Environment::get_or<u32>(
+      "SH_MAX_INFLIGHT_EXAMS", admission.max_inflight_exams);
+  admission.max_inflight_bytes = Environment::get_or<u64>(
+      "SH_MAX_INFLIGHT_BYTES", admission.max_inflight_bytes);
+  auto& coalescing = config.coalescing;
+  coalescing.enabled =
+      Environment::get_or<bool>("SH_COALESCE", coalescing.enabled);
+  coalescing.max_window_us = Environment::get_or<u32>(
+      "SH_COALESCE_WINDOW_US", coalescing.max_window_us);
+  coalescing.max_batch_exams = Environment::get_or<u32>(
+      "SH_COALESCE_MAX_EXAMS", coalescing.max_batch_exams);
+  auto& scaling = config.scaling;
+  scaling.max_spawned = Environment::get_or<u32>("SH_ELASTIC_MAX_WORKERS",
+                                                 scaling.max_spawned);
+  scaling.backlog_exams = Environment::get_or<u32>(
+      "SH_ELASTIC_BACKLOG_EXAMS", scaling.backlog_exams);
+  scaling.slo_ms =
+      Environment::get_or<u32>("SH_ELASTIC_SLO_MS", scaling.slo_ms);
+  scaling.idle_ms =
+      Environment::get_or<u32>("SH_ELASTIC_IDLE_MS", scaling.idle_ms);
+  scaling.cooldown_ms =
+      Environment::get_or<u32>("SH_ELASTIC_COOLDOWN_MS", scaling.cooldown_ms);
+  // Every ingress rank listens on its own port unless SH_REUSEPORT=1
+  config.reuse_port = Environment::get_or<bool>("SH_REUSEPORT", false);
+  if (!config.reuse_port) {
+    config.port += ingress.index();
+    if (config.http_port != 0) {
+      config.http_port += ingress.index();
+    }
+  }
+  config.drain_grace_ms =
+      Environment::get_or<u32>("SH_DRAIN_GRACE_MS", config.drain_grace_ms);
+  config.sink_root = Environment::get("SH_SINK_ROOT").value_or("");
+  auto capture = Environment::get("SH_CAPTURE");
+  if (capture) {
+    config.capture_path = *capture;
+    if (ingress.count() > 1) {
+      config.capture_path += "." + std::to_string(ingress.index());
+    }
+  }
+  auto handoff = Environment::get("SH_HANDOFF_SOCKET");
+  if (handoff) {
+    config.handoff_path = *handoff;
+    if (ingress.count() > 1) {
+      config.handoff_path += "." + std::to_string(ingress.index());
+    }
+  }
+  return config;
+}
+
+/**
+ * @brief Evaluate the batches of the master until it sends SHUTDOWN
+ */
+void run_worker(i32 rank) {
+  spdlog::info("Worker {} started", rank);
+  auto& coordinator = MPICoordinator::instance();
+  WorkerChannel channel(0);  // the ingress rank of the group
+  bool shutdown = false;
+  while (!shutdown) {
+    const auto& work = channel.next();
+    if (work.command == MPICommand::SHUTDOWN) {
+      shutdown = true;
+      ResultSink::instance().close();
+      coordinator.free_types();
+      spdlog::info("Worker {} received shutdown signal", rank);
+      break;
+    }
+    SH_LOG_EVERY_MS(spdlog::level::info, 1000,
+                    "Worker {} received exams count: {}", rank,
+                    work.exams.size());
+    if (work.command == MPICommand::RESCORE) {
+      std::vector<MPIResult> results;
+      {
+        TraceScope span("evaluate");
+        auto& resident = ResidentExams::instance();
+        resident.drop(work.exams.headers);
+        results = resident.rescore();
+      }
+      coordinator.send_to_master(results, 0);
+      continue;
+    }
+    if (work.command == MPICommand::SIMILARITY) {
+      std::vector<MPISimilarPair> pairs;
+      {
+        TraceScope span("evaluate");
+        pairs = SimilarityScan::scan(work.exams, work.part, work.parts,
+                                     work.top_k);
+      }
+      coordinator.send_to_master(pairs, 0);
+      continue;
+    }
+    if (work.queue_chunk > 0) {
+      MPISinkSummary summary{};
+      try {
+        TraceScope span("evaluate");
+        summary = RMAWorkQueue::instance().drain(work, rank);
+      } catch (const std::exception& e) {
+        spdlog::error("Worker {} failed to drain the work queue: {}", rank,
+                      e.what());
+        summary.rows = -1;
+      }
+      coordinator.send_to_master(summary, 0);
+      continue;
+    }
+    if (work.command == MPICommand::REVIEW_SINK) {
+      SinkTarget target{work.sink_directory, work.sink_job};
+      MPISinkSummary summary{};
+      try {
+        TraceScope span("evaluate");
+        summary = ResultSink::instance().append(target, rank, work.exams);
+      } catch (const std::exception& e) {
+        spdlog::error("Worker {} failed to write results: {}", rank,
+                      e.what());
+        summary.rows = -1;  // reported to the client as a failed file
+      }
+      coordinator.send_to_master(summary, 0);
+      continue;
+    }
+    std::vector<MPIResult> results;
+    {
+      TraceScope span("evaluate");
+      results = Evaluator::instance().evaluate_exam_batch(work.exams);
+      if (work.command == MPICommand::REVIEW_RESIDENT) {
+        ResidentExams::instance().keep(work.exams, results);
+      }
+    }
+    coordinator.send_to_master(results, 0);
+  }
+}
+
+/**
+ * @brief Path of this executable, which spawned workers run
+ */
+std::string executable_path(const char* argv0) {
+  std::error_code error;
+  auto path = std::filesystem::read_symlink("/proc/self/exe", error);
+  return error ? std::string(argv0) : path.string();
+}
+
+}  // namespace
 
 i32 main(i32 argc, char** argv) {
   MPI_Init(&argc, &argv);
   i32 rank, size;
+  MPI_Comm parent;
+  MPI_Comm_get_parent(&parent);
+  if (parent != MPI_COMM_NULL) {
+    // Spawned by an ingress rank, which is rank 0 of the merged communicator
+    // and sends the rank to log as
+    MPI_Comm comm;
+    MPI_Intercomm_merge(parent, 1, &comm);
+    MPI_Bcast(&rank, 1, MPI_INT, 0, comm);
+    Logger::config(rank);
+    Tracer::instance().init(rank);
+    MPICoordinator::instance().set_communicator(comm);
+    run_worker(rank);
+    MPI_Comm_free(&comm);
+    MPI_Comm_disconnect(&parent);
+    Tracer::instance().shutdown();
+    Logger::shutdown();
+    MPI_Finalize();
+    return 0;
+  }
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   Logger::config(rank);
-  if (rank == 0) {
-    ServerConfig config;
-    Server server(config);
+  Tracer::instance().init(rank);
+  auto& ingress = IngressGroup::instance();
+  ingress.init();
+  // Before the windows and buffers are allocated, so they are first touched
+  // on the node of the rank
+  Placement::apply(ingress.is_ingress());
+  MPICoordinator::instance().set_communicator(ingress.comm());
+  NodeSharedRegion::instance().init(ingress.comm());
+  RMAWorkQueue::instance().init(ingress.comm());
+  if (ingress.is_ingress()) {
+    MPICoordinator::instance().set_resident(
+        Environment::get_or<bool>("SH_RESIDENT", false));
+    MPICoordinator::instance().set_spawn_command(
+        executable_path(argv[0]), size + ingress.index(), ingress.count());
+    Server server(server_config(ingress));
     server.start();
     MPICoordinator::instance().free_types();
   } else {
-    spdlog::info("Worker {} started", rank);
-    bool shutdown = false;
-    while (!shutdown) {
-      auto& coordinator = MPICoordinator::instance();
-      auto [exams, command] = coordinator.receive_from_master(0);
-      if (command == MPICommand::SHUTDOWN) {
-        shutdown = true;
-        coordinator.free_types();
-        spdlog::info("Worker {} received shutdown signal", rank);
-        break;
-      }
-      spdlog::info("Worker {} received exams count: {}", rank, exams.size());
-      auto results = Evaluator::instance().evaluate_exam_batch(exams);
-      coordinator.send_to_master(results, 0);
-    }
+    run_worker(rank);
   }
+  RMAWorkQueue::instance().free();
+  NodeSharedRegion::instance().free();
+  ingress.free();
+  Tracer::instance().shutdown();
+  Logger::shutdown();
   MPI_Finalize();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "admission.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+AdmissionController::AdmissionController(const AdmissionConfig& config)
+    : _config(config) {}
+
+AdmissionTicket AdmissionController::classify(
+    i32 connection, const ScoreHiveRequest& request) const {
+  AdmissionTicket ticket{connection, PriorityClass::INTERACTIVE, 0,
+                         request.data.size()};
+  if (request.command != ScoreHiveCommand::REVIEW &&
+      request.command != ScoreHiveCommand::SIMILARITY) {
+    return ticket;
+  }
+  // Exams carry an id_exam and letter sheets a student_id
+  static constexpr std::array<std::string_view, 2> keys = {"\"id_exam\"",
+                                                          "\"student_id\""};
+  std::string_view body = request.data;
+  for (auto key : keys) {
+    for (auto pos = body.find(key); pos != std::string_view::npos;
+         pos = body.find(key, pos + key.size())) {
+      ticket.exams++;
+    }
+  }
+  // A comparison costs the square of its exams, it never jumps the queue
+  if (ticket.exams > _config.interactive_max_exams ||
+      request.command == ScoreHiveCommand::SIMILARITY) {
+    ticket.priority = PriorityClass::BULK;
+  }
+  return ticket;
+}
+
+std::optional<u32> AdmissionController::admit(PendingRequest&& pending) {
+  const auto& ticket = pending.ticket;
+  auto queued = _queues.find(ticket.connection);
+  if (queued != _queues.end() &&
+      queued->second.size() >= _config.max_queued_per_connection) {
+    return _retry_after();
+  }
+  u64 exam_cap = _config.max_inflight_exams;
+  u64 byte_cap = _config.max_inflight_bytes;
+  if (ticket.priority == PriorityClass::BULK) {
+    exam_cap = exam_cap * _config.bulk_share_percent / 100;
+    byte_cap = byte_cap * _config.bulk_share_percent / 100;
+  }
+  bool idle = _inflight_exams == 0 && _inflight_bytes == 0;
+  bool fits = _inflight_exams + ticket.exams <= exam_cap &&
+              _inflight_bytes + ticket.bytes <= byte_cap;
+  if (!idle && !fits) {
+    return _retry_after();
+  }
+  _inflight_exams += ticket.exams;
+  _inflight_bytes += ticket.bytes;
+  auto& queue = _queues[ticket.connection];
+  if (queue.empty()) {
+    _ring.push_back(ticket.connection);
+  }
+  queue.push_back(std::move(pending));
+  _queued++;
+  return std::nullopt;
+}
+
+std::optional<PendingRequest> AdmissionController::next() {
+  if (_queued == 0) {
+    return std::nullopt;
+  }
+  return _pop(_pick());
+}
+
+const PendingRequest* AdmissionController::peek() const {
+  if (_queued == 0) {
+    return nullptr;
+  }
+  return &_queues.at(*_pick()).front();
+}
+
+QueuedSummary AdmissionController::summarize(
+    const std::function<bool(const PendingRequest&)>& match) const {
+  QueuedSummary summary;
+  for (const auto& [connection, queue] : _queues) {
+    for (const auto& pending : queue) {
+      if (!match(pending)) {
+        break;  // only the front of the queue can be taken
+      }
+      if (summary.requests == 0 || pending.admitted_at < summary.oldest) {
+        summary.oldest = pending.admitted_at;
+      }
+      summary.requests++;
+      summary.exams += pending.ticket.exams;
+    }
+  }
+  return summary;
+}
+
+std::vector<PendingRequest> AdmissionController::take(
+    const std::function<bool(const PendingRequest&)>& match, u32 max_exams) {
+  std::vector<PendingRequest> taken;
+  u32 exams = 0;
+  while (_queued > 0) {
+    auto pick = std::find_if(_ring.begin(), _ring.end(), [&](i32 connection) {
+      return match(_queues.at(connection).front());
+    });
+    if (pick == _ring.end()) {
+      break;
+    }
+    auto request_exams = _queues.at(*pick).front().ticket.exams;
+    if (!taken.empty() && exams + request_exams > max_exams) {
+      break;
+    }
+    exams += request_exams;
+    taken.push_back(_pop(pick));
+  }
+  return taken;
+}
+
+std::deque<i32>::const_iterator AdmissionController::_pick() const {
+  auto pick = std::find_if(_ring.begin(), _ring.end(), [this](i32 connection) {
+    return _queues.at(connection).front().ticket.priority ==
+           PriorityClass::INTERACTIVE;
+  });
+  return pick == _ring.end() ? _ring.begin() : pick;
+}
+
+PendingRequest AdmissionController::_pop(
+    std::deque<i32>::const_iterator pick) {
+  auto connection = *pick;
+  _ring.erase(pick);
+  auto& queue = _queues.at(connection);
+  auto pending = std::move(queue.front());
+  queue.pop_front();
+  _queued--;
+  if (queue.empty()) {
+    _queues.erase(connection);
+  } else {
+    _ring.push_back(connection);  // served last in the next round
+  }
+  return pending;
+}
+
+void AdmissionController::complete(const AdmissionTicket& ticket,
+                                   u64 elapsed_us) {
+  _release(ticket);
+  if (ticket.exams > 0) {
+    auto sample = static_cast<double>(elapsed_us) / ticket.exams;
+    _us_per_exam =
+        _us_per_exam == 0 ? sample : 0.8 * _us_per_exam + 0.2 * sample;
+  }
+}
+
+void AdmissionController::drop_connection(i32 connection) {
+  auto it = _queues.find(connection);
+  if (it == _queues.end()) {
+    return;
+  }
+  for (const auto& pending : it->second) {
+    _release(pending.ticket);
+    _queued--;
+  }
+  _queues.erase(it);
+  std::erase(_ring, connection);
+}
+
+void AdmissionController::_release(const AdmissionTicket& ticket) {
+  _inflight_exams -= std::min(_inflight_exams, ticket.exams);
+  _inflight_bytes -= std::min(_inflight_bytes, ticket.bytes);
+}
+
+u32 AdmissionController::_retry_after() const {
+  // Time needed to drain the admitted work at the observed service rate
+  auto drain_ms = static_cast<u32>(_inflight_exams * _us_per_exam / 1000);
+  return std::max(_config.retry_after_ms, drain_ms);
+}
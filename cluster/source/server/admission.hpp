@@ -0,0 +1,159 @@
+#pragma once
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <optional>
+#include <server/protocol.hpp>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Admission control limits
+ */
+struct AdmissionConfig {
+  u32 max_inflight_exams = 200000;    /** Admitted exams not yet answered */
+  u64 max_inflight_bytes = 256 << 20; /** Admitted bytes not yet answered */
+  u32 bulk_share_percent = 75;        /** Budget share usable by bulk requests */
+  u32 interactive_max_exams = 16;     /** Larger REVIEWs are bulk requests */
+  u32 max_queued_per_connection = 8;  /** Pending requests per connection */
+  u32 retry_after_ms = 50;            /** Minimum retry hint for busy replies */
+};
+
+/**
+ * @brief Priority classes. Interactive requests are always served first.
+ */
+enum class PriorityClass : u8 {
+  INTERACTIVE = 0, /** Small reviews and control commands */
+  BULK = 1,        /** Large review batches and comparisons */
+};
+
+/**
+ * @brief Budget taken by an admitted request until it is answered
+ */
+struct AdmissionTicket {
+  i32 connection;         /** Connection that sent the request */
+  PriorityClass priority; /** Priority class of the request */
+  u32 exams;              /** Estimated number of exams */
+  u64 bytes;              /** Size of the request body */
+  u64 slot = 0;           /** Response slot of the request */
+};
+
+/**
+ * @brief Admitted request waiting to be dispatched
+ */
+struct PendingRequest {
+  ScoreHiveRequest request; /** Parsed request */
+  AdmissionTicket ticket;   /** Budget held by the request */
+  std::chrono::steady_clock::time_point admitted_at; /** Admission time */
+};
+
+/**
+ * @brief Summary of the queued requests that match a predicate
+ */
+struct QueuedSummary {
+  u32 requests = 0; /** Matching requests */
+  u32 exams = 0;    /** Estimated exams of the matching requests */
+  std::chrono::steady_clock::time_point oldest{}; /** Oldest admission */
+};
+
+/**
+ * @brief Admission controller and request scheduler of the front end
+ * @details Requests are admitted while the in-flight exams and bytes stay
+ *          under the configured caps; bulk requests can only use
+ *          `bulk_share_percent` of them so interactive traffic always has
+ *          headroom. A request larger than the whole budget is still
+ *          admitted when nothing else is in flight.
+ *          Admitted requests wait in a FIFO per connection, so the responses
+ *          of a connection keep the order of its requests. Connections are
+ *          served round-robin, first those whose next request is interactive
+ *          and then the bulk ones.
+ */
+class AdmissionController {
+ public:
+  explicit AdmissionController(const AdmissionConfig& config = {});
+
+  /**
+   * @brief Build the ticket of a request
+   * @details The exams of a REVIEW or SIMILARITY are estimated by counting
+   *          the "id_exam" keys of the body, or "student_id" for letter
+   *          sheets, without parsing it.
+   */
+  AdmissionTicket classify(i32 connection,
+                           const ScoreHiveRequest& request) const;
+
+  /**
+   * @brief Try to admit a request
+   * @return std::nullopt if the request was queued, otherwise the number of
+   *         milliseconds the client should wait before retrying.
+   */
+  std::optional<u32> admit(PendingRequest&& pending);
+
+  /**
+   * @brief Pop the next request to dispatch
+   */
+  std::optional<PendingRequest> next();
+
+  /**
+   * @brief Request that `next` would return, without popping it
+   */
+  const PendingRequest* peek() const;
+
+  /**
+   * @brief Summarize the requests at the front of every connection queue
+   *        that match the predicate
+   */
+  QueuedSummary summarize(
+      const std::function<bool(const PendingRequest&)>& match) const;
+
+  /**
+   * @brief Pop matching requests in round-robin order
+   * @details Takes the matching requests found at the front of the
+   *          connection queues while their exams fit in `max_exams` (the
+   *          first one is always taken).
+   */
+  std::vector<PendingRequest> take(
+      const std::function<bool(const PendingRequest&)>& match, u32 max_exams);
+
+  /**
+   * @brief Release the budget of a request once it has been answered
+   * @param ticket Ticket of the request
+   * @param elapsed_us Time spent serving the request
+   */
+  void complete(const AdmissionTicket& ticket, u64 elapsed_us);
+
+  /**
+   * @brief Drop the queued requests of a closed connection
+   */
+  void drop_connection(i32 connection);
+
+  /**
+   * @brief Replace the limits. Admitted requests keep their budget.
+   */
+  void reconfigure(const AdmissionConfig& config) { _config = config; }
+
+  const AdmissionConfig& config() const { return _config; }
+  bool has_pending() const { return _queued > 0; }
+  u32 inflight_exams() const { return _inflight_exams; }
+  u64 inflight_bytes() const { return _inflight_bytes; }
+
+ private:
+  void _release(const AdmissionTicket& ticket);
+  std::deque<i32>::const_iterator _pick() const;
+  PendingRequest _pop(std::deque<i32>::const_iterator pick);
+  u32 _retry_after() const;
+
+  AdmissionConfig _config;
+  std::map<i32, std::deque<PendingRequest>> _queues;
+  std::deque<i32> _ring;   /** Round-robin order of the connections */
+  size_t _queued = 0;
+  u32 _inflight_exams = 0;
+  u64 _inflight_bytes = 0;
+  double _us_per_exam = 0; /** Moving average of the service time per exam */
+};
+
+#endif  // ADMISSION_HPP
@@ -0,0 +1,117 @@
+#include "capture.hpp"
+#include <spdlog/spdlog.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+static constexpr size_t RECORD_HEADER_SIZE =
+    sizeof(u64) + sizeof(u32) + sizeof(u64) + sizeof(u32) + sizeof(u8);
+
+/**
+ * @brief Empty the file, since the writer appends to it
+ */
+const std::string& truncated(const std::string& path) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  return path;
+}
+
+template <typename T>
+void put(std::string& output, T value) {
+  output.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T take(std::string_view& input) {
+  T value;
+  std::memcpy(&value, input.data(), sizeof(T));
+  input.remove_prefix(sizeof(T));
+  return value;
+}
+
+}  // namespace
+
+FrameCapture::FrameCapture(const std::string& path)
+    : _writer(truncated(path)), _start(std::chrono::steady_clock::now()) {
+  auto started = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+  _staging.assign(MAGIC);
+  put(_staging, static_cast<u64>(started));
+  _writer.write(_staging);
+}
+
+void FrameCapture::request(u32 connection, u64 sequence,
+                           std::string_view frame) {
+  _record(CaptureKind::REQUEST, connection, sequence, frame);
+}
+
+void FrameCapture::response(u32 connection, u64 sequence,
+                            ScoreHiveResponseCode code) {
+  auto byte = static_cast<char>(code);
+  _record(CaptureKind::RESPONSE, connection, sequence,
+          std::string_view(&byte, 1));
+}
+
+void FrameCapture::_record(CaptureKind kind, u32 connection, u64 sequence,
+                           std::string_view data) {
+  if (_failed) {
+    return;
+  }
+  auto offset = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - _start)
+                    .count();
+  _staging.clear();
+  put(_staging, static_cast<u64>(offset));
+  put(_staging, connection);
+  put(_staging, sequence);
+  put(_staging, static_cast<u32>(data.size()));
+  put(_staging, static_cast<u8>(kind));
+  try {
+    _writer.write(_staging);
+    _writer.write(data);
+  } catch (const std::exception& e) {
+    spdlog::error("Frame capture stopped: {}", e.what());
+    _failed = true;
+  }
+}
+
+std::vector<CaptureRecord> FrameCapture::read(const std::string& path,
+                                              u64* started_ns) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  std::string contents((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+  std::string_view input(contents);
+  if (!input.starts_with(MAGIC) || input.size() < MAGIC.size() + sizeof(u64)) {
+    throw std::runtime_error(path + " is not a frame capture");
+  }
+  input.remove_prefix(MAGIC.size());
+  auto started = take<u64>(input);
+  if (started_ns != nullptr) {
+    *started_ns = started;
+  }
+  std::vector<CaptureRecord> records;
+  while (!input.empty()) {
+    if (input.size() < RECORD_HEADER_SIZE) {
+      throw std::runtime_error(path + " is truncated");
+    }
+    CaptureRecord record;
+    record.offset_ns = take<u64>(input);
+    record.connection = take<u32>(input);
+    record.sequence = take<u64>(input);
+    auto length = take<u32>(input);
+    record.kind = static_cast<CaptureKind>(take<u8>(input));
+    if (input.size() < length) {
+      throw std::runtime_error(path + " is truncated");
+    }
+    record.data.assign(input.substr(0, length));
+    input.remove_prefix(length);
+    records.push_back(std::move(record));
+  }
+  return records;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <chrono>
+#include <server/protocol.hpp>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <system/async_writer.hpp>
+#include <vector>
+
+enum class CaptureKind : u8 {
+  REQUEST = 0,  /** Frame received from a client */
+  RESPONSE = 1, /** Response queued for the request of the same sequence */
+};
+
+/**
+ * @brief Record of a capture file
+ */
+struct CaptureRecord {
+  CaptureKind kind;
+  u32 connection; /** Connection of the frame, numbered from 1 */
+  u64 sequence;   /** Request of the connection, numbered from 0 */
+  u64 offset_ns;  /** Time since the capture started */
+  std::string data;
+};
+
+/**
+ * @brief Log of the SH frames received by the server, for ScoreHiveReplay
+ * @details Enabled by SH_CAPTURE=<path>; with several ingress ranks each one
+ *          writes "<path>.<index>".
+ *          The file starts with the magic "SHCAP002" and the start of the
+ *          capture (u64, nanoseconds since the epoch), followed by records of
+ *          u64 offset_ns, u32 connection, u64 sequence, u32 length, u8 kind
+ *          and `length` bytes, in host (little endian) order.
+ *          A REQUEST holds the frame exactly as it arrived, compressed or
+ *          not, and is stamped once it is complete. A RESPONSE holds the
+ *          response code (one byte) and is stamped when the response is
+ *          queued, so the time between both is the latency seen by the
+ *          server. Both carry the response slot of the request as its
+ *          sequence, so a response is matched with its request even when
+ *          responses are queued out of order; the error of a frame that
+ *          could not be parsed has a sequence no request has. HTTP requests
+ *          are not captured.
+ *          The event loop only copies the record into a staging buffer; an
+ *          AsyncFileWriter writes it. If a write fails the capture stops and
+ *          the server goes on.
+ */
+class FrameCapture {
+ public:
+  static constexpr std::string_view MAGIC = "SHCAP002";
+
+  /**
+   * @brief Start a capture, replacing the file if it exists
+   * @throw std::runtime_error If the file cannot be opened
+   */
+  explicit FrameCapture(const std::string& path);
+
+  FrameCapture(const FrameCapture&) = delete;
+  FrameCapture& operator=(const FrameCapture&) = delete;
+
+  /**
+   * @brief Number of a new connection
+   */
+  u32 open_connection() { return ++_connections; }
+
+  void request(u32 connection, u64 sequence, std::string_view frame);
+  void response(u32 connection, u64 sequence, ScoreHiveResponseCode code);
+
+  /**
+   * @brief Records of a capture file, in the order they were written
+   * @throw std::runtime_error If it is not a capture or it is truncated
+   */
+  static std::vector<CaptureRecord> read(const std::string& path,
+                                         u64* started_ns = nullptr);
+
+ private:
+  void _record(CaptureKind kind, u32 connection, u64 sequence,
+               std::string_view data);
+
+  AsyncFileWriter _writer;
+  std::chrono::steady_clock::time_point _start;
+  u32 _connections = 0;
+  bool _failed = false;
+  std::string _staging; /** Bytes of the record being written */
+};
+
+#endif  // CAPTURE_HPP
@@ -0,0 +1,24 @@
+#include "coalescer.hpp"
+#include <algorithm>
+
+ReviewCoalescer::ReviewCoalescer(const CoalescingConfig& config)
+    : _config(config) {}
+
+void ReviewCoalescer::observe_arrival(clock::time_point now) {
+  if (_last_arrival != clock::time_point{}) {
+    auto gap = std::chrono::duration<double, std::micro>(now - _last_arrival);
+    // Clamp idle periods so the window reacts quickly when load comes back
+    auto sample = std::min(gap.count(), 4.0 * _config.max_window_us);
+    _gap_us = _gap_us == 0 ? sample : 0.8 * _gap_us + 0.2 * sample;
+  }
+  _last_arrival = now;
+}
+
+std::chrono::microseconds ReviewCoalescer::window() const {
+  if (!_config.enabled || _gap_us == 0 || _gap_us >= _config.max_window_us) {
+    return std::chrono::microseconds(0);
+  }
+  auto window = std::min<double>(_config.max_window_us,
+                                 _gap_us * _config.target_arrivals);
+  return std::chrono::microseconds(static_cast<i64>(window));
+}
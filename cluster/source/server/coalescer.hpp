@@ -0,0 +1,51 @@
+#pragma once
+#ifndef COALESCER_HPP
+#define COALESCER_HPP
+
+#include <chrono>
+#include <system/aliases.hpp>
+
+/**
+ * @brief Micro-batching limits for small REVIEW requests
+ */
+struct CoalescingConfig {
+  bool enabled = true;        /** Coalesce small reviews into one batch */
+  u32 max_window_us = 2000;   /** Longest time a review waits for others */
+  u32 max_batch_exams = 256;  /** Dispatch as soon as this many are queued */
+  u32 target_arrivals = 8;    /** Arrivals the window tries to wait for */
+};
+
+/**
+ * @brief Adaptive window of the REVIEW micro-batching stage
+ * @details Tracks a moving average of the gap between small reviews. Under
+ *          low load (gap longer than the maximum window) the window is zero
+ *          and reviews are dispatched right away; as the load grows the
+ *          window stretches to cover about `target_arrivals` more reviews,
+ *          up to `max_window_us`.
+ */
+class ReviewCoalescer {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit ReviewCoalescer(const CoalescingConfig& config = {});
+
+  /**
+   * @brief Record the arrival of a small review
+   */
+  void observe_arrival(clock::time_point now);
+
+  /**
+   * @brief Current coalescing window
+   */
+  std::chrono::microseconds window() const;
+
+  const CoalescingConfig& config() const { return _config; }
+  void reconfigure(const CoalescingConfig& config) { _config = config; }
+
+ private:
+  CoalescingConfig _config;
+  clock::time_point _last_arrival{};
+  double _gap_us = 0; /** Moving average of the inter-arrival gap */
+};
+
+#endif  // COALESCER_HPP
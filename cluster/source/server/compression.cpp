@@ -0,0 +1,79 @@
+#include "compression.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t output_chunk = 64 * 1024;
+
+}  // namespace
+
+Inflater::Inflater() {
+  if (inflateInit(&_stream) != Z_OK) {
+    throw std::runtime_error("Failed to initialize zlib inflater");
+  }
+}
+
+Inflater::~Inflater() {
+  inflateEnd(&_stream);
+}
+
+Inflater::Status Inflater::feed(std::string_view input, std::string& output,
+                                size_t max_output) {
+  if (_ended) {
+    return input.empty() ? Status::END : Status::INVALID;
+  }
+  _stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  _stream.avail_in = static_cast<uInt>(input.size());
+  while (true) {
+    auto used = output.size();
+    if (used > max_output) {
+      return Status::INVALID;  // no room left, the body is too large
+    }
+    // Grow in chunks, one byte past the limit to detect oversized bodies
+    output.resize(std::min(used + output_chunk, max_output + 1));
+    _stream.next_out = reinterpret_cast<Bytef*>(output.data() + used);
+    _stream.avail_out = static_cast<uInt>(output.size() - used);
+    auto result = inflate(&_stream, Z_NO_FLUSH);
+    output.resize(output.size() - _stream.avail_out);
+    if (result == Z_STREAM_END) {
+      _ended = true;
+      if (_stream.avail_in > 0 || output.size() > max_output) {
+        return Status::INVALID;
+      }
+      return Status::END;
+    }
+    if (result == Z_BUF_ERROR || (result == Z_OK && _stream.avail_in == 0 &&
+                                  _stream.avail_out > 0)) {
+      return output.size() > max_output ? Status::INVALID : Status::MORE;
+    }
+    if (result != Z_OK) {
+      return Status::INVALID;
+    }
+  }
+}
+
+void Inflater::reset() {
+  inflateReset(&_stream);
+  _ended = false;
+}
+
+std::string Deflater::compress(std::string_view input, i32 level) {
+  z_stream stream{};
+  if (deflateInit(&stream, level) != Z_OK) {
+    throw std::runtime_error("Failed to initialize zlib deflater");
+  }
+  std::string output(deflateBound(&stream, input.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+  stream.next_out = reinterpret_cast<Bytef*>(output.data());
+  stream.avail_out = static_cast<uInt>(output.size());
+  auto result = deflate(&stream, Z_FINISH);
+  output.resize(stream.total_out);
+  deflateEnd(&stream);
+  if (result != Z_STREAM_END) {
+    throw std::runtime_error("Failed to compress response");
+  }
+  return output;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <zlib.h>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+
+/**
+ * @brief Streaming zlib decompressor of frame bodies
+ * @details Compressed bytes are fed as they arrive from the socket, so the
+ *          body is decompressed while the rest of the frame is received.
+ */
+class Inflater {
+ public:
+  enum class Status : u8 {
+    MORE = 0,    /** The stream needs more input */
+    END = 1,     /** The stream is complete */
+    INVALID = 2, /** Corrupt stream, trailing bytes or output too large */
+  };
+
+  Inflater();
+  ~Inflater();
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
+
+  /**
+   * @brief Decompress the next bytes of the stream
+   * @param input Compressed bytes not fed before
+   * @param output String the decompressed bytes are appended to
+   * @param max_output Maximum size of `output`
+   */
+  Status feed(std::string_view input, std::string& output, size_t max_output);
+
+  /**
+   * @brief Get ready for a new stream
+   */
+  void reset();
+
+ private:
+  z_stream _stream{};
+  bool _ended = false;
+};
+
+/**
+ * @brief zlib compressor of response bodies
+ */
+class Deflater {
+ public:
+  Deflater() = delete;
+
+  /**
+   * @brief Compress `input` as one zlib stream
+   * @param level zlib level, 1 is the fastest
+   */
+  static std::string compress(std::string_view input, i32 level);
+};
+
+#endif  // COMPRESSION_HPP
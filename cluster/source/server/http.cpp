@@ -0,0 +1,302 @@
+#include "http.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+
+namespace {
+
+struct Endpoint {
+  std::string_view method;
+  std::string_view path;
+  ScoreHiveCommand command;
+};
+
+constexpr std::array endpoints = {
+    Endpoint{"GET", "/answers", ScoreHiveCommand::GET_ANSWERS},
+    Endpoint{"PUT", "/answers", ScoreHiveCommand::SET_ANSWERS},
+    Endpoint{"POST", "/answers", ScoreHiveCommand::SET_ANSWERS},
+    Endpoint{"PATCH", "/answers", ScoreHiveCommand::PATCH_ANSWERS},
+    Endpoint{"POST", "/review", ScoreHiveCommand::REVIEW},
+    Endpoint{"POST", "/rank", ScoreHiveCommand::RANK},
+    Endpoint{"POST", "/similarity", ScoreHiveCommand::SIMILARITY},
+    Endpoint{"POST", "/echo", ScoreHiveCommand::ECHO},
+};
+
+char lower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+  return std::ranges::equal(a, b, [](char x, char y) {
+    return lower(x) == lower(y);
+  });
+}
+
+bool icontains(std::string_view text, std::string_view word) {
+  return !std::ranges::search(text, word, [](char x, char y) {
+            return lower(x) == lower(y);
+          }).empty();
+}
+
+std::string_view trim(std::string_view text) {
+  auto first = text.find_first_not_of(" \t");
+  if (first == std::string_view::npos) {
+    return {};
+  }
+  auto last = text.find_last_not_of(" \t");
+  return text.substr(first, last - first + 1);
+}
+
+std::string decode(std::string_view text) {
+  std::string decoded;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '+') {
+      decoded += ' ';
+    } else if (text[i] != '%') {
+      decoded += text[i];
+    } else {
+      u8 byte = 0;
+      auto hex = text.substr(i + 1, std::min<size_t>(2, text.size() - i - 1));
+      auto [end, error] =
+          std::from_chars(hex.data(), hex.data() + hex.size(), byte, 16);
+      if (hex.size() != 2 || error != std::errc() ||
+          end != hex.data() + hex.size()) {
+        throw std::runtime_error("Invalid percent escape in the query");
+      }
+      decoded += static_cast<char>(byte);
+      i += 2;
+    }
+  }
+  return decoded;
+}
+
+}  // namespace
+
+HttpParser::Status HttpParser::parse(std::string_view input) {
+  if (_head_size == 0) {
+    // Skip the line breaks some clients send after a body
+    if (_scanned == 0) {
+      while (_start < input.size() &&
+             (input[_start] == '\r' || input[_start] == '\n')) {
+        _start++;
+      }
+    }
+    // The end of the head may straddle the previous read
+    auto from = std::max(_start, _scanned > 3 ? _scanned - 3 : 0);
+    auto end = input.find("\r\n\r\n", from);
+    if (end == std::string_view::npos) {
+      if (input.size() - _start > MAX_HEAD_BYTES) {
+        return _fail(431, "Request header fields too large");
+      }
+      _scanned = input.size() > _start ? input.size() : 0;
+      return Status::INCOMPLETE;
+    }
+    if (end - _start > MAX_HEAD_BYTES) {
+      return _fail(431, "Request header fields too large");
+    }
+    _head_size = end + 4;
+    _scanned = _head_size;
+    if (_parse_head(input.substr(_start, end - _start)) == Status::INVALID) {
+      return Status::INVALID;
+    }
+  }
+  if (input.size() < _head_size + _body_size) {
+    return Status::INCOMPLETE;
+  }
+  _request = {input.substr(_start, _method_size),
+              input.substr(_path_offset, _path_size),
+              input.substr(_path_offset + _path_size + 1, _query_size),
+              input.substr(_head_size, _body_size), _keep_alive,
+              _accepts_deflate, _json_body};
+  return Status::REQUEST;
+}
+
+HttpParser::Status HttpParser::_parse_head(std::string_view head) {
+  auto line_end = std::min(head.find("\r\n"), head.size());
+  auto line = head.substr(0, line_end);
+  auto method_end = line.find(' ');
+  auto target_end = method_end == std::string_view::npos
+                        ? std::string_view::npos
+                        : line.find(' ', method_end + 1);
+  if (method_end == 0 || target_end == std::string_view::npos) {
+    return _fail(400, "Malformed request line");
+  }
+  auto version = line.substr(target_end + 1);
+  if (version == "HTTP/1.0") {
+    _keep_alive = false;
+  } else if (version != "HTTP/1.1") {
+    return _fail(505, "HTTP version not supported");
+  }
+  auto target = line.substr(method_end + 1, target_end - method_end - 1);
+  if (target.empty() || target[0] != '/') {
+    return _fail(400, "Invalid request target");
+  }
+  _method_size = method_end;
+  _path_offset = _start + method_end + 1;
+  _path_size = std::min(target.find_first_of("?#"), target.size());
+  if (_path_size < target.size() && target[_path_size] == '?') {
+    _query_size = std::min(target.find('#'), target.size()) - _path_size - 1;
+  }
+  bool has_length = false;
+  for (size_t pos = line_end + 2; pos < head.size();) {
+    auto next = std::min(head.find("\r\n", pos), head.size());
+    auto field = head.substr(pos, next - pos);
+    pos = next + 2;
+    auto colon = field.find(':');
+    if (colon == 0 || colon == std::string_view::npos) {
+      return _fail(400, "Malformed header field");
+    }
+    auto name = field.substr(0, colon);
+    auto value = trim(field.substr(colon + 1));
+    if (iequals(name, "content-length")) {
+      size_t length = 0;
+      auto [ptr, ec] =
+          std::from_chars(value.data(), value.data() + value.size(), length);
+      if (value.empty() || ec != std::errc() ||
+          ptr != value.data() + value.size() ||
+          (has_length && length != _body_size)) {
+        return _fail(400, "Invalid Content-Length");
+      }
+      if (_max_body > 0 && length > _max_body) {
+        return _fail(413, "Message size exceeds the maximum allowed size");
+      }
+      has_length = true;
+      _body_size = length;
+    } else if (iequals(name, "transfer-encoding")) {
+      return _fail(501, "Chunked bodies are not supported");
+    } else if (iequals(name, "content-encoding")) {
+      if (!iequals(value, "identity")) {
+        return _fail(415, "Encoded bodies are not supported");
+      }
+    } else if (iequals(name, "connection")) {
+      if (icontains(value, "close")) {
+        _keep_alive = false;
+      } else if (icontains(value, "keep-alive")) {
+        _keep_alive = true;
+      }
+    } else if (iequals(name, "expect")) {
+      if (!iequals(value, "100-continue")) {
+        return _fail(417, "Unsupported expectation");
+      }
+      _continue = true;
+    } else if (iequals(name, "accept-encoding")) {
+      _accepts_deflate = icontains(value, "deflate");
+    } else if (iequals(name, "content-type")) {
+      auto media_type = trim(value.substr(0, value.find(';')));
+      _json_body = iequals(media_type, "application/json");
+    }
+  }
+  return Status::REQUEST;
+}
+
+bool HttpParser::take_continue() {
+  if (_head_size == 0 || !_continue) {
+    return false;
+  }
+  _continue = false;
+  return true;
+}
+
+void HttpParser::reset() {
+  *this = HttpParser(_max_body);
+}
+
+HttpParser::Status HttpParser::_fail(u16 status, const char* error) {
+  _status = status;
+  _error = error;
+  return Status::INVALID;
+}
+
+HttpRoute HttpApi::route(const HttpRequest& request) {
+  bool known_path = false;
+  for (const auto& endpoint : endpoints) {
+    if (endpoint.path != request.path) {
+      continue;
+    }
+    if (endpoint.method == request.method) {
+      // A browser sends other types cross-origin without a preflight
+      if (request.method != "GET" && !request.json_body) {
+        return {415, ScoreHiveCommand::ECHO};
+      }
+      return {200, endpoint.command};
+    }
+    known_path = true;
+  }
+  if (known_path && request.method == "OPTIONS") {
+    return {204, ScoreHiveCommand::ECHO};
+  }
+  return {static_cast<u16>(known_path ? 405 : 404), ScoreHiveCommand::ECHO};
+}
+
+std::string_view HttpApi::allowed(std::string_view path) {
+  if (path == "/answers") {
+    return "GET, PUT, POST, PATCH, OPTIONS";
+  }
+  return "POST, OPTIONS";
+}
+
+std::string HttpApi::query_object(std::string_view query) {
+  auto object = nlohmann::json::object();
+  while (!query.empty()) {
+    auto end = std::min(query.find('&'), query.size());
+    auto parameter = query.substr(0, end);
+    query.remove_prefix(std::min(end + 1, query.size()));
+    auto equals = std::min(parameter.find('='), parameter.size());
+    auto name = decode(parameter.substr(0, equals));
+    auto value = decode(equals < parameter.size()
+                            ? parameter.substr(equals + 1)
+                            : std::string_view());
+    if (name.empty()) {
+      continue;
+    }
+    // Exam ids are names, even those made of digits
+    bool text = name == "exam_id" || name == "student_id";
+    u64 number = 0;
+    auto [last, error] =
+        std::from_chars(value.data(), value.data() + value.size(), number);
+    if (!text && !value.empty() && error == std::errc() &&
+        last == value.data() + value.size()) {
+      object[name] = number;
+    } else {
+      object[name] = value;
+    }
+  }
+  return object.dump();
+}
+
+std::string_view HttpApi::reason(u16 status) {
+  switch (status) {
+    case 100:
+      return "Continue";
+    case 200:
+      return "OK";
+    case 204:
+      return "No Content";
+    case 304:
+      return "Not Modified";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 413:
+      return "Content Too Large";
+    case 415:
+      return "Unsupported Media Type";
+    case 417:
+      return "Expectation Failed";
+    case 431:
+      return "Request Header Fields Too Large";
+    case 501:
+      return "Not Implemented";
+    case 503:
+      return "Service Unavailable";
+    case 505:
+      return "HTTP Version Not Supported";
+    default:
+      return "Error";
+  }
+}
@@ -0,0 +1,159 @@
+#pragma once
+#ifndef HTTP_HPP
+#define HTTP_HPP
+
+#include <server/protocol.hpp>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+
+/**
+ * @brief HTTP request parsed from the receive buffer
+ * @details The views point into the buffer given to HttpParser::parse and
+ *          are only valid until the buffer changes or the parser is reset.
+ */
+struct HttpRequest {
+  std::string_view method; /** Request method */
+  std::string_view path;   /** Request target without the query */
+  std::string_view query;  /** Query of the target, without the "?" */
+  std::string_view body;   /** Body, delimited by Content-Length */
+  bool keep_alive;         /** Connection stays open after the response */
+  bool accepts_deflate;    /** Client accepts "Content-Encoding: deflate" */
+  bool json_body;          /** Content-Type is application/json */
+};
+
+/**
+ * @brief Incremental parser of HTTP/1.1 requests
+ * @details Waits for the whole head, parses it once and then waits for the
+ *          body. Only Content-Length bodies are accepted; chunked or
+ *          encoded bodies are rejected with the status to answer.
+ *          Oversized bodies are rejected as soon as the head arrives.
+ */
+class HttpParser {
+ public:
+  enum class Status : u8 {
+    INCOMPLETE = 0, /** More bytes are needed */
+    REQUEST = 1,    /** A request was parsed, see request() */
+    INVALID = 2,    /** The input is not a valid request, see status() */
+  };
+
+  static constexpr size_t MAX_HEAD_BYTES = 16 * 1024; /** Line and headers */
+
+  explicit HttpParser(u32 max_body = 0) : _max_body(max_body) {}
+
+  /**
+   * @brief Parse the next request
+   * @param input Unconsumed bytes of the receive buffer. Must start with the
+   *        same bytes as in the previous call until reset() is called.
+   */
+  Status parse(std::string_view input);
+
+  /**
+   * @brief Parsed request, valid after parse() returned REQUEST
+   */
+  const HttpRequest& request() const { return _request; }
+
+  /**
+   * @brief Bytes of the input taken by the parsed request
+   */
+  size_t request_size() const { return _head_size + _body_size; }
+
+  /**
+   * @brief HTTP status and reason of the last INVALID status
+   */
+  u16 status() const { return _status; }
+  const char* error() const { return _error; }
+
+  /**
+   * @brief Whether part of a request has been received
+   */
+  bool started() const { return _scanned > 0; }
+
+  /**
+   * @brief Whether the client waits for "100 Continue" before sending the
+   *        body. True once per request.
+   */
+  bool take_continue();
+
+  /**
+   * @brief Get ready for the next request once the current one is consumed
+   */
+  void reset();
+
+ private:
+  Status _fail(u16 status, const char* error);
+  Status _parse_head(std::string_view head);
+
+  u32 _max_body;
+  size_t _start = 0;     /** Start of the request, after leading CRLFs */
+  size_t _scanned = 0;   /** Bytes searched for the end of the head */
+  size_t _head_size = 0; /** Size of the head, 0 until it is complete */
+  size_t _body_size = 0;
+  size_t _method_size = 0;
+  size_t _path_offset = 0;
+  size_t _path_size = 0;
+  size_t _query_size = 0;
+  bool _keep_alive = true;
+  bool _accepts_deflate = false;
+  bool _json_body = false;
+  bool _continue = false;
+  HttpRequest _request{};
+  u16 _status = 0;
+  const char* _error = nullptr;
+};
+
+/**
+ * @brief Where an HTTP request goes
+ * @details `status` is 200 when the request maps to `command`, otherwise it
+ *          is the status to answer right away (204 for CORS preflights).
+ */
+struct HttpRoute {
+  u16 status;               /** 200 or the status to answer */
+  ScoreHiveCommand command; /** Command of the request if routed */
+};
+
+/**
+ * @brief Endpoints of the HTTP listener
+ * @details Every endpoint is an SH command and shares its handler:
+ *          - GET /answers: GET_ANSWERS, with the query as its data
+ *            (GET /answers?epoch=<epoch>&version=3 or ?stage=2 or
+ *            ?exam_id=...), 304 if NOT_MODIFIED
+ *          - PUT or POST /answers: SET_ANSWERS
+ *          - PATCH /answers: PATCH_ANSWERS
+ *          - POST /review: REVIEW
+ *          - POST /rank: RANK
+ *          - POST /similarity: SIMILARITY
+ *          - POST /echo: ECHO
+ *          Bodies are the same as the data of the SH commands, and must be
+ *          sent as application/json (415 otherwise), so browsers preflight
+ *          cross-origin requests. SHUTDOWN, DRAIN and RECONFIGURE are only
+ *          served on the SH port.
+ */
+class HttpApi {
+ public:
+  HttpApi() = delete;
+  ~HttpApi() = delete;
+
+  static HttpRoute route(const HttpRequest& request);
+
+  /**
+   * @brief Methods allowed on a path, for the Allow header
+   */
+  static std::string_view allowed(std::string_view path);
+
+  /**
+   * @brief JSON object of the parameters of a query
+   * @details Values are percent-decoded; those made of digits are numbers,
+   *          the rest strings. "exam_id" and "student_id" are always
+   *          strings, as they name letter keys and sheets.
+   * @throw std::runtime_error If a percent escape is invalid
+   */
+  static std::string query_object(std::string_view query);
+
+  /**
+   * @brief Reason phrase of a status
+   */
+  static std::string_view reason(u16 status);
+};
+
+#endif  // HTTP_HPP
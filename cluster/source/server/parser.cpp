@@ -0,0 +1,178 @@
+#include "parser.hpp"
+#include <algorithm>
+#include <charconv>
+
+namespace {
+
+constexpr std::string_view magic = "SH ";
+constexpr size_t max_command_digits = 3;
+constexpr size_t max_length_digits = 10;
+constexpr char compressed_flag = 'z';
+
+bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' ||
+         c == '\f';
+}
+
+}  // namespace
+
+FrameParser::Status FrameParser::parse(std::string_view input) {
+  while (true) {
+    switch (_state) {
+      case State::MAGIC: {
+        // Skip the line breaks some clients send between frames
+        if (_cursor == _start) {
+          while (_cursor < input.size() && is_space(input[_cursor])) {
+            _cursor++;
+          }
+          _start = _cursor;
+        }
+        for (; _cursor < input.size() && _cursor - _start < magic.size();
+             _cursor++) {
+          if (input[_cursor] != magic[_cursor - _start]) {
+            return _fail("Invalid magic string");
+          }
+        }
+        if (_cursor - _start < magic.size()) {
+          return Status::INCOMPLETE;
+        }
+        _state = State::COMMAND;
+        _token = _cursor;
+        break;
+      }
+      case State::COMMAND: {
+        while (_cursor < input.size() && is_digit(input[_cursor])) {
+          if (++_cursor - _token > max_command_digits) {
+            return _fail("Invalid command");
+          }
+        }
+        if (_cursor == input.size()) {
+          return Status::INCOMPLETE;
+        }
+        auto delimiter = input[_cursor];
+        if (_cursor == _token) {
+          return _fail("Missing command");
+        }
+        size_t flag = 0;
+        if (delimiter == compressed_flag) {
+          if (_cursor + 1 == input.size()) {
+            return Status::INCOMPLETE;
+          }
+          flag = 1;
+          delimiter = input[_cursor + 1];
+        }
+        if (delimiter != ' ' && delimiter != '$') {
+          return _fail("Invalid command");
+        }
+        u32 command = 0;
+        std::from_chars(input.data() + _token, input.data() + _cursor,
+                        command);
+        if (command > MAX_COMMAND) {
+          return _fail("Invalid command");
+        }
+        _command = static_cast<u8>(command);
+        _compressed = flag == 1;
+        _cursor += 1 + flag;
+        if (delimiter == '$') {
+          auto no_data = static_cast<ScoreHiveCommand>(_command);
+          if (no_data != ScoreHiveCommand::GET_ANSWERS &&
+              no_data != ScoreHiveCommand::SHUTDOWN &&
+              no_data != ScoreHiveCommand::DRAIN &&
+              no_data != ScoreHiveCommand::RECONFIGURE) {
+            return _fail("Missing length");
+          }
+          _frame = {no_data, 0, {}, _compressed};
+          _frame_size = _cursor;
+          return Status::FRAME;
+        }
+        _state = State::LENGTH;
+        _token = _cursor;
+        break;
+      }
+      case State::LENGTH: {
+        while (_cursor < input.size() && is_digit(input[_cursor])) {
+          if (++_cursor - _token > max_length_digits) {
+            return _fail("Invalid length");
+          }
+        }
+        if (_cursor == input.size()) {
+          return Status::INCOMPLETE;
+        }
+        if (_cursor == _token || input[_cursor] != ' ') {
+          return _fail("Invalid length");
+        }
+        u64 length = 0;
+        std::from_chars(input.data() + _token, input.data() + _cursor, length);
+        if (length > _max_length) {
+          return _fail("Length exceeds the maximum allowed size");
+        }
+        _length = static_cast<u32>(length);
+        _cursor++;
+        _state = State::DATA;
+        _token = _cursor;
+        if (_compressed) {
+          if (!_inflater) {
+            _inflater = std::make_unique<Inflater>();
+          }
+          _inflater->reset();
+        }
+        break;
+      }
+      case State::DATA: {
+        auto end = _token + _length;
+        if (_compressed && _cursor < std::min(input.size(), end)) {
+          // Decompress what arrived since the previous call
+          auto available = std::min(input.size(), end);
+          auto status = _inflater->feed(
+              input.substr(_cursor, available - _cursor), _inflated,
+              _max_length);
+          _cursor = available;
+          if (status == Inflater::Status::INVALID) {
+            return _fail(_inflated.size() > _max_length
+                             ? "Length exceeds the maximum allowed size"
+                             : "Invalid compressed data");
+          }
+          _inflated_end = status == Inflater::Status::END;
+        }
+        if (input.size() <= end) {
+          _cursor = input.size();
+          return Status::INCOMPLETE;
+        }
+        if (input[end] != '$') {
+          return _fail("Data length mismatch");
+        }
+        if (_compressed && !_inflated_end) {
+          return _fail("Invalid compressed data");
+        }
+        auto data = _compressed ? std::string_view(_inflated)
+                                : input.substr(_token, _length);
+        _frame = {static_cast<ScoreHiveCommand>(_command),
+                  static_cast<u32>(data.size()), data, _compressed};
+        _frame_size = end + 1;
+        return Status::FRAME;
+      }
+    }
+  }
+}
+
+void FrameParser::reset() {
+  _state = State::MAGIC;
+  _start = 0;
+  _cursor = 0;
+  _token = 0;
+  _frame = {};
+  _frame_size = 0;
+  _error = nullptr;
+  _compressed = false;
+  _inflated_end = false;
+  _inflated.clear();
+}
+
+FrameParser::Status FrameParser::_fail(const char* error) {
+  _error = error;
+  return Status::INVALID;
+}
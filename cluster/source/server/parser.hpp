@@ -0,0 +1,102 @@
+#pragma once
+#ifndef PARSER_HPP
+#define PARSER_HPP
+
+#include <memory>
+#include <server/compression.hpp>
+#include <server/protocol.hpp>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+
+/**
+ * @brief Frame parsed from the receive buffer
+ * @details `data` points into the buffer given to FrameParser::parse, or
+ *          into the parser for compressed frames, and is only valid until
+ *          the buffer changes or the parser is reset.
+ */
+struct FrameView {
+  ScoreHiveCommand command; /** Command to be performed */
+  u32 length;               /** Length of the data */
+  std::string_view data;    /** Data of the frame */
+  bool compressed;          /** Client sent the "z" flag */
+};
+
+/**
+ * @brief Incremental parser of "SH <command>[ <length> <data>]$" frames
+ * @details A state machine that resumes where the previous call stopped, so
+ *          a frame that arrives in several reads is scanned only once and
+ *          nothing is allocated or copied. Malformed frames are rejected as
+ *          soon as the offending byte arrives, and oversized frames as soon
+ *          as their length is known, before the data is received.
+ *          The data is delimited by its length, so it may contain '$'.
+ *          A "z" right after the command ("SH 2z <length> <data>$") marks
+ *          the data as a zlib stream of `length` bytes. It is decompressed
+ *          as it arrives, and the decompressed size is the one checked
+ *          against the maximum.
+ */
+class FrameParser {
+ public:
+  enum class Status : u8 {
+    INCOMPLETE = 0, /** More bytes are needed */
+    FRAME = 1,      /** A frame was parsed, see frame() */
+    INVALID = 2,    /** The input is not a valid frame, see error() */
+  };
+
+  explicit FrameParser(u32 max_length = 0) : _max_length(max_length) {}
+
+  /**
+   * @brief Parse the next frame
+   * @param input Unconsumed bytes of the receive buffer. Must start with the
+   *        same bytes as in the previous call until reset() is called.
+   */
+  Status parse(std::string_view input);
+
+  /**
+   * @brief Parsed frame, valid after parse() returned FRAME
+   */
+  const FrameView& frame() const { return _frame; }
+
+  /**
+   * @brief Bytes of the input taken by the parsed frame, including the
+   *        whitespace before it
+   */
+  size_t frame_size() const { return _frame_size; }
+
+  /**
+   * @brief Reason of the last INVALID status
+   */
+  const char* error() const { return _error; }
+
+  /**
+   * @brief Whether part of a frame has been received
+   */
+  bool started() const { return _state != State::MAGIC || _cursor > _start; }
+
+  /**
+   * @brief Get ready for the next frame once the current one is consumed
+   */
+  void reset();
+
+ private:
+  enum class State : u8 { MAGIC, COMMAND, LENGTH, DATA };
+
+  Status _fail(const char* error);
+
+  u32 _max_length;
+  State _state = State::MAGIC;
+  size_t _start = 0;  /** Start of the frame, after leading whitespace */
+  size_t _cursor = 0; /** Bytes of the input already scanned */
+  size_t _token = 0;  /** Start of the token being scanned */
+  u8 _command = 0;
+  u32 _length = 0;
+  bool _compressed = false;
+  bool _inflated_end = false;
+  std::unique_ptr<Inflater> _inflater; /** Created on the first "z" frame */
+  std::string _inflated;               /** Decompressed data of the frame */
+  FrameView _frame{};
+  size_t _frame_size = 0;
+  const char* _error = nullptr;
+};
+
+#endif  // PARSER_HPP
@@ -15,31 +15,98 @@ enum class ScoreHiveCommand : u8 {
   SET_ANSWERS = 1, /** Set answers to the server */
   REVIEW = 2,      /** Review answers from the server */
   ECHO = 3,        /** Echo the data to the server */
-  SHUTDOWN = 4     /** Shutdown the server */
+  SHUTDOWN = 4,    /** Shutdown the server */
+  RANK = 5,        /** Query the ranking of the latest results */
+  DRAIN = 6,       /** Finish the admitted work, then shutdown */
+  RECONFIGURE = 7,  /** Change or query the runtime settings */
+  PATCH_ANSWERS = 8, /** Change single questions and re-score kept exams */
+  SIMILARITY = 9     /** Pairs of exams that share wrong answers */
 };
 
 enum class ScoreHiveResponseCode : u8 {
-  OK = 0,    /** OK */
-  ERROR = 1, /** Error */
+  OK = 0,           /** OK */
+  ERROR = 1,        /** Error */
+  NOT_MODIFIED = 2, /** The client already has the data, sent empty */
 };
 
-static constexpr u8 MAX_COMMAND = 4; /** Maximum number of commands */
+static constexpr u8 MAX_COMMAND = 9; /** Maximum number of commands */
 
 /**
  * @brief ScoreHive message. The message is used to communicate with the
  *        ScoreHive server.
  * @details The signatures of the commands are:
- *          - GET_ANSWERS: "SH 0$"
+ *          - GET_ANSWERS: "SH 0$" or "SH 0 <length> <data>$"
+ *            Without data, the array of keys; those of letter keys carry
+ *            their "exam_id" instead of "stage". <data> is an object
+ *            {"epoch": <known>, "version": <known>} to fetch only what
+ *            changed since the version the client has: NOT_MODIFIED if
+ *            nothing did, else {"epoch", "version": <current>, "full":
+ *            <bool>, "answers": [...]} with the keys stored after it, or
+ *            every key ("full": true) if the client has none, a version this
+ *            server never published or one of another epoch.
+ *            {"stage": <stage>} or {"exam_id": <name>} fetch the key of a
+ *            stage as {"epoch", "version", "answers": [<key>]},
+ *            NOT_MODIFIED if "epoch" and "version" are also given and the
+ *            key did not change after it.
+ *            Every SET_ANSWERS and PATCH_ANSWERS publishes a new version;
+ *            every process starts a new epoch, shared by its ingress ranks
  *          - SET_ANSWERS: "SH 1 <length> <data>$"
+ *            <data> is the array of keys, or letter keys
+ *            {"answer_keys": {<exam_id>: ["C", "A", ...]}}. Numeric stages
+ *            go up to MAX_STAGE; the next ones name letter keys
  *          - REVIEW: "SH 2 <length> <data>$"
+ *            <data> is the array of exams, or an object
+ *            {"exams": [...], "sink": {"path": <dir>, "job": <name>}} to
+ *            write the results to columnar files instead of returning them.
+ *            <dir> is relative to SH_SINK_ROOT; without it sinks are
+ *            disabled.
+ *            Letter sheets ({"student_id", "exam_id", "answers": ["C",
+ *            ...]}, as an array or in {"exams": [...]}) are answered with
+ *            their student_id and exam_id instead of id_exam and stage.
+ *            An ans_idx of 0 is a blank and not scored, a repeated qst_idx
+ *            keeps its last answer, and a key rans_idx of 0 leaves the
+ *            question without key (see Evaluator)
  *          - ECHO: "SH 3 <length> <data>$" 
  *          - SHUTDOWN: "SH 4$"
+ *          - RANK: "SH 5 <length> <data>$"
+ *            <data> is {"stage"} or {"exam_id"} of a letter key, with one
+ *            of "top_k", "id_exam" (or "student_id") or "percentile". The
+ *            results of letter sheets carry their student_id and exam_id
+ *          - DRAIN: "SH 6$"
+ *            New connections are refused and, after a grace period, new
+ *            REVIEWs rejected; the server shuts down once the admitted
+ *            requests are answered
+ *          - RECONFIGURE: "SH 7$" or "SH 7 <length> <data>$"
+ *            <data> is a JSON object with the settings to change; the
+ *            response carries the settings in effect
+ *          - PATCH_ANSWERS: "SH 8 <length> <data>$"
+ *            <data> is an array of keys whose answers replace those of the
+ *            same question (rans_idx 0 drops it), or letter keys whose
+ *            non-blank letters replace theirs. With SH_RESIDENT=1 the
+ *            workers re-score the exams they keep and the response is the
+ *            array of results that changed (letter exams by student_id and
+ *            exam_id); otherwise it is an empty array
+ *          - SIMILARITY: "SH 9 <length> <data>$"
+ *            <data> is an array of exams or letter sheets, as in REVIEW, or
+ *            {"exams": [...], "top_k": <pairs>, "min_wrong": <answers>}
+ *            (defaults 100 and 1). The response is the array of the top_k
+ *            pairs of the same stage with at least min_wrong questions
+ *            answered with the same wrong choice, most similar first:
+ *            {"stage", "id_exam_a", "id_exam_b", "matching_wrong",
+ *            "matching_answers"}, or "exam_id", "student_id_a" and
+ *            "student_id_b" for letter sheets
+ *          A "z" after the command ("SH 2z <length> <data>$") means <data>
+ *          is a zlib stream of <length> bytes and the client accepts a
+ *          compressed response, sent as "SH <code>z <length> <data>$\r\n"
+ *          when it is large enough to be worth it.
  */
 struct ScoreHiveRequest {
   const char* magic = "SH"; /** Magic string of the message */
   ScoreHiveCommand command; /** Command to be performed */
   u32 length;               /** Length of the data */
   std::string data;         /** Incoming data */
+  bool compressed = false;  /** Client accepts a compressed response */
+  i32 trace = 0;            /** Trace id of the request */
 };
 
 /**
@@ -51,6 +118,8 @@ struct ScoreHiveResponse {
   ScoreHiveResponseCode code; /** Response code */
   u32 length;                 /** Length of the data */
   std::string data;           /** Outgoing data */
+  bool compressed = false;    /** Compress the data if it is large enough */
+  u16 http_status = 0;        /** HTTP status, derived from code when 0 */
 };
 
 #endif  // PROTOCOL_HPP
\ No newline at end of file
@@ -0,0 +1,29 @@
+#include "scaler.hpp"
+
+WorkerScaler::WorkerScaler(const ScalingConfig& config) : _config(config) {}
+
+ScalingAction WorkerScaler::decide(u32 backlog_exams,
+                                   std::chrono::milliseconds oldest_wait,
+                                   u32 spawned, clock::time_point now) {
+  auto busy = backlog_exams > 0 || oldest_wait.count() > 0;
+  if (busy) {
+    _last_busy = now;
+  }
+  if (now - _last_action < std::chrono::milliseconds(_config.cooldown_ms)) {
+    return ScalingAction::NONE;
+  }
+  if (spawned > _config.max_spawned) {
+    return ScalingAction::RETIRE;
+  }
+  auto behind =
+      busy && (backlog_exams >= _config.backlog_exams ||
+               oldest_wait >= std::chrono::milliseconds(_config.slo_ms));
+  if (behind && spawned < _config.max_spawned) {
+    return ScalingAction::SPAWN;
+  }
+  if (spawned > 0 &&
+      now - _last_busy >= std::chrono::milliseconds(_config.idle_ms)) {
+    return ScalingAction::RETIRE;
+  }
+  return ScalingAction::NONE;
+}
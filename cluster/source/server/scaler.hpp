@@ -0,0 +1,71 @@
+#pragma once
+#ifndef SCALER_HPP
+#define SCALER_HPP
+
+#include <chrono>
+#include <system/aliases.hpp>
+
+/**
+ * @brief Limits of the elastic worker pool
+ */
+struct ScalingConfig {
+  u32 max_spawned = 0;        /** Workers spawned at most, 0 disables it */
+  u32 backlog_exams = 50000;  /** Admitted exams that call for a worker */
+  u32 slo_ms = 1000;          /** Queue wait that calls for a worker */
+  u32 idle_ms = 30000;        /** Time without backlog before a retire */
+  u32 cooldown_ms = 2000;     /** Time between two changes of the pool */
+};
+
+enum class ScalingAction : u8 {
+  NONE = 0,
+  SPAWN = 1,  /** Start one more worker */
+  RETIRE = 2, /** Shut down the newest spawned worker */
+};
+
+/**
+ * @brief Policy of the elastic worker pool
+ * @details A worker is spawned while the admitted exams reach
+ *          `backlog_exams` or the oldest queued request has waited
+ *          `slo_ms`, up to `max_spawned` workers. A spawned worker is
+ *          retired once nothing has been admitted for `idle_ms`, or while
+ *          there are more than `max_spawned`. The pool changes at most once
+ *          per `cooldown_ms`, so a spawn can take effect before the next.
+ *          The server spawns on its event loop: MPI_Comm_spawn blocks until
+ *          the new process has started and connected, commonly for hundreds
+ *          of milliseconds, and no connection is served meanwhile. MPI
+ *          calls stay on that thread, so the stall is bounded by
+ *          `cooldown_ms` rather than moved off the loop; leave
+ *          `max_spawned` at 0 where such a pause is not acceptable.
+ *          Environment: SH_ELASTIC_MAX_WORKERS, SH_ELASTIC_BACKLOG_EXAMS,
+ *          SH_ELASTIC_SLO_MS, SH_ELASTIC_IDLE_MS and SH_ELASTIC_COOLDOWN_MS.
+ */
+class WorkerScaler {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit WorkerScaler(const ScalingConfig& config = {});
+
+  /**
+   * @brief Action to take now
+   * @param backlog_exams Exams admitted and not answered yet
+   * @param oldest_wait Wait of the oldest queued request
+   * @param spawned Spawned workers alive
+   */
+  ScalingAction decide(u32 backlog_exams, std::chrono::milliseconds oldest_wait,
+                       u32 spawned, clock::time_point now);
+
+  /**
+   * @brief Record that the action was taken
+   */
+  void acted(clock::time_point now) { _last_action = now; }
+
+  const ScalingConfig& config() const { return _config; }
+  void reconfigure(const ScalingConfig& config) { _config = config; }
+
+ private:
+  ScalingConfig _config;
+  clock::time_point _last_action{};
+  clock::time_point _last_busy{}; /** Last time something was admitted */
+};
+
+#endif  // SCALER_HPP
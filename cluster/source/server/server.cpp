@@ -1,85 +1,368 @@
 #include "server.hpp"
 #include <mpi.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <spdlog/spdlog.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstring>
 #include <domain/answers.hpp>
+#include <domain/codec.hpp>
 #include <domain/coordinator.hpp>
+#include <domain/ingress.hpp>
+#include <domain/letters.hpp>
+#include <domain/queue.hpp>
+#include <domain/ranking.hpp>
+#include <domain/similarity.hpp>
+#include <domain/sink.hpp>
 #include <nlohmann/json.hpp>
-#include <sstream>
+#include <server/compression.hpp>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <system/logger.hpp>
+#include <system/tracer.hpp>
+#include <utility>
 
 using json = nlohmann::json;
 
-Server::Server(const ServerConfig& config) : _config(config) {}
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(AdmissionConfig, max_inflight_exams,
+                                   max_inflight_bytes, bulk_share_percent,
+                                   interactive_max_exams,
+                                   max_queued_per_connection, retry_after_ms)
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(CoalescingConfig, enabled, max_window_us,
+                                   max_batch_exams, target_arrivals)
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ScalingConfig, max_spawned, backlog_exams,
+                                   slo_ms, idle_ms, cooldown_ms)
+
+namespace {
+
+static constexpr long REPLIES_POLL_NS = 200000;
+
+/**
+ * @brief Exams of a JSON array not in the plain form of JsonCodec
+ * @throw std::runtime_error If an exam lacks a field or an answer is out of
+ *        range
+ */
+std::vector<MPIExam> exams_from_json(const json& exams_json) {
+  std::vector<MPIExam> exams(exams_json.size());
+  for (size_t i = 0; i < exams.size(); i++) {
+    const auto& exam = exams_json.at(i);
+    exams[i].stage = exam.at("stage");
+    exams[i].id_exam = exam.at("id_exam");
+    if (exams[i].stage > MAX_STAGE) {
+      throw std::runtime_error("Stage out of range in exam " +
+                               std::to_string(exams[i].id_exam));
+    }
+    for (const auto& answer : exam.at("answers")) {
+      if (!exams[i].answer(answer.at("qst_idx").get<i32>(),
+                           answer.at("ans_idx").get<i32>())) {
+        throw std::runtime_error("Answer out of range in exam " +
+                                 std::to_string(exams[i].id_exam));
+      }
+    }
+  }
+  return exams;
+}
+
+}  // namespace
+
+Server::Server(const ServerConfig& config)
+    : _config(config),
+      _admission(config.admission),
+      _coalescer(config.coalescing),
+      _scaler(config.scaling) {}
 
 void Server::start() {
   spdlog::info("Starting server...");
+  if (!_config.handoff_path.empty() && _take_over_listeners()) {
+    spdlog::info("Took over the listening socket from {}",
+                 _config.handoff_path);
+  } else {
+    _listen_fd = _open_listener(_config.port);
+  }
+  if (_config.http_port != 0 && _http_listen_fd == -1) {
+    _http_listen_fd = _open_listener(_config.http_port);
+  }
+  if (!_config.handoff_path.empty()) {
+    _open_handoff();
+  }
+  if (!_config.capture_path.empty()) {
+    _capture = std::make_unique<FrameCapture>(_config.capture_path);
+    spdlog::info("Capturing frames to {}", _config.capture_path);
+  }
+  if (_http_listen_fd != -1) {
+    spdlog::info("Serving HTTP on port {}", _config.http_port);
+  }
+  SH_LOG_EVERY_MS(spdlog::level::info, 5000,
+                  "Server waiting for client on port {}", _config.port);
+  std::vector<pollfd> fds;
+  while (!_shutdown || _has_pending_output() || !_tasks.empty()) {
+    fds.clear();
+    if (!_shutdown && _listen_fd != -1) {
+      fds.push_back({_listen_fd, POLLIN, 0});
+    }
+    if (!_shutdown && _http_listen_fd != -1) {
+      fds.push_back({_http_listen_fd, POLLIN, 0});
+    }
+    if (!_shutdown && _handoff_fd != -1) {
+      fds.push_back({_handoff_fd, POLLIN, 0});
+    }
+    for (const auto& [fd, connection] : _connections) {
+      if (connection.broken) {
+        continue;  // kept until its requests are served
+      }
+      short events = 0;
+      if (connection.reading && !_shutdown) {
+        events |= POLLIN;
+      }
+      if (connection.output_offset < connection.output.size()) {
+        events |= POLLOUT;
+      }
+      fds.push_back({fd, events, 0});
+    }
+    // Do not block while there are admitted requests waiting for dispatch
+    auto timeout = _poll_timeout();
+    if (ppoll(fds.data(), fds.size(), &timeout, nullptr) == -1 &&
+        errno != EINTR) {
+      _handle_error();
+    }
+    for (const auto& entry : fds) {
+      if (entry.revents == 0) {
+        continue;
+      }
+      if (entry.fd == _listen_fd || entry.fd == _http_listen_fd) {
+        _accept_clients(entry.fd);
+        continue;
+      }
+      if (entry.fd == _handoff_fd) {
+        _hand_off_listeners();
+        continue;
+      }
+      auto it = _connections.find(entry.fd);
+      if (it == _connections.end()) {
+        continue;
+      }
+      if (entry.revents & (POLLIN | POLLHUP | POLLERR)) {
+        _read_client(entry.fd, it->second);
+      }
+      if (entry.revents & POLLOUT) {
+        _write_client(entry.fd);
+      }
+    }
+    _resume_tasks();
+    // The workers are not told to stop in the middle of a batch; the
+    // shutdown stays pending in the group until it is over
+    if (!_shutdown && IngressGroup::instance().poll() && !_replies_waiter) {
+      spdlog::info("Shutdown requested by another ingress rank");
+      _shutdown_workers();
+    }
+    _dispatch_next();
+    // Nor is the pool resized under it
+    if (!_shutdown && !_draining && !_replies_waiter) {
+      _scale_workers();
+    }
+    if (_draining && !_shutdown && _drained()) {
+      spdlog::info("Drain complete, shutting down");
+      IngressGroup::instance().replicate_shutdown();
+      _shutdown_workers();
+    }
+    if (_shutdown) {
+      // Answered before leaving the loop, which sends them
+      _reject_pending("Server is shutting down");
+    }
+    _close_finished_clients();
+  }
+  for (auto& [fd, connection] : _connections) {
+    close(fd);
+  }
+  _connections.clear();
+  if (_listen_fd != -1) {
+    close(_listen_fd);
+  }
+  if (_http_listen_fd != -1) {
+    close(_http_listen_fd);
+  }
+  if (_handoff_fd != -1) {
+    close(_handoff_fd);
+    unlink(_config.handoff_path.c_str());
+  }
+}
+
+i32 Server::_open_listener(u16 port) {
   // AF_INET: IPv4 protocol
   // SOCK_STREAM: TCP protocol
   // 0: Default protocol
-  i32 socket_fd =
-      socket(AF_INET, SOCK_STREAM, 0);  // Create the listening socket
-  if (socket_fd == -1) {
+  auto listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          0);  // Create the listening socket
+  if (listen_fd == -1) {
     _handle_error();
   }
-  MPI_Comm_size(MPI_COMM_WORLD, &_mpi_size);
+  i32 reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (_config.reuse_port) {
+    // The kernel balances the connections among the ingress ranks
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+  }
   sockaddr_in address = {
       .sin_family = AF_INET,            // IPv4
-      .sin_port = htons(_config.port),  // Port 8080
+      .sin_port = htons(port),          // Port to listen on
       .sin_addr = {htonl(INADDR_ANY)},  // Any IP address
       .sin_zero = {0}                   // Pad to size of `struct sockaddr'
   };
   sockaddr* address_ptr = reinterpret_cast<sockaddr*>(&address);
   // Bind the socket to the address and port
-  auto bind_result = bind(socket_fd, address_ptr, sizeof(address));
+  auto bind_result = bind(listen_fd, address_ptr, sizeof(address));
   if (bind_result == -1) {
     _handle_error();
   }
   // Listen for incoming connections
-  auto listen_result = listen(socket_fd, _config.backlog);
+  auto listen_result = listen(listen_fd, _config.backlog);
   if (listen_result == -1) {
     _handle_error();
   }
-  while (!_shutdown) {
-    spdlog::info("Server waiting for client on port 8080");
-    // Accept an incoming connection
-    auto accept_result = accept(socket_fd, nullptr, nullptr);
-    if (accept_result == -1) {
-      _handle_error();
-      continue;
+  return listen_fd;
+}
+
+bool Server::_take_over_listeners() {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (_config.handoff_path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Hand-off socket path is too long");
+  }
+  std::strncpy(address.sun_path, _config.handoff_path.c_str(),
+               sizeof(address.sun_path) - 1);
+  auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return false;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+      -1) {
+    close(fd);  // no previous process, bind the ports
+    return false;
+  }
+  char byte;
+  iovec io{&byte, 1};
+  // The SH listener and, if the previous process served HTTP, its listener
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(2 * sizeof(i32))> control{};
+  msghdr message{};
+  message.msg_iov = &io;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+  std::array<i32, 2> listen_fds = {-1, -1};
+  if (recvmsg(fd, &message, MSG_CMSG_CLOEXEC) == 1) {
+    auto* header = CMSG_FIRSTHDR(&message);
+    if (header != nullptr && header->cmsg_level == SOL_SOCKET &&
+        header->cmsg_type == SCM_RIGHTS) {
+      auto count = std::min<size_t>(
+          (header->cmsg_len - CMSG_LEN(0)) / sizeof(i32), listen_fds.size());
+      std::memcpy(listen_fds.data(), CMSG_DATA(header), count * sizeof(i32));
     }
-    // Set the client socket file descriptor
-    _client_socket_fd = accept_result;
-    auto read_result = _read();
-    if (!read_result) {
-      _parse_response();
-      auto response = _parse_response();
-      auto send_result =
-          send(_client_socket_fd, response.c_str(), response.size(), 0);
-      if (send_result == -1) {
-        _handle_error();
-      }
-      close(_client_socket_fd);
-      continue;
+  }
+  close(fd);
+  if (listen_fds[0] == -1) {
+    spdlog::warn("No listening socket received from {}",
+                 _config.handoff_path);
+    return false;
+  }
+  _listen_fd = listen_fds[0];
+  if (_config.http_port != 0) {
+    _http_listen_fd = listen_fds[1];
+  } else if (listen_fds[1] != -1) {
+    close(listen_fds[1]);  // HTTP is disabled in this process
+  }
+  return true;
+}
+
+void Server::_open_handoff() {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, _config.handoff_path.c_str(),
+               sizeof(address.sun_path) - 1);
+  unlink(address.sun_path);  // left by the previous process
+  _handoff_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_handoff_fd == -1 ||
+      bind(_handoff_fd, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) == -1 ||
+      listen(_handoff_fd, 1) == -1) {
+    spdlog::error("Failed to serve hand-off socket {}: {}",
+                  _config.handoff_path, strerror(errno));
+    if (_handoff_fd != -1) {
+      close(_handoff_fd);
+      _handoff_fd = -1;
     }
-    spdlog::debug("Request received from client");
-    _handle_request();
-    auto response = _parse_response();
-    auto send_result =
-        send(_client_socket_fd, response.c_str(), response.size(), 0);
-    if (send_result == -1) {
-      _handle_error();
-      close(_client_socket_fd);
-      continue;
+  }
+}
+
+void Server::_hand_off_listeners() {
+  auto fd = accept4(_handoff_fd, nullptr, nullptr, SOCK_CLOEXEC);
+  if (fd == -1) {
+    return;
+  }
+  std::array<i32, 2> listen_fds = {_listen_fd, _http_listen_fd};
+  size_t count = _http_listen_fd != -1 ? 2 : 1;
+  char byte = 0;
+  iovec io{&byte, 1};
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(2 * sizeof(i32))> control{};
+  msghdr message{};
+  message.msg_iov = &io;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = CMSG_SPACE(count * sizeof(i32));
+  auto* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(count * sizeof(i32));
+  std::memcpy(CMSG_DATA(header), listen_fds.data(), count * sizeof(i32));
+  auto sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+  close(fd);
+  if (sent != 1) {
+    spdlog::error("Failed to hand off the listening sockets: {}",
+                  strerror(errno));
+    return;
+  }
+  // The new process owns the path now, so it is not unlinked here
+  close(_handoff_fd);
+  _handoff_fd = -1;
+  _begin_drain("Listening sockets handed off");
+}
+
+void Server::_begin_drain(const std::string& reason) {
+  if (_draining) {
+    return;
+  }
+  _draining = true;
+  _drain_started = std::chrono::steady_clock::now();
+  // New clients go to the next process or instance
+  for (auto* listen_fd : {&_listen_fd, &_http_listen_fd}) {
+    if (*listen_fd != -1) {
+      close(*listen_fd);
+      *listen_fd = -1;
     }
-    spdlog::debug("Response sent to client");
-    close(_client_socket_fd);  // Close the client socket
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    // Sleep for 100ms to avoid busy-waiting
   }
+  spdlog::info("{}, answering the admitted requests before shutting down",
+               reason);
+}
+
+bool Server::_drained() const {
+  if (_admission.has_pending() || !_tasks.empty()) {
+    return false;
+  }
+  // Give the clients connected before the drain time to send their request
+  auto grace = std::chrono::milliseconds(_config.drain_grace_ms);
+  if (std::chrono::steady_clock::now() < _drain_started + grace) {
+    return false;
+  }
+  return std::ranges::none_of(_connections, [](const auto& entry) {
+    const auto& connection = entry.second;
+    return connection.reading && !connection.broken &&
+           connection.receiving();
+  });
 }
 
 void Server::_handle_error() {
@@ -88,186 +371,1363 @@ void Server::_handle_error() {
   throw std::runtime_error(error_string);
 }
 
-bool Server::_read() {
-  try {
-    std::string message;
-    buffer<1024> buffer;
-    // Read the message until the delimiter is found ('$' defined in the protocol)
-    while (message.find('$') == std::string::npos) {
-      auto recv_result =
-          recv(_client_socket_fd, buffer.data(), buffer.size(), 0);
-      if (recv_result == -1) {
-        _handle_error();
-      }
-      if (recv_result == 0) {
-        spdlog::error("Connection closed by client");
-        return false;
-      }
-      message.append(buffer.data(), recv_result);
-      if (message.size() > _config.max_message_size) {
-        spdlog::error("Message size exceeds the maximum allowed size");
-        return false;
-      }
-    }
-    _parse_request(message);
+void Server::_accept_clients(i32 listen_fd) {
+  while (true) {
+    auto client_fd =
+        accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        spdlog::error("Failed to accept client: {}", strerror(errno));
+      }
+      return;
+    }
+    Connection connection;
+    connection.http = listen_fd == _http_listen_fd;
+    if (connection.http) {
+      connection.http_parser = HttpParser(_config.max_message_size);
+    } else {
+      connection.parser = FrameParser(_config.max_message_size);
+      if (_capture) {
+        connection.capture_id = _capture->open_connection();
+      }
+    }
+    _connections[client_fd] = std::move(connection);
+  }
+}
+
+void Server::_read_client(i32 fd, Connection& connection) {
+  buffer<64 * 1024> buffer;
+  while (connection.reading) {
+    auto recv_result = recv(fd, buffer.data(), buffer.size(), 0);
+    if (recv_result == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      spdlog::error("Failed to read data: {}", strerror(errno));
+      connection.broken = true;
+      return;
+    }
+    if (recv_result == 0) {
+      if (connection.receiving()) {
+        _reply_error(fd, "Data length mismatch");  // truncated frame
+        return;
+      }
+      // The client will not send more requests, answer the admitted ones
+      connection.reading = false;
+      connection.closing = true;
+      break;
+    }
+    connection.input.append(buffer.data(), recv_result);
+    auto max_input = _config.max_message_size;
+    if (connection.http) {
+      max_input += HttpParser::MAX_HEAD_BYTES;
+    }
+    if (connection.input.size() > max_input) {
+      spdlog::error("Message size exceeds the maximum allowed size");
+      connection.input.clear();
+      _reply_error(fd, "Message size exceeds the maximum allowed size", 413);
+      return;
+    }
+    _extract_frames(fd, connection);
+  }
+}
+
+void Server::_extract_frames(i32 fd, Connection& connection) {
+  if (connection.http) {
+    _extract_http_requests(fd, connection);
+    return;
+  }
+  auto& input = connection.input;
+  size_t begin = 0;
+  auto& tracer = Tracer::instance();
+  while (connection.reading) {
+    auto& parser = connection.parser;
+    if (tracer.enabled() && !parser.started()) {
+      connection.frame_begin_us = Tracer::now_us();
+    }
+    auto status = parser.parse(std::string_view(input).substr(begin));
+    if (status == FrameParser::Status::INCOMPLETE) {
+      break;
+    }
+    if (status == FrameParser::Status::INVALID) {
+      spdlog::error("Failed to read data: {}", parser.error());
+      _reply_error(fd, parser.error());
+      return;
+    }
+    const auto& frame = parser.frame();
+    ScoreHiveRequest request;
+    request.command = frame.command;
+    request.length = frame.length;
+    request.data.assign(frame.data);  // the only copy, kept while queued
+    request.compressed = frame.compressed;
+    auto slot = _take_slot(connection);
+    if (_capture) {
+      _capture->request(
+          connection.capture_id, slot,
+          std::string_view(input).substr(begin, parser.frame_size()));
+    }
+    begin += parser.frame_size();
+    parser.reset();
+    if (!_config.keep_alive) {
+      connection.reading = false;  // one request per connection
+      connection.closing = true;
+    }
+    _admit(fd, slot, std::move(request));
+  }
+  input.erase(0, begin);
+}
+
+void Server::_extract_http_requests(i32 fd, Connection& connection) {
+  auto& input = connection.input;
+  size_t begin = 0;
+  auto& tracer = Tracer::instance();
+  while (connection.reading) {
+    auto& parser = connection.http_parser;
+    if (tracer.enabled() && !parser.started()) {
+      connection.frame_begin_us = Tracer::now_us();
+    }
+    auto status = parser.parse(std::string_view(input).substr(begin));
+    if (status == HttpParser::Status::INCOMPLETE) {
+      // Interim responses cannot overtake the answers of earlier requests,
+      // the last of them sends it otherwise
+      if (connection.responses.empty() && parser.take_continue()) {
+        connection.output += "HTTP/1.1 100 Continue\r\n\r\n";
+        _write_client(fd);
+      }
+      break;
+    }
+    if (status == HttpParser::Status::INVALID) {
+      spdlog::error("Failed to read HTTP request: {}", parser.error());
+      _reply_error(fd, parser.error(), parser.status());
+      return;
+    }
+    const auto& request = parser.request();
+    auto route = HttpApi::route(request);
+    if (!request.keep_alive) {
+      connection.reading = false;
+      connection.closing = true;
+    }
+    if (route.status != 200) {
+      // Answered here: preflights and requests no handler takes
+      ScoreHiveResponse response;
+      response.code = route.status == 204 ? ScoreHiveResponseCode::OK
+                                          : ScoreHiveResponseCode::ERROR;
+      response.data = route.status == 204 ? ""
+                                          : HttpApi::reason(route.status);
+      response.length = response.data.size();
+      response.http_status = route.status;
+      auto allow = HttpApi::allowed(request.path);
+      begin += parser.request_size();
+      parser.reset();
+      _queue_response(fd, _take_slot(connection), response, allow);
+      continue;
+    }
+    ScoreHiveRequest routed;
+    routed.command = route.command;
+    routed.data.assign(request.body);
+    if (route.command == ScoreHiveCommand::GET_ANSWERS &&
+        !request.query.empty()) {
+      try {
+        routed.data = HttpApi::query_object(request.query);
+      } catch (std::exception& e) {
+        ScoreHiveResponse response;
+        response.code = ScoreHiveResponseCode::ERROR;
+        response.data = e.what();
+        response.length = response.data.size();
+        begin += parser.request_size();
+        parser.reset();
+        _queue_response(fd, _take_slot(connection), response);
+        continue;
+      }
+    }
+    routed.length = routed.data.size();
+    routed.compressed = request.accepts_deflate;
+    begin += parser.request_size();
+    parser.reset();
+    _admit(fd, _take_slot(connection), std::move(routed));
+  }
+  input.erase(0, begin);
+}
+
+void Server::_admit(i32 fd, u64 slot, ScoreHiveRequest&& request) {
+  auto& tracer = Tracer::instance();
+  request.trace = 0;
+  if (tracer.enabled()) {
+    request.trace = tracer.next_trace();
+    tracer.record("recv", request.trace, _connections.at(fd).frame_begin_us);
+  }
+  SH_LOG_EVERY_MS(spdlog::level::debug, 1000, "Request received from client");
+  ScoreHiveResponse response;
+  if (_draining && request.command == ScoreHiveCommand::REVIEW &&
+      std::chrono::steady_clock::now() >=
+          _drain_started + std::chrono::milliseconds(_config.drain_grace_ms)) {
+    // Requests sent before the drain got the grace period, later ones are
+    // retried on another instance or on the next process
+    response.code = ScoreHiveResponseCode::ERROR;
+    response.data = "Server is draining";
+    response.length = response.data.size();
+    response.http_status = 503;
+    _queue_response(fd, slot, response);
+    return;
+  }
+  auto ticket = _admission.classify(fd, request);
+  ticket.slot = slot;
+  auto now = std::chrono::steady_clock::now();
+  PendingRequest pending{std::move(request), ticket, now};
+  bool coalescable = _is_coalescable(pending);
+  auto retry_after = _admission.admit(std::move(pending));
+  if (retry_after) {
+    SH_LOG_EVERY_MS(spdlog::level::warn, 1000,
+                    "Server busy ({} exams, {} bytes in flight)",
+                    _admission.inflight_exams(), _admission.inflight_bytes());
+    response.code = ScoreHiveResponseCode::ERROR;
+    response.data =
+        "Busy, retry after " + std::to_string(*retry_after) + " ms";
+    response.length = response.data.size();
+    response.http_status = 503;
+    _queue_response(fd, slot, response);
+    return;
+  }
+  if (coalescable) {
+    _coalescer.observe_arrival(now);
+  }
+}
+
+u64 Server::_take_slot(Connection& connection) {
+  connection.responses.emplace_back();
+  return connection.next_slot++;
+}
+
+void Server::_dispatch_next() {
+  if (_replies_waiter) {
+    auto local = _admission.take(
+        [this](const PendingRequest& pending) { return _is_local(pending); },
+        0);
+    for (auto& pending : local) {
+      _dispatch(std::move(pending));
+    }
+    return;
+  }
+  const auto* head = _admission.peek();
+  if (head == nullptr) {
+    return;
+  }
+  if (!_is_coalescable(*head)) {
+    _dispatch(*_admission.next());
+    return;
+  }
+  // Hold small reviews for the coalescing window, or until enough exams
+  // are queued to fill a batch
+  const auto& config = _coalescer.config();
+  auto match = [this](const PendingRequest& pending) {
+    return _is_coalescable(pending);
+  };
+  auto queued = _admission.summarize(match);
+  auto deadline = queued.oldest + _coalescer.window();
+  if (queued.exams < config.max_batch_exams &&
+      std::chrono::steady_clock::now() < deadline) {
+    _dispatch_deadline = deadline;
+    return;
+  }
+  _dispatch_deadline.reset();
+  auto batch = _admission.take(match, config.max_batch_exams);
+  if (batch.size() == 1) {
+    _dispatch(std::move(batch.front()));
+    return;
+  }
+  for (const auto& pending : batch) {
+    _connections.at(pending.ticket.connection).serving++;
+  }
+  _start(_serve_coalesced(std::move(batch)));
+}
+
+void Server::_dispatch(PendingRequest&& pending) {
+  _connections.at(pending.ticket.connection).serving++;
+  _start(_serve(std::move(pending)));
+}
+
+void Server::_start(Task task) {
+  task.start();
+  if (task.done()) {
+    task.rethrow();
+    return;
+  }
+  _tasks.push_back(std::move(task));
+}
+
+void Server::_resume_tasks() {
+  if (_replies_waiter && MPICoordinator::instance().replies_ready()) {
+    std::exchange(_replies_waiter, nullptr).resume();
+  }
+  for (auto it = _tasks.begin(); it != _tasks.end();) {
+    if (!it->done()) {
+      ++it;
+      continue;
+    }
+    it->rethrow();
+    it = _tasks.erase(it);
+  }
+}
+
+Server::WorkerReplies Server::_worker_replies() {
+  return {*this, Tracer::instance().current()};
+}
+
+bool Server::WorkerReplies::await_ready() const {
+  return MPICoordinator::instance().replies_ready();
+}
+
+void Server::WorkerReplies::await_suspend(std::coroutine_handle<> waiter) {
+  server._replies_waiter = waiter;
+}
+
+void Server::WorkerReplies::await_resume() const {
+  Tracer::instance().set_current(trace);
+}
+
+void Server::_scale_workers() {
+  auto& coordinator = MPICoordinator::instance();
+  auto spawned = static_cast<u32>(coordinator.spawned_workers());
+  if (_scaler.config().max_spawned == 0 && spawned == 0) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  auto queued = _admission.summarize([](const PendingRequest&) {
     return true;
+  });
+  auto oldest_wait =
+      queued.requests == 0
+          ? std::chrono::milliseconds(0)
+          : std::chrono::duration_cast<std::chrono::milliseconds>(
+                now - queued.oldest);
+  auto action = _scaler.decide(_admission.inflight_exams(), oldest_wait,
+                               spawned, now);
+  if (action == ScalingAction::NONE) {
+    return;
+  }
+  _scaler.acted(now);
+  try {
+    if (action == ScalingAction::SPAWN) {
+      coordinator.spawn_worker();
+    } else {
+      coordinator.retire_worker();
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("Worker pool not changed: {}", e.what());
+  }
+}
+
+Task Server::_serve(PendingRequest pending) {
+  auto started = std::chrono::steady_clock::now();
+  _trace_dispatch(pending);
+  RequestContext context{std::move(pending.request), {}};
+  co_await _handle_request(context);
+  context.response.compressed = context.request.compressed;
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started);
+  _finish(pending.ticket, elapsed.count(), context.response);
+}
+
+Task Server::_serve_coalesced(std::vector<PendingRequest> batch) {
+  auto started = std::chrono::steady_clock::now();
+  std::vector<MPIExam> merged;
+  std::vector<MPIExam> exams;
+  std::vector<size_t> counts;
+  std::vector<PendingRequest*> members;
+  auto& tracer = Tracer::instance();
+  for (auto& pending : batch) {
+    _trace_dispatch(pending);
+    bool decoded = false;
+    {
+      TraceScope span("parse");
+      decoded = JsonCodec::read_exams(pending.request.data, exams);
+    }
+    if (!decoded) {
+      // Unusual or invalid body: the regular path validates it and reports
+      // the error to its client alone
+      co_await _serve(std::move(pending));
+      continue;
+    }
+    counts.push_back(exams.size());
+    merged.insert(merged.end(), std::make_move_iterator(exams.begin()),
+                  std::make_move_iterator(exams.end()));
+    members.push_back(&pending);
+  }
+  std::vector<MPIResult> results;
+  if (!members.empty()) {
+    // The batch spans carry the id of its first review
+    tracer.set_current(members.front()->request.trace);
+  }
+  bool failed = false;
+  try {
+    auto& coordinator = MPICoordinator::instance();
+    auto merged_size = merged.size();
+    coordinator.send_to_workers(std::move(merged));
+    co_await _worker_replies();
+    results = coordinator.receive_results_from_workers();
+    if (results.size() != merged_size) {
+      throw std::runtime_error("Result count does not match the exams");
+    }
   } catch (std::exception& e) {
-    spdlog::error("Failed to read data: {}", e.what());
-    _response.code = ScoreHiveResponseCode::ERROR;
-    _response.length = strlen(e.what());
-    _response.data = e.what();
+    // An invalid exam fails the whole batch: serve the reviews one by one so
+    // only the faulty request gets the error
+    spdlog::warn("Coalesced review failed, serving individually: {}",
+                 e.what());
+    failed = true;
+  }
+  if (failed) {
+    for (auto* pending : members) {
+      co_await _serve(std::move(*pending));
+    }
+    co_return;
+  }
+  ScoreIndex::instance().update(results);
+  SH_LOG_EVERY_MS(spdlog::level::info, 1000,
+                  "Coalesced {} reviews into one batch of {} exams",
+                  members.size(), results.size());
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - started)
+                     .count();
+  size_t offset = 0;
+  for (size_t i = 0; i < members.size(); i++) {
+    tracer.set_current(members[i]->request.trace);
+    std::string msg;
+    {
+      TraceScope span("encode");
+      JsonCodec::write_results(
+          std::span<const MPIResult>(results).subspan(offset, counts[i]),
+          msg);
+    }
+    offset += counts[i];
+    ScoreHiveResponse response;
+    response.code = ScoreHiveResponseCode::OK;
+    response.length = msg.size();
+    response.data = msg;
+    response.compressed = members[i]->request.compressed;
+    auto share = results.empty() ? 0 : elapsed * counts[i] / results.size();
+    _finish(members[i]->ticket, share, response);
+  }
+}
+
+void Server::_trace_dispatch(const PendingRequest& pending) {
+  auto& tracer = Tracer::instance();
+  tracer.set_current(pending.request.trace);
+  if (!tracer.enabled()) {
+    return;
+  }
+  auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - pending.admitted_at);
+  tracer.record("queue", pending.request.trace,
+                Tracer::now_us() - waited.count());
+}
+
+void Server::_finish(const AdmissionTicket& ticket, u64 elapsed_us,
+                     ScoreHiveResponse& response) {
+  TraceScope span("respond");
+  _admission.complete(ticket, elapsed_us);
+  auto& connection = _connections.at(ticket.connection);
+  connection.serving--;
+  if (connection.broken) {
+    return;  // the client went away while the request was served
+  }
+  _queue_response(ticket.connection, ticket.slot, response);
+}
+
+bool Server::_is_coalescable(const PendingRequest& pending) const {
+  if (!_coalescer.config().enabled ||
+      pending.request.command != ScoreHiveCommand::REVIEW ||
+      pending.ticket.priority != PriorityClass::INTERACTIVE) {
     return false;
   }
+  // Reviews with a result sink are objects and are never coalesced
+  const auto& body = pending.request.data;
+  auto first = body.find_first_not_of(" \t\r\n");
+  return first != std::string::npos && body[first] == '[';
 }
 
-void Server::_parse_request(const std::string& message) {
-  std::istringstream iss(message);
-  std::string token;
-  if (!std::getline(iss, token, ' ') || token != "SH") {
-    throw std::runtime_error("Invalid magic string");
+bool Server::_is_local(const PendingRequest& pending) const {
+  auto command = pending.request.command;
+  return (command == ScoreHiveCommand::GET_ANSWERS ||
+          command == ScoreHiveCommand::ECHO ||
+          command == ScoreHiveCommand::RANK) &&
+         _connections.at(pending.ticket.connection).serving == 0;
+}
+
+timespec Server::_poll_timeout() const {
+  if (_replies_waiter) {
+    // MPI has no descriptor to poll, check the replies of the workers often
+    return timespec{0, REPLIES_POLL_NS};
   }
-  if (!std::getline(iss, token, ' ')) {
-    throw std::runtime_error("Missing command");
+  if (!_admission.has_pending()) {
+    // Wake up to apply the updates of the other ingress ranks, or to check
+    // whether the drain is complete
+    return IngressGroup::instance().count() > 1 || _draining
+               ? timespec{0, 20000000}
+               : timespec{1, 0};
   }
-  size_t pos = token.find('$');
-  if (pos != std::string::npos) {
-    token = token.substr(0, pos);
+  if (!_dispatch_deadline) {
+    return timespec{0, 0};
   }
-  u8 command = static_cast<u8>(std::stoi(token));
-  if (command > MAX_COMMAND) {
-    throw std::runtime_error("Invalid command");
+  auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      *_dispatch_deadline - std::chrono::steady_clock::now());
+  if (remaining.count() <= 0) {
+    return timespec{0, 0};
   }
-  if (command == 0) {
-    _request.command = ScoreHiveCommand::GET_ANSWERS;
-    _request.length = 0;
-    _request.data = "";
-    return;
+  return timespec{static_cast<time_t>(remaining.count() / 1000000000),
+                  static_cast<long>(remaining.count() % 1000000000)};
+}
+
+void Server::_queue_response(i32 fd, u64 slot,
+                             ScoreHiveResponse& response,
+                             std::string_view allow) {
+  auto& connection = _connections.at(fd);
+  auto& responses = connection.responses;
+  auto index = slot - (connection.next_slot - responses.size());
+  if (_capture && !connection.http) {
+    _capture->response(connection.capture_id, slot, response.code);
   }
-  if (command == 4) {
-    _request.command = ScoreHiveCommand::SHUTDOWN;
-    _request.length = 0;
-    _request.data = "";
-    return;
+  bool last = connection.closing && index + 1 == responses.size();
+  responses[index] = connection.http ? _http_response(response, allow, last)
+                                     : _parse_response(response);
+  // Send the responses that are ready, from the oldest one owed
+  while (!responses.empty() && responses.front()) {
+    connection.output += *responses.front();
+    responses.pop_front();
+  }
+  if (connection.http && responses.empty() &&
+      connection.http_parser.take_continue()) {
+    connection.output += "HTTP/1.1 100 Continue\r\n\r\n";
+  }
+  _write_client(fd);
+}
+
+void Server::_reply_error(i32 fd, const std::string& message,
+                          u16 http_status) {
+  auto& connection = _connections.at(fd);
+  connection.reading = false;
+  connection.closing = true;
+  ScoreHiveResponse response;
+  response.code = ScoreHiveResponseCode::ERROR;
+  response.length = message.size();
+  response.data = message;
+  response.http_status = http_status;
+  _queue_response(fd, _take_slot(connection), response);
+}
+
+void Server::_reject_pending(const std::string& message) {
+  while (auto pending = _admission.next()) {
+    auto fd = pending->ticket.connection;
+    _admission.complete(pending->ticket, 0);
+    if (!_connections.contains(fd) || _connections[fd].broken) {
+      continue;
+    }
+    ScoreHiveResponse response;
+    response.code = ScoreHiveResponseCode::ERROR;
+    response.length = message.size();
+    response.data = message;
+    response.http_status = 503;
+    _queue_response(fd, pending->ticket.slot, response);
   }
-  if (!std::getline(iss, token, ' ')) {
-    throw std::runtime_error("Missing length");
+}
+
+void Server::_write_client(i32 fd) {
+  auto it = _connections.find(fd);
+  if (it == _connections.end()) {
+    return;
   }
-  u32 length = static_cast<u32>(std::stoi(token));
-  if (length > _config.max_message_size) {
-    throw std::runtime_error("Length exceeds the maximum allowed size");
+  auto& connection = it->second;
+  while (connection.output_offset < connection.output.size()) {
+    auto send_result =
+        send(fd, connection.output.data() + connection.output_offset,
+             connection.output.size() - connection.output_offset,
+             MSG_NOSIGNAL);
+    if (send_result == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      spdlog::error("Failed to send response: {}", strerror(errno));
+      connection.broken = true;
+      return;
+    }
+    connection.output_offset += send_result;
   }
-  if (!std::getline(iss, token, '$')) {
-    throw std::runtime_error("Missing delimiter");
+  connection.output.clear();
+  connection.output_offset = 0;
+  SH_LOG_EVERY_MS(spdlog::level::debug, 1000, "Response sent to client");
+}
+
+void Server::_close_finished_clients() {
+  for (auto it = _connections.begin(); it != _connections.end();) {
+    const auto& connection = it->second;
+    bool done = connection.closing && connection.responses.empty() &&
+                connection.output.empty();
+    // A served request still holds the descriptor, it must not be reused
+    if ((!connection.broken && !done) || connection.serving > 0) {
+      ++it;
+      continue;
+    }
+    _admission.drop_connection(it->first);
+    close(it->first);  // Close the client socket
+    it = _connections.erase(it);
   }
-  if (token.size() != length) {
-    throw std::runtime_error("Data length mismatch");
+}
+
+bool Server::_has_pending_output() const {
+  for (const auto& [fd, connection] : _connections) {
+    if (connection.output_offset < connection.output.size()) {
+      return true;
+    }
   }
-  _request.command = static_cast<ScoreHiveCommand>(command);
-  _request.length = length;
-  _request.data = token;
+  return false;
 }
 
-void Server::_handle_request() {
-  switch (_request.command) {
+Task Server::_handle_request(RequestContext& context) {
+  switch (context.request.command) {
     case ScoreHiveCommand::GET_ANSWERS:
-      _handle_get_answers();
+      _handle_get_answers(context);
       break;
     case ScoreHiveCommand::SET_ANSWERS:
-      _handle_set_answers();
+      _handle_set_answers(context);
       break;
     case ScoreHiveCommand::REVIEW:
-      _handle_review();
+      co_await _handle_review(context);
       break;
     case ScoreHiveCommand::ECHO:
-      _handle_echo();
+      _handle_echo(context);
       break;
     case ScoreHiveCommand::SHUTDOWN:
-      _handle_shutdown();
+      _handle_shutdown(context);
+      break;
+    case ScoreHiveCommand::RANK:
+      _handle_rank(context);
+      break;
+    case ScoreHiveCommand::DRAIN:
+      _handle_drain(context);
+      break;
+    case ScoreHiveCommand::RECONFIGURE:
+      _handle_reconfigure(context);
+      break;
+    case ScoreHiveCommand::PATCH_ANSWERS:
+      co_await _handle_patch_answers(context);
+      break;
+    case ScoreHiveCommand::SIMILARITY:
+      co_await _handle_similarity(context);
       break;
     default:
-      _handle_bad_request();
+      _handle_bad_request(context);
       break;
   }
 }
 
-void Server::_handle_get_answers() {
-  auto data = AnswersManager::instance().save_to_json();
-  _response.code = ScoreHiveResponseCode::OK;
-  _response.length = data.size();
-  _response.data = data;
+void Server::_handle_get_answers(RequestContext& context) {
+  auto& manager = AnswersManager::instance();
+  auto answers = manager.snapshot();
+  auto& response = context.response;
+  if (context.request.data.empty()) {
+    response.data = manager.save_to_json(*answers);
+    response.code = ScoreHiveResponseCode::OK;
+    response.length = response.data.size();
+    return;
+  }
+  try {
+    auto query = json::parse(context.request.data);
+    if (!query.is_object()) {
+      throw std::runtime_error("Expected an object");
+    }
+    bool conditional = query.contains("version");
+    // A version of another epoch says nothing about these keys
+    auto known = query.value("epoch", u64{0}) == manager.epoch()
+                     ? query.value("version", u64{0})
+                     : 0;
+    bool modified = !conditional || known != answers->version;
+    bool full = known == 0 || known > answers->version;
+    std::string body;
+    if (query.contains("stage") || query.contains("exam_id")) {
+      std::optional<i32> stage;
+      if (query.contains("stage")) {
+        stage = query["stage"].get<i32>();
+      } else {
+        stage = answers->stage_of(query["exam_id"].get<std::string>());
+      }
+      auto key = stage ? answers->keys.find(*stage) : answers->keys.end();
+      if (key == answers->keys.end()) {
+        throw std::runtime_error("The stage has no answer key");
+      }
+      modified = !conditional || full || key->second->version > known;
+      body = ",\"answers\":";
+      JsonCodec::write_answers(std::array{&key->second->answers}, body,
+                               &answers->stage_names);
+    } else if (modified) {
+      // A client that is behind gets only the keys stored after its version
+      body = full ? ",\"full\":true,\"answers\":"
+                  : ",\"full\":false,\"answers\":";
+      body += full ? manager.save_to_json(*answers)
+                   : manager.save_changes(*answers, known);
+    }
+    response.data.clear();
+    if (modified) {
+      response.data = "{\"epoch\":" + std::to_string(manager.epoch()) +
+                      ",\"version\":" + std::to_string(answers->version) +
+                      body + "}";
+    }
+    response.code = modified ? ScoreHiveResponseCode::OK
+                             : ScoreHiveResponseCode::NOT_MODIFIED;
+    response.length = response.data.size();
+  } catch (std::exception& e) {
+    std::string message = "Get Answers Error: " + std::string(e.what());
+    spdlog::error(message);
+    response.code = ScoreHiveResponseCode::ERROR;
+    response.length = message.size();
+    response.data = message;
+  }
 }
 
-void Server::_handle_set_answers() {
-  auto data = json::parse(_request.data);
+void Server::_handle_set_answers(RequestContext& context) {
   try {
-    AnswersManager::instance().load_from_json(data);
+    auto data = json::parse(context.request.data);
+    auto& ingress = IngressGroup::instance();
+    if (ingress.count() == 1) {
+      AnswersManager::instance().load_from_json(data);
+    } else {
+      // Validate before the update reaches the other ingress ranks
+      if (data.is_object()) {
+        LetterFormat::read_keys(data);
+      } else {
+        std::ranges::for_each(data.get<std::vector<ExamAnswers>>(),
+                              AnswersManager::check_stage);
+      }
+      ingress.replicate_answers(data.dump());
+    }
   } catch (std::exception& e) {
     std::string message = "Set Answers Error: " + std::string(e.what());
     spdlog::error(message);
-    _response.code = ScoreHiveResponseCode::ERROR;
-    _response.length = message.size();
-    _response.data = message;
+    context.response.code = ScoreHiveResponseCode::ERROR;
+    context.response.length = message.size();
+    context.response.data = message;
     return;
   }
   std::string message = "Set Answers OK";
-  _response.code = ScoreHiveResponseCode::OK;
-  _response.length = message.size();
-  _response.data = message;
+  context.response.code = ScoreHiveResponseCode::OK;
+  context.response.length = message.size();
+  context.response.data = message;
 }
 
-void Server::_handle_review() {
-  auto exams_json = json::parse(_request.data);
+Task Server::_handle_patch_answers(RequestContext& context) {
   try {
+    auto data = json::parse(context.request.data);
+    auto lettered = data.is_object();
+    std::vector<i32> stages;
+    auto& ingress = IngressGroup::instance();
+    if (ingress.count() == 1) {
+      stages = AnswersManager::instance().patch_from_json(data);
+    } else {
+      // Validate before the patch reaches the other ingress ranks
+      std::vector<std::string> names;
+      if (lettered) {
+        for (auto& key : LetterFormat::read_keys(data)) {
+          names.push_back(std::move(key.exam_id));
+        }
+      } else {
+        for (const auto& key : data.get<std::vector<ExamAnswers>>()) {
+          AnswersManager::check_stage(key);
+          stages.push_back(key.stage);
+        }
+      }
+      ingress.replicate_answers(data.dump(), IngressMessage::PATCH_ANSWERS);
+      auto answers = AnswersManager::instance().snapshot();
+      for (const auto& name : names) {
+        stages.push_back(answers->stage_of(name).value_or(-1));
+      }
+    }
+    std::vector<MPIResult> results;
     auto& coordinator = MPICoordinator::instance();
-    coordinator.send_to_workers(exams_json, _mpi_size);
-    auto results = coordinator.receive_results_from_workers(_mpi_size);
-    auto msg = results.dump();
-    spdlog::info("Results from review: {}", msg);
-    _response.code = ScoreHiveResponseCode::OK;
-    _response.length = msg.size();
-    _response.data = msg;
+    if (coordinator.resident()) {
+      auto keys = AnswersManager::instance().serialize_for_mpi(stages);
+      coordinator.send_rescore(keys);
+      co_await _worker_replies();
+      results = coordinator.receive_results_from_workers();
+      ScoreIndex::instance().update(results);
+    }
+    std::string msg;
+    if (lettered) {
+      // Exams and stages named by letter sheets get their names back
+      auto answers = AnswersManager::instance().snapshot();
+      const auto& index = ScoreIndex::instance();
+      std::vector<AnswerSheet> sheets(results.size());
+      for (size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        sheets[i].student_id = index.student_name(result.stage, result.id_exam);
+        sheets[i].exam_id = answers->stage_names.name(result.stage);
+      }
+      JsonCodec::write_sheet_results(results, sheets, msg);
+    } else {
+      JsonCodec::write_results(results, msg);
+    }
+    SH_LOG_EVERY_MS(spdlog::level::info, 1000,
+                    "Answer patch of {} stages changed {} results",
+                    stages.size(), results.size());
+    context.response.code = ScoreHiveResponseCode::OK;
+    context.response.length = msg.size();
+    context.response.data = msg;
+  } catch (std::exception& e) {
+    std::string message = "Patch Answers Error: " + std::string(e.what());
+    spdlog::error(message);
+    context.response.code = ScoreHiveResponseCode::ERROR;
+    context.response.length = message.size();
+    context.response.data = message;
+  }
+}
+
+Task Server::_handle_review(RequestContext& context) {
+  std::vector<MPIExam> exams;
+  std::vector<AnswerSheet> sheets;
+  json exams_json;
+  bool decoded = false;
+  bool lettered = false;
+  try {
+    {
+      TraceScope span("parse");
+      decoded = JsonCodec::read_exams(context.request.data, exams);
+      if (!decoded) {
+        lettered = JsonCodec::read_sheets(context.request.data, sheets);
+      }
+      if (!decoded && !lettered) {
+        exams_json = json::parse(context.request.data);
+      }
+    }
+    if (!decoded && !lettered && exams_json.is_object() &&
+        !LetterFormat::is_sheets(exams_json)) {
+      co_await _handle_review_to_sink(context, exams_json);
+      co_return;
+    }
+    if (!decoded && !lettered && LetterFormat::is_sheets(exams_json)) {
+      sheets = LetterFormat::read_sheets(exams_json);
+      lettered = true;
+    }
+    if (lettered) {
+      exams = _sheet_exams(sheets, nullptr);
+      decoded = true;
+    }
+    auto& coordinator = MPICoordinator::instance();
+    auto exams_size = exams.size();
+    if (decoded) {
+      coordinator.send_to_workers(std::move(exams));
+    } else {
+      coordinator.send_to_workers(exams_json);
+    }
+    co_await _worker_replies();
+    auto results = coordinator.receive_results_from_workers();
+    if (lettered && results.size() != exams_size) {
+      throw std::runtime_error("Result count does not match the sheets");
+    }
+    if (lettered) {
+      // Sheets of an exam id with no key have no stage to be ranked in
+      std::vector<MPIResult> ranked;
+      std::ranges::copy_if(results, std::back_inserter(ranked),
+                           [](const MPIResult& result) {
+                             return result.stage > MAX_STAGE;
+                           });
+      ScoreIndex::instance().update(ranked);
+    } else {
+      ScoreIndex::instance().update(results);
+    }
+    std::string msg;
+    {
+      TraceScope span("encode");
+      if (lettered) {
+        JsonCodec::write_sheet_results(results, sheets, msg);
+      } else {
+        JsonCodec::write_results(results, msg);
+      }
+    }
+    SH_LOG_EVERY_MS(spdlog::level::info, 1000, "Review returned {} results",
+                    results.size());
+    SH_LOG_PAYLOAD("Results from review: {}", msg);
+    context.response.code = ScoreHiveResponseCode::OK;
+    context.response.length = msg.size();
+    context.response.data = msg;
   } catch (std::exception& e) {
     std::string message = "Review Error: " + std::string(e.what());
     spdlog::error(message);
-    _response.code = ScoreHiveResponseCode::ERROR;
-    _response.length = message.size();
-    _response.data = message;
+    context.response.code = ScoreHiveResponseCode::ERROR;
+    context.response.length = message.size();
+    context.response.data = message;
+  }
+}
+
+std::vector<MPIExam> Server::_sheet_exams(std::vector<AnswerSheet>& sheets,
+                                          IdTable* students) {
+  auto answers = AnswersManager::instance().snapshot();
+  auto& index = ScoreIndex::instance();
+  std::vector<MPIExam> exams(sheets.size());
+  for (size_t i = 0; i < sheets.size(); i++) {
+    auto stage = answers->stage_of(sheets[i].exam_id);
+    exams[i].stage = stage.value_or(-1);
+    if (students != nullptr) {
+      exams[i].id_exam = students->intern(sheets[i].student_id);
+    } else if (stage) {
+      exams[i].id_exam = index.intern_student(*stage, sheets[i].student_id);
+    } else {
+      // Not ranked, the results are answered by position
+      exams[i].id_exam = IdTable::FIRST_ID + static_cast<i32>(i);
+    }
+    exams[i].answers = std::move(sheets[i].answers);
   }
+  return exams;
 }
 
-void Server::_handle_echo() {
-  auto data = _request.data;
+Task Server::_handle_review_to_sink(RequestContext& context,
+                                   const json& job) {
+  try {
+    if (!job.contains("exams") || !job.contains("sink")) {
+      throw std::runtime_error("Expected exams and sink fields");
+    }
+    const auto& sink = job["sink"];
+    SinkTarget target;
+    target.directory = ResultSink::directory(
+        _config.sink_root, sink.at("path").get<std::string>());
+    if (sink.contains("job")) {
+      target.job = sink["job"].get<std::string>();
+    } else {
+      auto now = std::chrono::system_clock::now().time_since_epoch();
+      target.job =
+          "review-" +
+          std::to_string(
+              std::chrono::duration_cast<std::chrono::milliseconds>(now)
+                  .count());
+    }
+    if (target.job.empty() || target.job.find('/') != std::string::npos ||
+        target.job.find('\0') != std::string::npos) {
+      throw std::runtime_error("Invalid job name");
+    }
+    auto& coordinator = MPICoordinator::instance();
+    coordinator.send_to_workers(job["exams"], target);
+    co_await _worker_replies();
+    auto summaries = coordinator.receive_sink_summaries();
+    json files = json::array();
+    MPISinkSummary total{};
+    std::vector<i32> failed_ranks;
+    for (const auto& [rank, summary] : summaries) {
+      if (summary.rows < 0) {
+        failed_ranks.push_back(rank);
+        continue;
+      }
+      files.push_back({{"rank", rank},
+                       {"path", ResultSink::file_path(target, rank)},
+                       {"rows", summary.rows},
+                       {"bytes", summary.bytes}});
+      total.rows += summary.rows;
+      total.bytes += summary.bytes;
+      total.correct_answers += summary.correct_answers;
+      total.wrong_answers += summary.wrong_answers;
+      total.unscored_answers += summary.unscored_answers;
+      total.score_sum += summary.score_sum;
+    }
+    if (!failed_ranks.empty()) {
+      throw std::runtime_error("Workers " + json(failed_ranks).dump() +
+                               " failed to write their results");
+    }
+    json manifest = {
+        {"job", target.job},
+        {"format", SINK_FORMAT},
+        {"columns",
+         {{{"name", "stage"}, {"type", "i32"}},
+          {{"name", "id_exam"}, {"type", "i32"}},
+          {{"name", "correct_answers"}, {"type", "i32"}},
+          {{"name", "wrong_answers"}, {"type", "i32"}},
+          {{"name", "unscored_answers"}, {"type", "i32"}},
+          {{"name", "score"}, {"type", "f64"}}}},
+        {"files", files},
+        {"rows", total.rows},
+        {"bytes", total.bytes},
+        {"correct_answers", total.correct_answers},
+        {"wrong_answers", total.wrong_answers},
+        {"unscored_answers", total.unscored_answers},
+        {"mean_score", total.rows > 0 ? total.score_sum / total.rows : 0.0}};
+    auto msg = manifest.dump();
+    SH_LOG_EVERY_MS(spdlog::level::info, 1000,
+                    "Review job {} wrote {} results to {} files", target.job,
+                    total.rows, files.size());
+    context.response.code = ScoreHiveResponseCode::OK;
+    context.response.length = msg.size();
+    context.response.data = msg;
+  } catch (std::exception& e) {
+    std::string message = "Review Error: " + std::string(e.what());
+    spdlog::error(message);
+    context.response.code = ScoreHiveResponseCode::ERROR;
+    context.response.length = message.size();
+    context.response.data = message;
+  }
+}
+
+void Server::_handle_echo(RequestContext& context) {
+  auto data = context.request.data;
   data = "Echo " + data;
-  _response.code = ScoreHiveResponseCode::OK;
-  _response.length = data.size();
-  _response.data = data;
+  context.response.code = ScoreHiveResponseCode::OK;
+  context.response.length = data.size();
+  context.response.data = data;
 }
 
-void Server::_handle_shutdown() {
+void Server::_handle_shutdown(RequestContext& context) {
   _shutdown = true;
   std::string message = "Server received shutdown signal";
-  _response.code = ScoreHiveResponseCode::OK;
-  _response.length = message.size();
-  _response.data = message;
+  context.response.code = ScoreHiveResponseCode::OK;
+  context.response.length = message.size();
+  context.response.data = message;
   spdlog::info(message);
+  IngressGroup::instance().replicate_shutdown();
+  _shutdown_workers();
+}
+
+void Server::_handle_drain(RequestContext& context) {
+  _begin_drain("Drain requested");
+  std::string message = "Server is draining";
+  context.response.code = ScoreHiveResponseCode::OK;
+  context.response.length = message.size();
+  context.response.data = message;
+}
+
+json Server::_settings() const {
+  return {{"keep_alive", _config.keep_alive},
+          {"max_message_size", _config.max_message_size},
+          {"compression_min_bytes", _config.compression_min_bytes},
+          {"compression_level", _config.compression_level},
+          {"rma_chunk", RMAWorkQueue::instance().chunk()},
+          {"resident_exams", MPICoordinator::instance().resident()},
+          {"admission", _admission.config()},
+          {"coalescing", _coalescer.config()},
+          {"scaling", _scaler.config()}};
+}
+
+void Server::_handle_reconfigure(RequestContext& context) {
+  try {
+    auto settings = _settings();
+    if (!context.request.data.empty()) {
+      auto patch = json::parse(context.request.data);
+      if (!patch.is_object()) {
+        throw std::runtime_error("Settings must be an object");
+      }
+      // Reject typos instead of ignoring them
+      for (const auto& [key, value] : patch.items()) {
+        if (!settings.contains(key)) {
+          throw std::runtime_error("Unknown setting " + key);
+        }
+        if (settings[key].is_object()) {
+          for (const auto& [field, ignored] : value.items()) {
+            if (!settings[key].contains(field)) {
+              throw std::runtime_error("Unknown setting " + key + "." + field);
+            }
+          }
+        }
+      }
+      settings.merge_patch(patch);
+      // Convert everything before applying anything
+      auto keep_alive = settings["keep_alive"].get<bool>();
+      auto max_message_size = settings["max_message_size"].get<u32>();
+      auto min_bytes = settings["compression_min_bytes"].get<u32>();
+      auto level = settings["compression_level"].get<i32>();
+      auto rma_chunk = settings["rma_chunk"].get<i32>();
+      auto resident = settings["resident_exams"].get<bool>();
+      auto admission = settings["admission"].get<AdmissionConfig>();
+      auto coalescing = settings["coalescing"].get<CoalescingConfig>();
+      auto scaling = settings["scaling"].get<ScalingConfig>();
+      if (level < Z_NO_COMPRESSION || level > Z_BEST_COMPRESSION) {
+        throw std::runtime_error("compression_level must be between 0 and 9");
+      }
+      if (rma_chunk < 1) {
+        throw std::runtime_error("rma_chunk must be positive");
+      }
+      _config.keep_alive = keep_alive;
+      // Connections already open keep the limit of their parser
+      _config.max_message_size = max_message_size;
+      _config.compression_min_bytes = min_bytes;
+      _config.compression_level = level;
+      RMAWorkQueue::instance().set_chunk(rma_chunk);
+      MPICoordinator::instance().set_resident(resident);
+      _admission.reconfigure(admission);
+      _coalescer.reconfigure(coalescing);
+      _scaler.reconfigure(scaling);
+      spdlog::info("Settings changed: {}", patch.dump());
+    }
+    auto message = _settings().dump();
+    context.response.code = ScoreHiveResponseCode::OK;
+    context.response.length = message.size();
+    context.response.data = message;
+  } catch (std::exception& e) {
+    std::string message = "Reconfigure Error: " + std::string(e.what());
+    spdlog::error(message);
+    context.response.code = ScoreHiveResponseCode::ERROR;
+    context.response.length = message.size();
+    context.response.data = message;
+  }
+}
+
+void Server::_shutdown_workers() {
+  _shutdown = true;
   auto& coordinator = MPICoordinator::instance();
-  coordinator.send_shutdown_signal(_mpi_size);
-}
-
-void Server::_handle_bad_request() {
-  _response.code = ScoreHiveResponseCode::ERROR;
-  _response.length = 0;
-  _response.data = "Bad Request";
-}
-
-std::string Server::_parse_response() {
-  std::string response = "SH";
-  response += " ";
-  response += std::to_string(static_cast<u8>(_response.code));
-  response += " ";
-  response += std::to_string(_response.length);
-  response += " ";
-  response += _response.data;
-  response += "$\r\n";
-  return response;
-}
\ No newline at end of file
+  coordinator.send_shutdown_signal();
+}
+
+void Server::_handle_rank(RequestContext& context) {
+  try {
+    auto query = json::parse(context.request.data);
+    const auto& index = ScoreIndex::instance();
+    // Named stages and their students are asked and answered by name
+    std::optional<std::string> exam_id;
+    i32 stage = 0;
+    if (query.contains("exam_id")) {
+      exam_id = query["exam_id"].get<std::string>();
+      auto answers = AnswersManager::instance().snapshot();
+      stage = answers->stage_of(*exam_id).value_or(-1);
+    } else if (query.contains("stage")) {
+      stage = query["stage"];
+    } else {
+      throw std::runtime_error("Missing stage");
+    }
+    auto stage_name = exam_id ? *exam_id : std::to_string(stage);
+    auto to_json = [&](const MPIResult& result) {
+      if (!exam_id) {
+        return json(result);
+      }
+      return json{
+          {"correct_answers", result.correct_answers},
+          {"exam_id", *exam_id},
+          {"score", result.score},
+          {"student_id", index.student_name(result.stage, result.id_exam)},
+          {"unscored_answers", result.unscored_answers},
+          {"wrong_answers", result.wrong_answers}};
+    };
+    json answer = {{"total", index.size(stage)}};
+    if (exam_id) {
+      answer["exam_id"] = *exam_id;
+    } else {
+      answer["stage"] = stage;
+    }
+    if (query.contains("top_k")) {
+      answer["results"] = json::array();
+      for (const auto& result :
+           index.top(stage, query["top_k"].get<size_t>())) {
+        answer["results"].push_back(to_json(result));
+      }
+    } else if (query.contains("id_exam") || query.contains("student_id")) {
+      std::optional<RankedResult> ranked;
+      std::string exam;
+      if (query.contains("student_id")) {
+        exam = query["student_id"].get<std::string>();
+        auto id_exam = index.find_student(stage, exam);
+        if (id_exam) {
+          ranked = index.rank_of(stage, *id_exam);
+        }
+      } else {
+        i32 id_exam = query["id_exam"];
+        exam = std::to_string(id_exam);
+        ranked = index.rank_of(stage, id_exam);
+      }
+      if (!ranked) {
+        throw std::runtime_error("Exam " + exam + " is not ranked in stage " +
+                                 stage_name);
+      }
+      answer["rank"] = ranked->rank;
+      answer["position"] = ranked->position;
+      answer["result"] = to_json(ranked->result);
+    } else if (query.contains("percentile")) {
+      double percentile = query["percentile"];
+      auto result = index.at_percentile(stage, percentile);
+      if (!result) {
+        throw std::runtime_error("Stage " + stage_name + " has no results");
+      }
+      answer["percentile"] = percentile;
+      answer["score"] = result->score;
+      answer["result"] = to_json(*result);
+    } else {
+      throw std::runtime_error(
+          "Expected one of top_k, id_exam, student_id or percentile");
+    }
+    auto msg = answer.dump();
+    context.response.code = ScoreHiveResponseCode::OK;
+    context.response.length = msg.size();
+    context.response.data = msg;
+  } catch (std::exception& e) {
+    std::string message = "Rank Error: " + std::string(e.what());
+    spdlog::error(message);
+    context.response.code = ScoreHiveResponseCode::ERROR;
+    context.response.length = message.size();
+    context.response.data = message;
+  }
+}
+
+Task Server::_handle_similarity(RequestContext& context) {
+  try {
+    std::vector<MPIExam> exams;
+    std::vector<AnswerSheet> sheets;
+    json query;
+    bool lettered = false;
+    i32 top_k = 100;
+    i32 min_wrong = 1;
+    {
+      TraceScope span("parse");
+      // The fast readers would skip the options of {"exams", "top_k", ...}
+      const auto& data = context.request.data;
+      auto first = data.find_first_not_of(" \t\r\n");
+      bool array = first != std::string::npos && data[first] == '[';
+      bool decoded = array && JsonCodec::read_exams(data, exams);
+      if (!decoded && array) {
+        lettered = JsonCodec::read_sheets(data, sheets);
+      }
+      if (!decoded && !lettered) {
+        query = json::parse(data);
+      }
+    }
+    if (query.is_object()) {
+      top_k = query.value("top_k", top_k);
+      min_wrong = query.value("min_wrong", min_wrong);
+      if (top_k <= 0) {
+        throw std::runtime_error("top_k must be positive");
+      }
+      query = query.at("exams");
+    }
+    if (!query.is_null()) {
+      if (LetterFormat::is_sheets(query)) {
+        sheets = LetterFormat::read_sheets(query);
+        lettered = true;
+      } else {
+        exams = exams_from_json(query);
+      }
+    }
+    IdTable students;
+    if (lettered) {
+      exams = _sheet_exams(sheets, &students);
+    }
+    auto& coordinator = MPICoordinator::instance();
+    coordinator.send_similarity(exams, top_k);
+    co_await _worker_replies();
+    auto pairs = coordinator.receive_similar_pairs();
+    SimilarityScan::top(pairs, top_k);
+    std::erase_if(pairs, [min_wrong](const MPISimilarPair& pair) {
+      return pair.matching_wrong < min_wrong;
+    });
+    json answer = json::array();
+    {
+      TraceScope span("encode");
+      auto snapshot = AnswersManager::instance().snapshot();
+      for (const auto& pair : pairs) {
+        json entry = {{"matching_wrong", pair.matching_wrong},
+                      {"matching_answers", pair.matching_answers}};
+        if (lettered) {
+          entry["exam_id"] = snapshot->stage_names.name(pair.stage);
+          entry["student_id_a"] = students.name(pair.id_exam_a);
+          entry["student_id_b"] = students.name(pair.id_exam_b);
+        } else {
+          entry["stage"] = pair.stage;
+          entry["id_exam_a"] = pair.id_exam_a;
+          entry["id_exam_b"] = pair.id_exam_b;
+        }
+        answer.push_back(std::move(entry));
+      }
+    }
+    auto msg = answer.dump();
+    SH_LOG_EVERY_MS(spdlog::level::info, 1000,
+                    "Similarity compared {} exams, {} pairs flagged",
+                    exams.size(), pairs.size());
+    context.response.code = ScoreHiveResponseCode::OK;
+    context.response.length = msg.size();
+    context.response.data = msg;
+  } catch (std::exception& e) {
+    std::string message = "Similarity Error: " + std::string(e.what());
+    spdlog::error(message);
+    context.response.code = ScoreHiveResponseCode::ERROR;
+    context.response.length = message.size();
+    context.response.data = message;
+  }
+}
+
+void Server::_handle_bad_request(RequestContext& context) {
+  context.response.code = ScoreHiveResponseCode::ERROR;
+  context.response.length = 0;
+  context.response.data = "Bad Request";
+}
+
+bool Server::_compress_response(ScoreHiveResponse& response) {
+  // The flag only applies to the response being formatted
+  bool compress = std::exchange(response.compressed, false) &&
+                  response.data.size() >= _config.compression_min_bytes;
+  if (compress) {
+    response.data =
+        Deflater::compress(response.data, _config.compression_level);
+    response.length = response.data.size();
+  }
+  return compress;
+}
+
+std::string Server::_parse_response(ScoreHiveResponse& response) {
+  response.http_status = 0;
+  bool compress = _compress_response(response);
+  std::string message = "SH";
+  message += " ";
+  message += std::to_string(static_cast<u8>(response.code));
+  if (compress) {
+    message += "z";
+  }
+  message += " ";
+  message += std::to_string(response.length);
+  message += " ";
+  message += response.data;
+  message += "$\r\n";
+  return message;
+}
+
+std::string Server::_http_response(ScoreHiveResponse& response,
+                                  std::string_view allow, bool last) {
+  auto status = std::exchange(response.http_status, 0);
+  if (status == 0) {
+    status = response.code == ScoreHiveResponseCode::OK             ? 200
+             : response.code == ScoreHiveResponseCode::NOT_MODIFIED ? 304
+                                                                    : 400;
+  }
+  // Bodies of the handlers are JSON documents or plain messages
+  auto first = response.data.empty() ? '\0' : response.data.front();
+  bool is_json = status == 200 && (first == '[' || first == '{');
+  bool compress = _compress_response(response);
+  std::string message = "HTTP/1.1 ";
+  message += std::to_string(status);
+  message += " ";
+  message += HttpApi::reason(status);
+  if (status != 304) {
+    message += "\r\nContent-Type: ";
+    message += is_json ? "application/json" : "text/plain; charset=utf-8";
+    message += "\r\nContent-Length: ";
+    message += std::to_string(response.data.size());
+  }
+  if (compress) {
+    message += "\r\nContent-Encoding: deflate";
+  }
+  if (!_config.http_allow_origin.empty()) {
+    message += "\r\nAccess-Control-Allow-Origin: ";
+    message += _config.http_allow_origin;
+  }
+  if (!allow.empty()) {
+    message += status == 204 ? "\r\nAccess-Control-Allow-Methods: "
+                             : "\r\nAllow: ";
+    message += allow;
+  }
+  if (status == 204) {
+    message += "\r\nAccess-Control-Allow-Headers: Content-Type";
+    message += "\r\nAccess-Control-Max-Age: 600";
+  }
+  if (status == 503) {
+    message += "\r\nRetry-After: 1";
+  }
+  // The last response before the server closes the connection says so
+  if (last) {
+    message += "\r\nConnection: close";
+  }
+  message += "\r\n\r\n";
+  message += response.data;
+  return message;
+}
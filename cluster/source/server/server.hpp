@@ -3,19 +3,52 @@
 #define SERVER_HPP
 
 #include <array>
+#include <chrono>
+#include <coroutine>
+#include <ctime>
+#include <deque>
+#include <domain/coordinator.hpp>
+#include <domain/ids.hpp>
+#include <domain/letters.hpp>
 #include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <server/admission.hpp>
+#include <server/capture.hpp>
+#include <server/coalescer.hpp>
+#include <server/http.hpp>
+#include <server/parser.hpp>
 #include <server/protocol.hpp>
+#include <server/scaler.hpp>
+#include <server/task.hpp>
 #include <string>
+#include <string_view>
 #include <system/aliases.hpp>
 
+using json = nlohmann::json;
+
 /**
  * @brief Server configuration
  */
 struct ServerConfig {
-  u16 port = 8080;  /** Port to listen on */
-  u16 backlog = 10; /** Backlog for the listen socket */
+  u16 port = 8080;         /** Port to listen on */
+  u16 http_port = 0;       /** Port of the HTTP listener, 0 disables it */
+  bool reuse_port = false; /** Share the port with other ingress ranks */
+  u16 backlog = 10;        /** Backlog for the listen socket */
   u32 max_message_size =
       1024 * 1024 * 10; /** Maximum message size (1MB default) */
+  bool keep_alive = false;     /** Serve several requests per connection */
+  u32 compression_min_bytes = 1024; /** Smaller responses go uncompressed */
+  i32 compression_level = 1;        /** zlib level of compressed responses */
+  std::string handoff_path; /** Unix socket to pass the listener on */
+  u32 drain_grace_ms = 200; /** Wait for requests of open connections */
+  std::string http_allow_origin; /** CORS origin, empty to omit it */
+  std::string capture_path; /** Log of the SH frames, empty disables it */
+  std::string sink_root;    /** Root of result sinks, empty disables them */
+  AdmissionConfig admission;   /** Admission control limits */
+  CoalescingConfig coalescing; /** Micro-batching of small reviews */
+  ScalingConfig scaling;       /** Elastic worker pool */
 };
 
 /**
@@ -32,9 +65,24 @@ class Server {
   /**
    * @brief Start the server
    * @note This function will block until the server is shutdown
-   * @details Starts a loop that accepts client connections and handles requests
-   *           until the server is shutdown. this server only handles one client
-   *           at a time.
+   * @details Starts an event loop that accepts client connections, reads
+   *           their requests and handles them until the server is shutdown.
+   *           Every complete request goes through the admission controller;
+   *           requests over budget get a "busy" error right away and the
+   *           admitted ones are dispatched one at a time.
+   *           Each dispatched request is served by a coroutine, whose frame
+   *           holds its state: it is parsed and handled, and suspends while
+   *           the workers compute. Meanwhile the loop keeps reading and
+   *           writing every connection and serves the requests that do not
+   *           need the workers (GET_ANSWERS, ECHO and RANK) of the other
+   *           connections.
+   *           If `handoff_path` is set, the listening sockets are taken from
+   *           the process serving that Unix socket, which then drains, so a
+   *           new image can replace a running one without refusing clients.
+   *           If `http_port` is set, the same requests are also accepted as
+   *           HTTP/1.1 on that port.
+   * @see HttpApi
+   * @see AdmissionController
    */
   void start();
 
@@ -53,81 +101,413 @@ class Server {
    */
   void _handle_error();
 
+  /**
+   * @brief State of a client connection
+   */
+  struct Connection {
+    FrameParser parser;       /** Parser of the next frame in input */
+    std::string input;        /** Bytes received and not parsed yet */
+    std::string output;       /** Response bytes not sent yet */
+    size_t output_offset = 0; /** Bytes of output already sent */
+    std::deque<std::optional<std::string>>
+        responses;            /** Responses owed, in request order */
+    u64 next_slot = 0;        /** Response slot of the next request */
+    bool reading = true;      /** Whether more requests are accepted */
+    bool closing = false;     /** Close once every request is answered */
+    bool broken = false;      /** Socket failed, close without answering */
+    i64 frame_begin_us = 0;   /** Arrival of the frame being parsed */
+    bool http = false;        /** Accepted on the HTTP listener */
+    HttpParser http_parser;   /** Parser of the next HTTP request */
+    u32 capture_id = 0;       /** Number of the connection in the capture */
+    u32 serving = 0;          /** Dispatched requests not answered yet */
+
+    /**
+     * @brief Whether part of a request has been received
+     */
+    bool receiving() const {
+      return http ? http_parser.started() : parser.started();
+    }
+  };
+
+  /**
+   * @brief State of a request being served, kept in the frame of its
+   *        coroutine
+   */
+  struct RequestContext {
+    ScoreHiveRequest request;
+    ScoreHiveResponse response;
+  };
+
+  /**
+   * @brief Awaitable of a request that sent work to the workers
+   * @details Suspends the request until every worker has started replying,
+   *          so gathering the replies does not block the event loop while
+   *          they compute. The trace of the request is current again when
+   *          it resumes.
+   */
+  struct WorkerReplies {
+    Server& server;
+    i32 trace; /** Trace of the request */
+
+    bool await_ready() const;
+    void await_suspend(std::coroutine_handle<> waiter);
+    void await_resume() const;
+  };
+
+  /**
+   * @brief Wait for the replies of the work just sent to the workers
+   */
+  WorkerReplies _worker_replies();
+
+  /**
+   * @brief Run the coroutine of a request until it suspends, and keep it
+   *        until it is done
+   */
+  void _start(Task task);
+
+  /**
+   * @brief Resume the request waiting for the workers if they replied, and
+   *        drop the coroutines that are done
+   */
+  void _resume_tasks();
+
+  /**
+   * @brief Accept every pending client connection of a listener
+   */
+  void _accept_clients(i32 listen_fd);
+
   /**
    * @brief Read data from the client
-   * @return True if the read was successful, false otherwise
+   * @details Reads what is available without blocking and admits the
+   *          complete requests found in the input.
+   */
+  void _read_client(i32 fd, Connection& connection);
+
+  /**
+   * @brief Split the input of a connection into requests and admit them
+   */
+  void _extract_frames(i32 fd, Connection& connection);
+
+  /**
+   * @brief Split the input of an HTTP connection into requests and admit
+   *        them
+   * @details Each routed request becomes the SH request of its endpoint, so
+   *          it goes through the same admission, coalescing and handlers.
+   */
+  void _extract_http_requests(i32 fd, Connection& connection);
+
+  /**
+   * @brief Admit a request, or answer right away if the server is draining
+   *        or busy
+   * @param slot Response slot the request took with _take_slot, so its
+   *        answer is sent after those of the earlier requests either way
+   */
+  void _admit(i32 fd, u64 slot, ScoreHiveRequest&& request);
+
+  /**
+   * @brief Take the response slot of the next request of a connection
+   */
+  u64 _take_slot(Connection& connection);
+
+  /**
+   * @brief Send the pending output of a connection without blocking
+   */
+  void _write_client(i32 fd);
+
+  /**
+   * @brief Handle the next admitted request, if any
+   * @details Small reviews are held for the coalescing window and then
+   *          served together as a single batch. While a request waits for
+   *          the workers only the requests that do not need them are
+   *          dispatched.
+   * @see ReviewCoalescer
+   */
+  void _dispatch_next();
+
+  /**
+   * @brief Start serving a request
+   */
+  void _dispatch(PendingRequest&& pending);
+
+  /**
+   * @brief Spawn or retire a worker if the backlog calls for it
+   * @see WorkerScaler
+   */
+  void _scale_workers();
+
+  /**
+   * @brief Handle an admitted request and queue its response
+   */
+  Task _serve(PendingRequest pending);
+
+  /**
+   * @brief Handle several small reviews as one MPI batch
+   * @details The exams of every review are sent to the workers together and
+   *          the results are split back in request order.
+   */
+  Task _serve_coalesced(std::vector<PendingRequest> batch);
+
+  /**
+   * @brief Release the budget of a request and queue its response
+   */
+  void _finish(const AdmissionTicket& ticket, u64 elapsed_us,
+               ScoreHiveResponse& response);
+
+  /**
+   * @brief Whether a request can join a coalesced review batch
+   */
+  bool _is_coalescable(const PendingRequest& pending) const;
+
+  /**
+   * @brief Whether a request can be served while another one waits for the
+   *        workers: it does not use them and its connection has no request
+   *        being served
+   */
+  bool _is_local(const PendingRequest& pending) const;
+
+  /**
+   * @brief Time the event loop can wait for socket events
    */
-  bool _read();
+  timespec _poll_timeout() const;
 
   /**
-   * @brief Parse the request
-   * @param message The message to parse
-   * @details This function will parse the request and set the request fields.
+   * @brief Fill the response slot of a request
+   * @param allow Methods of an HTTP 405 or preflight response
+   * @details The responses of the connection are moved to its output as
+   *          long as they are ready from the oldest one, so they are sent in
+   *          request order even when they are answered out of it.
    */
-  void _parse_request(const std::string& message);
+  void _queue_response(i32 fd, u64 slot, ScoreHiveResponse& response,
+                       std::string_view allow = {});
+
+  /**
+   * @brief Answer with an error and close the connection afterwards
+   * @param http_status Status of the answer on HTTP connections
+   * @details The error takes the slot of the request that could not be
+   *          read, after the responses still owed.
+   */
+  void _reply_error(i32 fd, const std::string& message, u16 http_status = 400);
+
+  /**
+   * @brief Answer every admitted request that was not dispatched with an error
+   */
+  void _reject_pending(const std::string& message);
+
+  /**
+   * @brief Close the connections that are done or failed
+   */
+  void _close_finished_clients();
+
+  /**
+   * @brief Whether some connection still has response bytes to send
+   */
+  bool _has_pending_output() const;
 
   /**
    * @brief Parse the response
    * @return The response message
    * @details This function will parse the response and set the response fields.
    */
-  std::string _parse_response();
+  std::string _parse_response(ScoreHiveResponse& response);
+
+  /**
+   * @brief Format a response as an HTTP response
+   * @details The status is taken from the response, or derived from its
+   *          code.
+   * @param last Whether it is the last response before the server closes
+   *        the connection, which it then announces
+   */
+  std::string _http_response(ScoreHiveResponse& response,
+                             std::string_view allow, bool last);
+
+  /**
+   * @brief Compress the data of a response if it was asked for and is large
+   *        enough
+   * @return Whether the data was compressed
+   */
+  bool _compress_response(ScoreHiveResponse& response);
 
   /**
    * @brief Handle the request
    * @details This function will handle the request and set the response fields.
    *          It will call the appropriate handler for the request.
    */
-  void _handle_request();
+  Task _handle_request(RequestContext& context);
 
   /**
    * @brief Handle the GET_ANSWERS request
    * @details This function will handle the GET_ANSWERS request. It will return
    *          all the answers in the AnswersManager.
    */
-  void _handle_get_answers();
+  void _handle_get_answers(RequestContext& context);
 
   /**
    * @brief Handle the SET_ANSWERS request
    * @details This function will handle the SET_ANSWERS request. It will set the
    *          answers in the AnswersManager (override).
    */
-  void _handle_set_answers();
+  void _handle_set_answers(RequestContext& context);
+
+  /**
+   * @brief Handle the PATCH_ANSWERS request
+   * @details Merges the changed questions into the keys and, if the workers
+   *          keep their exams, has them re-score the exams of the touched
+   *          stages and answers the results that changed.
+   */
+  Task _handle_patch_answers(RequestContext& context);
 
   /**
    * @brief Handle the REVIEW request
    * @details This function will handle the REVIEW request. It will send the
    *          exams to the workers for review.
    */
-  void _handle_review();
+  Task _handle_review(RequestContext& context);
+
+  /**
+   * @brief Handle a REVIEW request with a result sink
+   * @param job The request body: {"exams": [...], "sink": {"path", "job"}},
+   *        where `path` is relative to `sink_root`
+   * @details The workers append their results to a columnar file in the sink
+   *          directory. The response only carries the manifest of the files
+   *          and the summary counts.
+   * @see ResultSink
+   */
+  Task _handle_review_to_sink(RequestContext& context, const json& job);
 
   /**
    * @brief Handle the ECHO request
    * @details This function will handle the ECHO request. It will return the
    *          message received.
    */
-  void _handle_echo();
+  void _handle_echo(RequestContext& context);
 
   /**
    * @brief Handle the SHUTDOWN request
    * @details This function will handle the SHUTDOWN request. It will set the
    *          shutdown flag to true and send a shutdown signal to the workers.
    */
-  void _handle_shutdown();
+  void _handle_shutdown(RequestContext& context);
+
+  /**
+   * @brief Stop accepting requests and send the shutdown signal to the
+   *        workers of this ingress rank
+   */
+  void _shutdown_workers();
+
+  /**
+   * @brief Start tracing a request: make it current and record the time it
+   *        waited for dispatch
+   */
+  void _trace_dispatch(const PendingRequest& pending);
+
+  /**
+   * @brief Handle the DRAIN request
+   * @details Stops accepting connections and, after `drain_grace_ms`,
+   *          REVIEWs; the server shuts down once the admitted requests are
+   *          answered.
+   */
+  void _handle_drain(RequestContext& context);
+
+  /**
+   * @brief Handle the RECONFIGURE request
+   * @details Applies the settings of the body, a JSON object shaped like the
+   *          response, and answers the settings in effect. Only this
+   *          ingress rank is reconfigured.
+   */
+  void _handle_reconfigure(RequestContext& context);
+
+  /**
+   * @brief Runtime settings as JSON
+   */
+  json _settings() const;
+
+  /**
+   * @brief Stop accepting connections and new reviews
+   */
+  void _begin_drain(const std::string& reason);
+
+  /**
+   * @brief Whether every admitted request has been answered and no open
+   *        connection is still sending one
+   */
+  bool _drained() const;
+
+  /**
+   * @brief Create, bind and listen on a TCP socket
+   * @return The socket
+   */
+  i32 _open_listener(u16 port);
+
+  /**
+   * @brief Receive the listening sockets from the process serving
+   *        `handoff_path`
+   * @return Whether the SH listener was received; the HTTP one may not be
+   */
+  bool _take_over_listeners();
+
+  /**
+   * @brief Serve `handoff_path` so a new process can take the listener
+   */
+  void _open_handoff();
+
+  /**
+   * @brief Pass the listening sockets to the process connected to
+   *        `handoff_path` and drain
+   */
+  void _hand_off_listeners();
+
+  /**
+   * @brief Handle the RANK request
+   * @details This function will handle the RANK request. It will answer a
+   *          top-K, rank of an exam or percentile query over the latest
+   *          results of a stage.
+   * @see ScoreIndex
+   */
+  void _handle_rank(RequestContext& context);
+
+  /**
+   * @brief Handle the SIMILARITY request
+   * @details This function will handle the SIMILARITY request. It will have
+   *          the workers compare every pair of exams of a stage and answer
+   *          the `top_k` pairs sharing the most wrong answers.
+   * @see SimilarityScan
+   */
+  Task _handle_similarity(RequestContext& context);
+
+  /**
+   * @brief Numeric exams of letter sheets
+   * @param students Table the student ids are interned in; if null, those
+   *        of a named stage are interned in the ScoreIndex that ranks their
+   *        results and the others are only numbered
+   * @details The exam id names the stage of its key. The answers are moved
+   *          out of the sheets.
+   */
+  std::vector<MPIExam> _sheet_exams(std::vector<AnswerSheet>& sheets,
+                                    IdTable* students);
 
   /**
    * @brief Handle a bad request
    * @details This function will handle a bad request. It will set the response
    *          code to BAD_REQUEST and the response data to the error message.
    */
-  void _handle_bad_request();
+  void _handle_bad_request(RequestContext& context);
 
-  i32 _client_socket_fd;       /** Client socket file descriptor */
-  ServerConfig _config;        /** Server configuration */
-  ScoreHiveRequest _request;   /** Request */
-  ScoreHiveResponse _response; /** Response */
-  i32 _mpi_size;               /** MPI size */
-  bool _shutdown = false;      /** Shutdown flag */
+  i32 _listen_fd = -1;                    /** Listening socket */
+  i32 _http_listen_fd = -1;               /** HTTP listening socket */
+  i32 _handoff_fd = -1;                   /** Listener hand-off socket */
+  std::map<i32, Connection> _connections; /** Open client connections */
+  ServerConfig _config;                   /** Server configuration */
+  AdmissionController _admission;         /** Admission controller */
+  ReviewCoalescer _coalescer;             /** Review micro-batching window */
+  WorkerScaler _scaler;                   /** Elastic worker pool policy */
+  std::unique_ptr<FrameCapture> _capture; /** Frame capture, if enabled */
+  std::optional<std::chrono::steady_clock::time_point>
+      _dispatch_deadline; /** End of the current coalescing window */
+  std::vector<Task> _tasks;               /** Requests being served */
+  std::coroutine_handle<> _replies_waiter; /** Request awaiting the workers */
+  bool _shutdown = false;                 /** Shutdown flag */
+  bool _draining = false;                 /** Drain flag */
+  std::chrono::steady_clock::time_point _drain_started; /** Drain start */
 };
 
 #endif  // SERVER_HPP
\ No newline at end of file
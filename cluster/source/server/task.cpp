@@ -0,0 +1,45 @@
+#include "task.hpp"
+#include <new>
+
+FramePool& FramePool::instance() {
+  static FramePool pool;
+  return pool;
+}
+
+FramePool::~FramePool() {
+  for (auto& frames : _free) {
+    for (auto* frame : frames) {
+      ::operator delete(frame);
+    }
+  }
+}
+
+void* FramePool::allocate(size_t size) {
+  auto blocks = (size + BLOCK_BYTES - 1) / BLOCK_BYTES;
+  if (blocks < _free.size() && !_free[blocks].empty()) {
+    auto* frame = _free[blocks].back();
+    _free[blocks].pop_back();
+    return frame;
+  }
+  return ::operator new(blocks * BLOCK_BYTES);
+}
+
+void FramePool::release(void* frame, size_t size) {
+  auto blocks = (size + BLOCK_BYTES - 1) / BLOCK_BYTES;
+  if (blocks >= _free.size()) {
+    _free.resize(blocks + 1);
+  }
+  if (_free[blocks].size() >= MAX_CACHED) {
+    ::operator delete(frame);
+    return;
+  }
+  _free[blocks].push_back(frame);
+}
+
+size_t FramePool::cached() const {
+  size_t frames = 0;
+  for (const auto& list : _free) {
+    frames += list.size();
+  }
+  return frames;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#ifndef TASK_HPP
+#define TASK_HPP
+
+#include <coroutine>
+#include <exception>
+#include <system/aliases.hpp>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Free lists of coroutine frames
+ * @details Frames are rounded up to BLOCK_BYTES and, once released, kept on
+ *          the free list of their size for the next coroutine of the same
+ *          handler, so a request in flight costs no heap allocation once the
+ *          server is warm. Each list keeps at most MAX_CACHED frames.
+ *          Only the event loop creates and destroys frames; the pool is not
+ *          thread safe.
+ */
+class FramePool {
+ public:
+  static constexpr size_t BLOCK_BYTES = 256;
+  static constexpr size_t MAX_CACHED = 1024;
+
+  static FramePool& instance();
+
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+  ~FramePool();
+
+  void* allocate(size_t size);
+  void release(void* frame, size_t size);
+
+  /**
+   * @brief Frames kept on the free lists
+   */
+  size_t cached() const;
+
+ private:
+  FramePool() = default;
+
+  std::vector<std::vector<void*>> _free; /** Free frames by size in blocks */
+};
+
+/**
+ * @brief Coroutine of a request, or of a step of one
+ * @details A task is lazy: it starts when it is awaited, and then resumes
+ *          the awaiting coroutine when it ends, or when the event loop calls
+ *          start() for the coroutine of a request. An exception that leaves
+ *          the coroutine is rethrown to the awaiting one. The frame belongs
+ *          to the Task object and is allocated from the FramePool.
+ */
+class Task {
+ public:
+  struct promise_type {
+    std::coroutine_handle<> continuation; /** Coroutine awaiting this one */
+    std::exception_ptr error;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      struct Resume {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<promise_type> done) noexcept {
+          auto next = done.promise().continuation;
+          return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+      };
+      return Resume{};
+    }
+    void return_void() {}
+    void unhandled_exception() { error = std::current_exception(); }
+
+    static void* operator new(size_t size) {
+      return FramePool::instance().allocate(size);
+    }
+    static void operator delete(void* frame, size_t size) {
+      FramePool::instance().release(frame, size);
+    }
+  };
+
+  Task(Task&& other) noexcept
+      : _handle(std::exchange(other._handle, nullptr)) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      _destroy();
+      _handle = std::exchange(other._handle, nullptr);
+    }
+    return *this;
+  }
+  ~Task() { _destroy(); }
+
+  /**
+   * @brief Run the coroutine until it first suspends
+   */
+  void start() { _handle.resume(); }
+
+  bool done() const { return !_handle || _handle.done(); }
+
+  /**
+   * @brief Rethrow the exception that ended the coroutine, if any
+   */
+  void rethrow() const {
+    if (_handle && _handle.promise().error) {
+      std::rethrow_exception(_handle.promise().error);
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+    _handle.promise().continuation = caller;
+    return _handle;
+  }
+  void await_resume() const { rethrow(); }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : _handle(handle) {}
+
+  void _destroy() {
+    if (_handle) {
+      _handle.destroy();
+    }
+  }
+
+  std::coroutine_handle<promise_type> _handle;
+};
+
+#endif  // TASK_HPP
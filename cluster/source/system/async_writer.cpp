@@ -0,0 +1,101 @@
+#include "async_writer.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+AsyncFileWriter::AsyncFileWriter(const std::string& path, size_t buffer_size,
+                                 size_t max_pending)
+    : _path(path), _buffer_size(buffer_size), _max_pending(max_pending) {
+  _fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (_fd == -1) {
+    throw std::runtime_error("Failed to open " + path + ": " +
+                             std::string(strerror(errno)));
+  }
+  _current.reserve(_buffer_size);
+  _thread = std::thread(&AsyncFileWriter::_run, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  {
+    std::unique_lock lock(_mutex);
+    if (!_current.empty()) {
+      _pending.push_back(std::move(_current));
+    }
+    _stop = true;
+  }
+  _work_ready.notify_one();
+  _thread.join();
+  close(_fd);
+}
+
+void AsyncFileWriter::write(std::string_view bytes) {
+  std::unique_lock lock(_mutex);
+  if (!_error.empty()) {
+    throw std::runtime_error(_error);
+  }
+  _accepted += bytes.size();
+  while (!bytes.empty()) {
+    auto room = _buffer_size - _current.size();
+    auto take = std::min(room, bytes.size());
+    _current.insert(_current.end(), bytes.begin(), bytes.begin() + take);
+    bytes.remove_prefix(take);
+    if (_current.size() == _buffer_size) {
+      _submit(lock);
+    }
+  }
+}
+
+void AsyncFileWriter::flush() {
+  std::unique_lock lock(_mutex);
+  if (!_current.empty()) {
+    _submit(lock);
+  }
+  _work_done.wait(lock, [this] { return _pending.empty() && !_writing; });
+  if (!_error.empty()) {
+    throw std::runtime_error(_error);
+  }
+}
+
+void AsyncFileWriter::_submit(std::unique_lock<std::mutex>& lock) {
+  // Backpressure: wait for the I/O thread when too many buffers are queued
+  _work_done.wait(lock, [this] { return _pending.size() < _max_pending; });
+  _pending.push_back(std::move(_current));
+  _current = std::vector<char>();
+  _current.reserve(_buffer_size);
+  _work_ready.notify_one();
+}
+
+void AsyncFileWriter::_run() {
+  std::unique_lock lock(_mutex);
+  while (true) {
+    _work_ready.wait(lock, [this] { return _stop || !_pending.empty(); });
+    if (_pending.empty()) {
+      return;  // stop requested and nothing left to write
+    }
+    auto chunk = std::move(_pending.front());
+    _pending.pop_front();
+    _writing = true;
+    lock.unlock();
+    std::string error;
+    size_t offset = 0;
+    while (offset < chunk.size()) {
+      auto written = ::write(_fd, chunk.data() + offset, chunk.size() - offset);
+      if (written == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        error = "Failed to write " + _path + ": " + strerror(errno);
+        break;
+      }
+      offset += written;
+    }
+    lock.lock();
+    _writing = false;
+    if (!error.empty() && _error.empty()) {
+      _error = error;
+    }
+    _work_done.notify_all();
+  }
+}
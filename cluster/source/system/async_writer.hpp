@@ -0,0 +1,81 @@
+#pragma once
+#ifndef ASYNC_WRITER_HPP
+#define ASYNC_WRITER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Append-only file writer backed by a background I/O thread
+ * @details Bytes are staged in a large in-memory buffer. Full buffers are
+ *          handed to the I/O thread, which issues one write call per buffer.
+ *          At most `max_pending` buffers wait in the queue; once it is full,
+ *          `write` blocks until the I/O thread catches up.
+ */
+class AsyncFileWriter {
+ public:
+  /**
+   * @brief Open (or create) the file in append mode and start the I/O thread
+   * @param path Path of the output file
+   * @param buffer_size Size of each staging buffer
+   * @param max_pending Maximum number of full buffers waiting to be written
+   * @throw std::runtime_error If the file cannot be opened
+   */
+  AsyncFileWriter(const std::string& path, size_t buffer_size = 4 << 20,
+                  size_t max_pending = 4);
+
+  /**
+   * @brief Flush the remaining bytes, stop the I/O thread and close the file
+   */
+  ~AsyncFileWriter();
+
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  /**
+   * @brief Append bytes to the file
+   * @throw std::runtime_error If a previous write failed
+   */
+  void write(std::string_view bytes);
+
+  /**
+   * @brief Hand the staged bytes to the I/O thread and wait until everything
+   *        queued so far is on disk
+   * @throw std::runtime_error If a write failed
+   */
+  void flush();
+
+  /**
+   * @brief Bytes accepted by `write` since the file was opened
+   */
+  u64 bytes_accepted() const { return _accepted; }
+
+  const std::string& path() const { return _path; }
+
+ private:
+  void _submit(std::unique_lock<std::mutex>& lock);
+  void _run();
+
+  std::string _path;
+  i32 _fd = -1;
+  size_t _buffer_size;
+  size_t _max_pending;
+  std::vector<char> _current;
+  std::deque<std::vector<char>> _pending;
+  std::mutex _mutex;
+  std::condition_variable _work_ready;
+  std::condition_variable _work_done;
+  bool _writing = false;
+  bool _stop = false;
+  std::string _error;
+  u64 _accepted = 0;
+  std::thread _thread;
+};
+
+#endif  // ASYNC_WRITER_HPP
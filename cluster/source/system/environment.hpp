@@ -2,10 +2,12 @@
 #ifndef ENVIRONMENT_HPP
 #define ENVIRONMENT_HPP
 
+#include <charconv>
 #include <map>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 /**
@@ -27,6 +29,32 @@ class Environment {
    */
   static std::optional<std::string> get(const std::string& key);
 
+  /**
+   * @brief Get an environment variable as a number or a flag
+   * @param key The key of the environment variable
+   * @param fallback Value returned if the environment variable is not set
+   * @throw std::runtime_error If the value is not a valid T
+   * @details Flags are true for "1" and "true".
+   */
+  template <typename T>
+  static T get_or(const std::string& key, T fallback) {
+    auto value = get(key);
+    if (!value) {
+      return fallback;
+    }
+    if constexpr (std::is_same_v<T, bool>) {
+      return *value == "1" || *value == "true";
+    } else {
+      T parsed{};
+      const auto* end = value->data() + value->size();
+      auto [ptr, ec] = std::from_chars(value->data(), end, parsed);
+      if (ec != std::errc() || ptr != end) {
+        throw std::runtime_error("Invalid value for " + key + ": " + *value);
+      }
+      return parsed;
+    }
+  }
+
  private:
   /**
    * @brief The environment variables
@@ -2,10 +2,64 @@
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
 
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <optional>
+#include <system/aliases.hpp>
 #include <system/environment.hpp>
 
+/**
+ * @brief Per call-site rate limiter
+ * @details Lets at most one message through every `interval_ms`. The calls
+ *          dropped in between are counted and reported with the next message
+ *          that goes through.
+ */
+class RateLimiter {
+ public:
+  explicit RateLimiter(i64 interval_ms) : _interval_ns(interval_ms * 1000000) {}
+
+  /**
+   * @brief Try to take the slot of the current interval
+   * @return The number of calls suppressed since the last accepted one, or
+   *         std::nullopt if this call must be suppressed as well.
+   */
+  std::optional<u64> acquire() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto next = _next_ns.load(std::memory_order_relaxed);
+    if (now < next || !_next_ns.compare_exchange_strong(
+                          next, now + _interval_ns, std::memory_order_relaxed)) {
+      _suppressed.fetch_add(1, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+    return _suppressed.exchange(0, std::memory_order_relaxed);
+  }
+
+ private:
+  i64 _interval_ns;
+  std::atomic<i64> _next_ns = 0;
+  std::atomic<u64> _suppressed = 0;
+};
+
+/**
+ * @brief Per call-site sampler. Lets one call out of every `period` through.
+ */
+class Sampler {
+ public:
+  bool sample(u64 period) {
+    if (period == 0) {
+      return false;
+    }
+    return _calls.fetch_add(1, std::memory_order_relaxed) % period == 0;
+  }
+
+ private:
+  std::atomic<u64> _calls = 0;
+};
+
 /**
  * @brief Logger class
  * @details This class is used to initialize the logging system.
@@ -17,11 +71,33 @@ class Logger {
    * @details This function is used to initialize the logging system. It sets
    *          the pattern and the level of the logging. It also sets the flush
    *          time to 5 seconds.
+   *          Messages are formatted on the caller thread and written by a
+   *          background thread through a bounded queue:
+   *          - LOG_QUEUE_SIZE: queue capacity in messages (default 8192).
+   *          - LOG_OVERFLOW: "block" waits for room when the queue is full,
+   *            "overrun" (default) drops the oldest queued message.
+   *          - LOG_PAYLOAD_SAMPLE: log one payload dump out of every N at
+   *            debug level (default 100, 0 disables payload dumps).
    * @see Environment::get()
    */
   static auto config(i32 rank) -> void {
     try {
       const auto debug_mode = Environment::get("DEBUG");  // Debug mode
+      const auto queue_size = Environment::get("LOG_QUEUE_SIZE");
+      const auto overflow = Environment::get("LOG_OVERFLOW");
+      const auto payload_sample = Environment::get("LOG_PAYLOAD_SAMPLE");
+      auto policy = spdlog::async_overflow_policy::overrun_oldest;
+      if (overflow && overflow.value() == "block") {
+        policy = spdlog::async_overflow_policy::block;
+      }
+      spdlog::init_thread_pool(queue_size ? std::stoul(*queue_size) : 8192, 1);
+      auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+      auto logger = std::make_shared<spdlog::async_logger>(
+          "scorehive", sink, spdlog::thread_pool(), policy);
+      spdlog::set_default_logger(logger);
+      if (payload_sample) {
+        _payload_sample = std::stoull(*payload_sample);
+      }
       spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] %v");
       if (debug_mode && debug_mode.value() == "1") {
         spdlog::set_level(spdlog::level::debug);
@@ -37,5 +113,61 @@ class Logger {
       spdlog::set_level(spdlog::level::off);
     }
   }
+
+  /**
+   * @brief Flush the queued messages and stop the background thread
+   */
+  static auto shutdown() -> void { spdlog::shutdown(); }
+
+  /**
+   * @brief Sampling period of payload dumps (see LOG_PAYLOAD_SAMPLE)
+   */
+  static auto payload_sample() -> u64 { return _payload_sample; }
+
+  /**
+   * @brief Log a message that got through a RateLimiter
+   */
+  template <typename... Args>
+  static auto log_limited(spdlog::level::level_enum level, u64 suppressed,
+                          spdlog::format_string_t<Args...> format,
+                          Args&&... args) -> void {
+    if (suppressed == 0) {
+      spdlog::log(level, format, std::forward<Args>(args)...);
+      return;
+    }
+    spdlog::log(level, "{} ({} similar messages suppressed)",
+                fmt::format(format, std::forward<Args>(args)...), suppressed);
+  }
+
+ private:
+  static inline u64 _payload_sample = 100;
 };
-#endif  // LOGGER_HPP
\ No newline at end of file
+
+/**
+ * @brief Log at most once every `interval_ms` from this call site
+ */
+#define SH_LOG_EVERY_MS(level, interval_ms, ...)                    \
+  do {                                                              \
+    if (spdlog::should_log(level)) {                                \
+      static RateLimiter sh_rate_limiter_(interval_ms);             \
+      if (auto suppressed = sh_rate_limiter_.acquire()) {           \
+        Logger::log_limited(level, *suppressed, __VA_ARGS__);       \
+      }                                                             \
+    }                                                               \
+  } while (false)
+
+/**
+ * @brief Dump a payload at debug level, one call out of every
+ *        Logger::payload_sample() from this call site
+ */
+#define SH_LOG_PAYLOAD(...)                                         \
+  do {                                                              \
+    if (spdlog::should_log(spdlog::level::debug)) {                 \
+      static Sampler sh_sampler_;                                   \
+      if (sh_sampler_.sample(Logger::payload_sample())) {           \
+        spdlog::debug(__VA_ARGS__);                                 \
+      }                                                             \
+    }                                                               \
+  } while (false)
+
+#endif  // LOGGER_HPP
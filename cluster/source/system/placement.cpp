@@ -0,0 +1,89 @@
+#include "placement.hpp"
+#include <hwloc.h>
+#include <mpi.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <system/environment.hpp>
+#include <vector>
+
+namespace {
+
+std::string bitmap_list(hwloc_const_bitmap_t bitmap) {
+  char* text = nullptr;
+  if (hwloc_bitmap_list_asprintf(&text, bitmap) < 0) {
+    return "?";
+  }
+  std::string list(text);
+  std::free(text);
+  return list;
+}
+
+}  // namespace
+
+void Placement::apply(bool ingress) {
+  i32 rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  // Role of every rank of the node, in node rank order
+  MPI_Comm node_comm;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                      MPI_INFO_NULL, &node_comm);
+  i32 node_rank, node_size;
+  MPI_Comm_rank(node_comm, &node_rank);
+  MPI_Comm_size(node_comm, &node_size);
+  std::vector<i32> roles(node_size);
+  i32 role = ingress ? 1 : 0;
+  MPI_Allgather(&role, 1, MPI_INT, roles.data(), 1, MPI_INT, node_comm);
+  MPI_Comm_free(&node_comm);
+
+  auto mode = Environment::get("SH_PLACEMENT").value_or("none");
+  const char* name = ingress ? "ingress" : "worker";
+  hwloc_topology_t topology;
+  hwloc_topology_init(&topology);
+  hwloc_topology_load(topology);
+  auto* cpuset = hwloc_bitmap_alloc();
+  auto* nodeset = hwloc_bitmap_alloc();
+  if (mode != "core" && mode != "numa") {
+    if (mode != "none") {
+      spdlog::warn("Unknown SH_PLACEMENT {}, ranks are not pinned", mode);
+    }
+    hwloc_get_cpubind(topology, cpuset, HWLOC_CPUBIND_PROCESS);
+    hwloc_cpuset_to_nodeset(topology, cpuset, nodeset);
+    spdlog::info("Rank {} ({}) not pinned: cpus {}, NUMA nodes {}", rank,
+                 name, bitmap_list(cpuset), bitmap_list(nodeset));
+  } else {
+    auto type = HWLOC_OBJ_CORE;
+    auto cores = hwloc_get_nbobjs_by_type(topology, type);
+    if (cores <= 0) {
+      type = HWLOC_OBJ_PU;
+      cores = hwloc_get_nbobjs_by_type(topology, type);
+    }
+    auto before = roles.begin() + node_rank;
+    i32 ingress_index = std::count(roles.begin(), before, 1);
+    i32 worker_index = std::count(roles.begin(), before, 0);
+    i32 node_ingress = std::count(roles.begin(), roles.end(), 1);
+    // Keep the last cores for the network loops when there are enough
+    i32 evaluation_cores = cores > node_ingress ? cores - node_ingress : cores;
+    i32 core = ingress ? cores - 1 - ingress_index % cores
+                       : worker_index % evaluation_cores;
+    auto* object = hwloc_get_obj_by_type(topology, type, core);
+    if (mode == "numa") {
+      hwloc_cpuset_from_nodeset(topology, cpuset, object->nodeset);
+    } else {
+      hwloc_bitmap_copy(cpuset, object->cpuset);
+    }
+    hwloc_bitmap_copy(nodeset, object->nodeset);
+    if (hwloc_set_cpubind(topology, cpuset, HWLOC_CPUBIND_PROCESS) == -1) {
+      spdlog::warn("Rank {} ({}) could not be bound to cpus {}", rank, name,
+                   bitmap_list(cpuset));
+    } else {
+      spdlog::info("Rank {} ({}) bound to core {}: cpus {}, NUMA nodes {}",
+                   rank, name, core, bitmap_list(cpuset),
+                   bitmap_list(nodeset));
+    }
+  }
+  hwloc_bitmap_free(nodeset);
+  hwloc_bitmap_free(cpuset);
+  hwloc_topology_destroy(topology);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <system/aliases.hpp>
+
+/**
+ * @brief Placement of the ranks of a node on its cores
+ * @details Selected by SH_PLACEMENT:
+ *          - "none" (default): the binding given by mpirun is kept.
+ *          - "core": every rank is bound to one core.
+ *          - "numa": every rank is bound to the NUMA node of its core, so
+ *            the kernel can still balance it within the socket.
+ *          The ingress ranks of a node take its last cores and the workers
+ *          are spread over the others in topology order, so the network
+ *          loop never competes with an evaluation. The binding applies to
+ *          every thread of the process (logger and writer threads too).
+ *          Memory is placed by first touch, so the buffers a rank allocates
+ *          after the binding (answer keys, batch payloads, results) are on
+ *          its local NUMA node. Run mpirun with "--bind-to none" so its own
+ *          binding does not get in the way.
+ *          Every rank logs its placement, including when it is not pinned.
+ */
+class Placement {
+ public:
+  Placement() = delete;
+  ~Placement() = delete;
+
+  /**
+   * @brief Bind the calling rank. Collective over MPI_COMM_WORLD.
+   * @param ingress Whether the rank runs a server
+   */
+  static void apply(bool ingress);
+};
+
+#endif  // PLACEMENT_HPP
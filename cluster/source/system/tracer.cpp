@@ -0,0 +1,103 @@
+#include "tracer.hpp"
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <system/environment.hpp>
+
+std::unique_ptr<Tracer> Tracer::_instance = nullptr;
+
+Tracer& Tracer::instance() {
+  static std::once_flag flag;
+  std::call_once(flag, []() { _instance.reset(new Tracer()); });
+  return *_instance;
+}
+
+void Tracer::init(i32 rank) {
+  _rank = rank;
+  auto directory = Environment::get("SH_TRACE_DIR");
+  if (!directory) {
+    return;
+  }
+  _capacity = std::max<size_t>(
+      1, Environment::get_or<size_t>("SH_TRACE_SPANS", _capacity));
+  _spans.reserve(_capacity);
+  auto path = fmt::format("{}/trace.rank{}.json", *directory, rank);
+  try {
+    std::filesystem::create_directories(*directory);
+    std::filesystem::remove(path);  // the writer appends
+    _writer = std::make_unique<AsyncFileWriter>(path, 1 << 20);
+  } catch (const std::exception& e) {
+    spdlog::error("Tracing disabled: {}", e.what());
+    return;
+  }
+  _text = fmt::format(
+      "[{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},"
+      "\"args\":{{\"name\":\"rank {}\"}}}}",
+      rank, rank);
+  _writer->write(_text);
+  spdlog::info("Tracing to {}", path);
+}
+
+void Tracer::shutdown() {
+  if (!enabled()) {
+    return;
+  }
+  _flush();
+  if (!enabled()) {
+    return;  // a write failed while flushing
+  }
+  try {
+    _writer->write("]\n");
+  } catch (const std::exception& e) {
+    spdlog::error("Failed to close the trace: {}", e.what());
+  }
+  _writer.reset();  // writes what is left and joins the I/O thread
+}
+
+i32 Tracer::next_trace() {
+  // Rank in the high bits keeps the ids of the ingress ranks apart
+  _sequence = (_sequence + 1) & 0xFFFFF;
+  return (_rank << 20) | _sequence;
+}
+
+void Tracer::record(const char* name, i32 trace, i64 begin_us) {
+  if (!enabled()) {
+    return;  // a write failed while the span was open
+  }
+  _spans.push_back({name, trace, begin_us, now_us() - begin_us});
+  if (_spans.size() >= _capacity) {
+    _flush();
+  }
+}
+
+i64 Tracer::now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void Tracer::_flush() {
+  if (_spans.empty() || !enabled()) {
+    return;
+  }
+  _text.clear();
+  auto out = std::back_inserter(_text);
+  for (const auto& span : _spans) {
+    fmt::format_to(out,
+                   ",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":{},\"tid\":0,"
+                   "\"ts\":{},\"dur\":{},\"args\":{{\"trace\":{}}}}}",
+                   span.name, _rank, span.begin_us, span.duration_us,
+                   span.trace);
+  }
+  _spans.clear();
+  try {
+    _writer->write(_text);  // the I/O thread does the write calls
+  } catch (const std::exception& e) {
+    spdlog::error("Tracing disabled: {}", e.what());
+    _writer.reset();
+  }
+}
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <memory>
+#include <string>
+#include <system/aliases.hpp>
+#include <system/async_writer.hpp>
+#include <vector>
+
+/**
+ * @brief Timed span of a request on one rank
+ */
+struct TraceSpan {
+  const char* name; /** Static name of the span */
+  i32 trace;        /** Trace id of the request */
+  i64 begin_us;     /** Start, in microseconds since the epoch */
+  i64 duration_us;  /** Duration in microseconds */
+};
+
+/**
+ * @brief Per-rank recorder of trace spans
+ * @details Enabled by SH_TRACE_DIR. Spans are stored in a fixed buffer of
+ *          SH_TRACE_SPANS entries (default 16384); when it fills up they
+ *          are formatted as Chrome trace events and handed to an
+ *          AsyncFileWriter, whose I/O thread writes them to
+ *          "<SH_TRACE_DIR>/trace.rank<N>.json". The files of every rank can
+ *          be loaded together in Perfetto or chrome://tracing; wall-clock
+ *          timestamps line them up.
+ *          The trace id of a request is assigned by the ingress rank and
+ *          travels to the workers in the batch header; spans take the
+ *          current id of the rank. Only the main thread of a rank records.
+ */
+class Tracer {
+ public:
+  static Tracer& instance();
+  ~Tracer() = default;
+
+  /**
+   * @brief Read the settings and open the trace file of the rank
+   */
+  void init(i32 rank);
+
+  /**
+   * @brief Write the remaining spans and close the trace file
+   */
+  void shutdown();
+
+  bool enabled() const { return _writer != nullptr; }
+
+  /**
+   * @brief New trace id, unique across ranks (ingress)
+   */
+  i32 next_trace();
+
+  i32 current() const { return _current; }
+  void set_current(i32 trace) { _current = trace; }
+
+  /**
+   * @brief Record a span that ends now
+   */
+  void record(const char* name, i32 trace, i64 begin_us);
+
+  /**
+   * @brief Wall-clock time in microseconds
+   */
+  static i64 now_us();
+
+ private:
+  Tracer() = default;
+  static std::unique_ptr<Tracer> _instance;
+  void _flush();
+
+  std::unique_ptr<AsyncFileWriter> _writer;
+  std::vector<TraceSpan> _spans;
+  size_t _capacity = 16384;
+  std::string _text; /** Formatting buffer, reused between flushes */
+  i32 _rank = 0;
+  i32 _sequence = 0;
+  i32 _current = 0;
+};
+
+/**
+ * @brief Records a span covering the lifetime of the object
+ * @details Does nothing, not even reading the clock, if tracing is disabled.
+ */
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name) : _name(name) {
+    auto& tracer = Tracer::instance();
+    if (tracer.enabled()) {
+      _trace = tracer.current();
+      _begin_us = Tracer::now_us();
+    }
+  }
+
+  ~TraceScope() {
+    if (_begin_us >= 0) {
+      Tracer::instance().record(_name, _trace, _begin_us);
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* _name;
+  i32 _trace = 0;
+  i64 _begin_us = -1;
+};
+
+#endif  // TRACER_HPP
@@ -0,0 +1,210 @@
+#include <cmath>
+#include <domain/codec.hpp>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Tests of JsonCodec against nlohmann
+ * @details The writers must produce the bytes of `json(value).dump()`, and
+ *          the readers must never accept a text nlohmann rejects: known
+ *          documents and random mutations of them are checked.
+ */
+
+namespace {
+
+using json = nlohmann::json;
+
+i32 failures = 0;
+
+void fail(std::string_view what, std::string_view detail) {
+  failures++;
+  std::cerr << "FAIL " << what << ": " << std::quoted(detail.substr(0, 160))
+            << "\n";
+}
+
+void expect_equal(std::string_view what, const std::string& actual,
+                  const std::string& expected) {
+  if (actual != expected) {
+    fail(std::string(what) + " wrote " + actual, expected);
+  }
+}
+
+void write_results() {
+  std::vector<MPIResult> empty;
+  std::string output;
+  JsonCodec::write_results(empty, output);
+  expect_equal("empty results", output, json(empty).dump());
+
+  std::vector<MPIResult> results = {
+      {1, 1, 10, 2, 0, 10.0},
+      {-3, -2147483647 - 1, 0, 0, 0, -0.0},
+      {2147483647, 7, 1, 1, 1, 1.0 / 3.0},
+      {4, 8, 5, 6, 7, -2.5},
+      {5, 9, 0, 0, 0, 0.1},
+      {6, 10, 0, 0, 0, 1e300},
+      {7, 11, 0, 0, 0, -1e-300},
+      {8, 12, 0, 0, 0, std::numeric_limits<double>::denorm_min()},
+      {9, 13, 0, 0, 0, 12345678.9},
+      {10, 14, 0, 0, 0, 100.0},
+      {11, 15, 0, 0, 0, std::nan("")},
+      {12, 16, 0, 0, 0, -std::numeric_limits<double>::infinity()},
+  };
+  output.clear();
+  JsonCodec::write_results(results, output);
+  expect_equal("results", output, json(results).dump());
+
+  // Random doubles of every magnitude and sign
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> mantissa(-1.0, 1.0);
+  std::uniform_int_distribution<i32> exponent(-320, 300);
+  for (i32 i = 0; i < 20000; i++) {
+    std::vector<MPIResult> one = {
+        {i, -i, i % 7, i % 5, i % 3,
+         std::ldexp(mantissa(random), exponent(random))}};
+    output.clear();
+    JsonCodec::write_results(one, output);
+    expect_equal("random double", output, json(one).dump());
+  }
+}
+
+void write_answers() {
+  std::vector<ExamAnswers> keys = {{1, {{1, 2}, {2, 3}}}, {-4, {}}};
+  std::vector<const ExamAnswers*> pointers = {&keys[0], &keys[1]};
+  std::string output;
+  JsonCodec::write_answers(pointers, output);
+  expect_equal("answer keys", output, json(keys).dump());
+  output.clear();
+  JsonCodec::write_answers({}, output);
+  expect_equal("no answer keys", output,
+               json(std::vector<ExamAnswers>{}).dump());
+}
+
+void write_sheet_results() {
+  std::vector<MPIResult> results = {{1, 1, 3, 1, 0, 3.0},
+                                    {2, 2, 0, 4, 1, -1.5}};
+  std::vector<AnswerSheet> sheets = {
+      {"A\"b\\c/\x01\x1f\t\n", "EXAM_1", {}},
+      {"Ñandú ✓", "", {}},
+  };
+  auto expected = json::array();
+  for (size_t i = 0; i < results.size(); i++) {
+    expected.push_back({{"correct_answers", results[i].correct_answers},
+                        {"exam_id", sheets[i].exam_id},
+                        {"score", results[i].score},
+                        {"student_id", sheets[i].student_id},
+                        {"unscored_answers", results[i].unscored_answers},
+                        {"wrong_answers", results[i].wrong_answers}});
+  }
+  std::string output;
+  JsonCodec::write_sheet_results(results, sheets, output);
+  expect_equal("sheet results", output, expected.dump());
+}
+
+/**
+ * @brief Whether every reader that accepts `text` agrees with nlohmann
+ */
+void check_readers(std::string_view text) {
+  std::vector<MPIExam> exams;
+  std::vector<ExamAnswers> answers;
+  std::vector<AnswerSheet> sheets;
+  auto valid = json::accept(text);
+  if (JsonCodec::read_exams(text, exams) && !valid) {
+    fail("read_exams accepted invalid JSON", text);
+  }
+  if (JsonCodec::read_answers(text, answers) && !valid) {
+    fail("read_answers accepted invalid JSON", text);
+  }
+  if (JsonCodec::read_sheets(text, sheets) && !valid) {
+    fail("read_sheets accepted invalid JSON", text);
+  }
+}
+
+void read_documents() {
+  std::string exams =
+      R"([{"stage":1,"id_exam":-2,"answers":[{"qst_idx":1,"ans_idx":3}],)"
+      R"("x":[true,false,null,-0.5e+3,"a\"\u00e9\n",{"y":{}}]}])";
+  std::vector<MPIExam> read;
+  if (!JsonCodec::read_exams(exams, read) || read.size() != 1 ||
+      read[0].stage != 1 || read[0].id_exam != -2 ||
+      read[0].answers.size() != 1 || read[0].answers[0] != 3) {
+    fail("read_exams rejected or misread", exams);
+  }
+  // Bodies nlohmann rejects must send the caller to it
+  for (std::string_view extra :
+       {"bar", "True", "nul", "nulls", "truefalse", "01", "-", "1.", ".5",
+        "1e", "+1", "0x1", "\"\\x\"", "\"\\u12g4\"", "\"\t\"", "[1,]",
+        "{\"a\" 1}", "NaN", "Infinity", "'a'"}) {
+    auto text = R"([{"stage":1,"id_exam":1,"answers":[],"x":)" +
+                std::string(extra) + "}]";
+    std::vector<MPIExam> ignored;
+    if (JsonCodec::read_exams(text, ignored)) {
+      fail("read_exams accepted invalid JSON", text);
+    }
+  }
+  for (std::string_view text :
+       {R"([{"stage":01,"id_exam":1,"answers":[]}])",
+        R"([{"stage":1,"id_exam":-01,"answers":[]}])",
+        "[{\"stage\":1,\"id_exam\":1,\"answers\":[],\"a\tb\":1}]"}) {
+    check_readers(text);
+  }
+}
+
+/**
+ * @brief Readers never accept a mutation of a document nlohmann rejects
+ */
+void read_mutations() {
+  static constexpr std::string_view alphabet =
+      "{}[]\",:0123456789-.eE+ tnfrux\\";
+  std::vector<std::string> documents = {
+      R"([{"stage":1,"id_exam":2,"answers":[{"qst_idx":1,"ans_idx":3}],)"
+      R"("note":[1.5,true,null,"s",{"k":false}]}])",
+      R"([{"stage":1,"answers":[{"qst_idx":1,"rans_idx":3}],"v":-1e2}])",
+      R"({"exams":[{"student_id":"a","exam_id":"E","answers":["A","",)"
+      R"(null],"extra":{"n":[0,-0.0]}}]})",
+  };
+  std::mt19937 random(7);
+  for (i32 round = 0; round < 200000; round++) {
+    auto text = documents[round % documents.size()];
+    auto mutations = std::uniform_int_distribution<i32>(1, 3)(random);
+    for (i32 i = 0; i < mutations; i++) {
+      auto at = std::uniform_int_distribution<size_t>(0, text.size() - 1)(
+          random);
+      auto c = alphabet[std::uniform_int_distribution<size_t>(
+          0, alphabet.size() - 1)(random)];
+      switch (std::uniform_int_distribution<i32>(0, 2)(random)) {
+        case 0:
+          text[at] = c;
+          break;
+        case 1:
+          text.insert(text.begin() + static_cast<long>(at), c);
+          break;
+        default:
+          text.erase(at, 1);
+      }
+    }
+    check_readers(text);
+  }
+}
+
+}  // namespace
+
+i32 main() {
+  write_results();
+  write_answers();
+  write_sheet_results();
+  read_documents();
+  read_mutations();
+  if (failures > 0) {
+    std::cerr << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "JsonCodec: all checks passed\n";
+  return 0;
+}
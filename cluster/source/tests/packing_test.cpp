@@ -0,0 +1,193 @@
+#include <domain/packing.hpp>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Tests of AnswerPacking against a per-question reference
+ * @details Random exams with blanks, lengths that end inside a word and keys
+ *          shorter than the answers are packed at both widths and scored;
+ *          the counts must be those of scoring question by question.
+ */
+
+namespace {
+
+i32 failures = 0;
+
+void fail(std::string_view what, std::string_view detail) {
+  failures++;
+  std::cerr << "FAIL " << what << ": " << detail << "\n";
+}
+
+std::string describe(const AnswerCounts& counts) {
+  return std::to_string(counts.correct) + "/" + std::to_string(counts.wrong) +
+         "/" + std::to_string(counts.unscored);
+}
+
+AnswerCounts score_reference(const std::vector<u8>& answers,
+                             const std::vector<u8>& key) {
+  AnswerCounts counts;
+  for (size_t i = 0; i < answers.size(); i++) {
+    auto expected = i < key.size() ? key[i] : u8{0};
+    if (answers[i] == 0) {
+      continue;
+    }
+    if (expected == 0) {
+      counts.unscored++;
+    } else if (answers[i] == expected) {
+      counts.correct++;
+    } else {
+      counts.wrong++;
+    }
+  }
+  return counts;
+}
+
+std::vector<u8> random_answers(std::mt19937& random, size_t questions,
+                               u8 max_choice, i32 blank_percent) {
+  std::uniform_int_distribution<i32> percent(0, 99);
+  std::uniform_int_distribution<i32> choice(1, max_choice);
+  std::vector<u8> answers(questions);
+  for (auto& answer : answers) {
+    answer = percent(random) < blank_percent ? 0 : choice(random);
+  }
+  return answers;
+}
+
+template <i32 Bits>
+void non_zero_lanes(std::mt19937& random) {
+  constexpr u64 lane_mask = (u64{1} << Bits) - 1;
+  std::uniform_int_distribution<u64> bits;
+  std::uniform_int_distribution<i32> percent(0, 99);
+  for (i32 round = 0; round < 2000; round++) {
+    u64 word = bits(random);
+    // Clear lanes at random so that blanks are common
+    for (i32 lane = 0; lane < 64 / Bits; lane++) {
+      if (percent(random) < 40) {
+        word &= ~(lane_mask << (lane * Bits));
+      }
+    }
+    u64 expected = 0;
+    for (i32 lane = 0; lane < 64 / Bits; lane++) {
+      if ((word >> (lane * Bits)) & lane_mask) {
+        expected |= u64{1} << (lane * Bits);
+      }
+    }
+    if (AnswerPacking::non_zero_lanes<Bits>(word) != expected) {
+      fail("non_zero_lanes<" + std::to_string(Bits) + ">",
+           std::to_string(word));
+    }
+  }
+}
+
+void bits_for() {
+  std::vector<u8> narrow = {0, 1, 15, 7};
+  std::vector<u8> wide = {0, 1, 16, 7};
+  if (AnswerPacking::bits_for(narrow) != AnswerPacking::NARROW_BITS) {
+    fail("bits_for", "choices up to 15 must be narrow");
+  }
+  if (AnswerPacking::bits_for(wide) != AnswerPacking::WIDE_BITS) {
+    fail("bits_for", "a choice of 16 must be wide");
+  }
+  if (AnswerPacking::bits_for({}) != AnswerPacking::NARROW_BITS) {
+    fail("bits_for", "no answers must be narrow");
+  }
+}
+
+void pack(std::mt19937& random) {
+  for (auto bits : {AnswerPacking::NARROW_BITS, AnswerPacking::WIDE_BITS}) {
+    auto max_choice = static_cast<u8>((1 << bits) - 1);
+    for (size_t questions = 0; questions <= 70; questions++) {
+      auto answers = random_answers(random, questions, max_choice, 30);
+      auto words = AnswerPacking::pack(answers, bits);
+      auto what = "pack of " + std::to_string(questions) + " at " +
+                  std::to_string(bits) + " bits";
+      if (words.size() != AnswerPacking::words(questions, bits)) {
+        fail(what, "wrong number of words");
+        continue;
+      }
+      for (size_t i = 0; i < questions; i++) {
+        if (AnswerPacking::lane(words, i, bits) != answers[i]) {
+          fail(what, "lane " + std::to_string(i));
+        }
+      }
+      // Unused lanes of the last word, and lanes past it, read as blanks
+      auto lanes = words.size() * static_cast<size_t>(64 / bits);
+      for (size_t i = questions; i < lanes + 4; i++) {
+        if (AnswerPacking::lane(words, i, bits) != 0) {
+          fail(what, "lane " + std::to_string(i) + " is not blank");
+        }
+      }
+    }
+  }
+}
+
+void widen(std::mt19937& random) {
+  std::vector<u64> wide;
+  for (size_t questions = 0; questions <= 70; questions++) {
+    auto answers = random_answers(random, questions, 15, 30);
+    auto narrow = AnswerPacking::pack(answers, AnswerPacking::NARROW_BITS);
+    AnswerPacking::widen(narrow, questions, wide);
+    if (wide != AnswerPacking::pack(answers, AnswerPacking::WIDE_BITS)) {
+      fail("widen", std::to_string(questions) + " questions");
+    }
+  }
+}
+
+void score(std::mt19937& random) {
+  std::uniform_int_distribution<size_t> length(0, 90);
+  std::uniform_int_distribution<i32> blanks(0, 60);
+  for (i32 round = 0; round < 4000; round++) {
+    auto bits = round % 2 == 0 ? AnswerPacking::NARROW_BITS
+                               : AnswerPacking::WIDE_BITS;
+    // Few choices make correct answers common enough to be checked
+    u8 max_choice = round % 4 < 2 ? 4 : static_cast<u8>((1 << bits) - 1);
+    auto answers = random_answers(random, length(random), max_choice,
+                                  blanks(random));
+    // Keys are shorter, as long or longer than the answers
+    auto key = random_answers(random, length(random), max_choice,
+                              blanks(random) / 4);
+    auto packed_answers = AnswerPacking::pack(answers, bits);
+    auto packed_key = AnswerPacking::pack(key, bits);
+    auto expected = score_reference(answers, key);
+    auto actual = AnswerPacking::score(packed_answers, packed_key, bits);
+    if (actual != expected) {
+      fail("score at " + std::to_string(bits) + " bits",
+           describe(actual) + " instead of " + describe(expected));
+    }
+    // A narrow exam scores the same once widened
+    if (bits == AnswerPacking::NARROW_BITS) {
+      std::vector<u64> wide_answers;
+      std::vector<u64> wide_key;
+      AnswerPacking::widen(packed_answers, answers.size(), wide_answers);
+      AnswerPacking::widen(packed_key, key.size(), wide_key);
+      auto widened = AnswerPacking::score(wide_answers, wide_key,
+                                          AnswerPacking::WIDE_BITS);
+      if (widened != expected) {
+        fail("score of widened answers",
+             describe(widened) + " instead of " + describe(expected));
+      }
+    }
+  }
+}
+
+}  // namespace
+
+i32 main() {
+  std::mt19937 random(20240611);
+  non_zero_lanes<AnswerPacking::NARROW_BITS>(random);
+  non_zero_lanes<AnswerPacking::WIDE_BITS>(random);
+  bits_for();
+  pack(random);
+  widen(random);
+  score(random);
+  if (failures > 0) {
+    std::cerr << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "AnswerPacking: all checks passed\n";
+  return 0;
+}
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <server/compression.hpp>
+#include <server/parser.hpp>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Fuzz-style tests of FrameParser
+ * @details Known frames are checked against their expected outcome, then
+ *          random frames, their mutations and random bytes are parsed both
+ *          at once and in random splits, which must give the same outcome.
+ *          The seed and the number of rounds can be given as arguments.
+ */
+
+namespace {
+
+constexpr u32 MAX_LENGTH = 4096;
+
+i32 failures = 0;
+
+/**
+ * @brief Result of parsing an input, with the frame copied out of it
+ */
+struct Outcome {
+  FrameParser::Status status = FrameParser::Status::INCOMPLETE;
+  std::string error;
+  i32 command = -1;
+  std::string data;
+  bool compressed = false;
+  size_t size = 0;
+
+  bool operator==(const Outcome&) const = default;
+};
+
+Outcome outcome_of(const FrameParser& parser, FrameParser::Status status) {
+  Outcome outcome;
+  outcome.status = status;
+  if (status == FrameParser::Status::INVALID) {
+    outcome.error = parser.error();
+  } else if (status == FrameParser::Status::FRAME) {
+    const auto& frame = parser.frame();
+    outcome.command = static_cast<i32>(frame.command);
+    outcome.data = frame.data;
+    outcome.compressed = frame.compressed;
+    outcome.size = parser.frame_size();
+  }
+  return outcome;
+}
+
+Outcome parse_whole(std::string_view input) {
+  FrameParser parser(MAX_LENGTH);
+  return outcome_of(parser, parser.parse(input));
+}
+
+/**
+ * @brief Parse the input as it would arrive in reads ending at `cuts`
+ */
+Outcome parse_split(std::string_view input, std::vector<size_t> cuts) {
+  FrameParser parser(MAX_LENGTH);
+  cuts.push_back(input.size());
+  for (auto cut : cuts) {
+    auto status = parser.parse(input.substr(0, cut));
+    if (status != FrameParser::Status::INCOMPLETE || cut == input.size()) {
+      return outcome_of(parser, status);
+    }
+  }
+  return {};
+}
+
+std::string describe(const Outcome& outcome) {
+  switch (outcome.status) {
+    case FrameParser::Status::INCOMPLETE:
+      return "INCOMPLETE";
+    case FrameParser::Status::INVALID:
+      return "INVALID (" + outcome.error + ")";
+    case FrameParser::Status::FRAME:
+      return "FRAME " + std::to_string(outcome.command) + " of " +
+             std::to_string(outcome.data.size()) + " bytes";
+  }
+  return "?";
+}
+
+void fail(std::string_view what, std::string_view input) {
+  failures++;
+  std::cerr << "FAIL " << what << ": "
+            << std::quoted(input.substr(0, 120)) << "\n";
+}
+
+Outcome frame(i32 command, std::string_view data, size_t size,
+              bool compressed = false) {
+  return {FrameParser::Status::FRAME, "", command, std::string(data),
+          compressed, size};
+}
+
+Outcome invalid(const char* error) {
+  return {FrameParser::Status::INVALID, error, -1, "", false, 0};
+}
+
+void expect(std::string_view input, const Outcome& expected) {
+  std::vector<size_t> byte_by_byte(input.size());
+  std::iota(byte_by_byte.begin(), byte_by_byte.end(), 1);
+  for (const auto& actual :
+       {parse_whole(input), parse_split(input, byte_by_byte)}) {
+    if (!(actual == expected)) {
+      fail("expected " + describe(expected) + ", got " + describe(actual),
+           input);
+      return;
+    }
+  }
+}
+
+void known_frames() {
+  expect("SH 0$", frame(0, "", 5));
+  expect("\r\n SH 4$", frame(4, "", 8));
+  expect("SH 3 5 hello$", frame(3, "hello", 13));
+  expect("SH 3 3 a$b$", frame(3, "a$b", 11));
+  expect("SH 3 0 $", frame(3, "", 8));
+  expect("SH 3 5 hello$SH 0$", frame(3, "hello", 13));
+  expect("SH 3 5 hel", {});
+  expect("SH", {});
+  // Bad magic
+  expect("XH 3 1 a$", invalid("Invalid magic string"));
+  expect("sh 3 1 a$", invalid("Invalid magic string"));
+  expect("SH3 1 a$", invalid("Invalid magic string"));
+  // Commands
+  expect("SH  3 1 a$", invalid("Missing command"));
+  expect("SH 10 1 a$", invalid("Invalid command"));
+  expect("SH 0003 1 a$", invalid("Invalid command"));
+  expect("SH 3x 1 a$", invalid("Invalid command"));
+  expect("SH 3$", invalid("Missing length"));
+  // Lengths that do not match the data
+  expect("SH 3 $", invalid("Invalid length"));
+  expect("SH 3 -1 a$", invalid("Invalid length"));
+  expect("SH 3 10 abc$", {});
+  expect("SH 3 3 abcd$", invalid("Data length mismatch"));
+  expect("SH 3 5 abc$", {});
+  // Oversized lengths are rejected before the data arrives
+  expect("SH 3 4097 ", invalid("Length exceeds the maximum allowed size"));
+  expect("SH 3 99999999999 ", invalid("Invalid length"));
+  expect("SH 3 4294967296 ",
+         invalid("Length exceeds the maximum allowed size"));
+  // Compressed data
+  auto zipped = Deflater::compress("hello hello hello", 1);
+  auto z = "SH 3z " + std::to_string(zipped.size()) + " " + zipped + "$";
+  expect(z, frame(3, "hello hello hello", z.size(), true));
+  auto bomb = Deflater::compress(std::string(MAX_LENGTH + 1, 'a'), 9);
+  expect("SH 3z " + std::to_string(bomb.size()) + " " + bomb + "$",
+         invalid("Length exceeds the maximum allowed size"));
+  expect("SH 3z 5 hello$", invalid("Invalid compressed data"));
+  auto cut = zipped.substr(0, zipped.size() - 2);
+  expect("SH 3z " + std::to_string(cut.size()) + " " + cut + "$",
+         invalid("Invalid compressed data"));
+}
+
+/**
+ * @brief Frames in a row are parsed one after the other
+ */
+void consecutive_frames() {
+  std::string input = "SH 3 2 ab$\r\nSH 0$SH 2 3 [1]$";
+  std::vector<Outcome> expected = {frame(3, "ab", 10), frame(0, "", 7),
+                                   frame(2, "[1]", 11)};
+  FrameParser parser(MAX_LENGTH);
+  std::string_view rest = input;
+  for (const auto& next : expected) {
+    auto actual = outcome_of(parser, parser.parse(rest));
+    if (!(actual == next)) {
+      fail("consecutive frame " + describe(actual), rest);
+      return;
+    }
+    rest.remove_prefix(parser.frame_size());
+    parser.reset();
+  }
+  if (parser.parse(rest) != FrameParser::Status::INCOMPLETE ||
+      parser.started()) {
+    fail("input left after the frames", rest);
+  }
+}
+
+template <typename T>
+T pick(std::mt19937& random, T low, T high) {
+  return std::uniform_int_distribution<T>(low, high)(random);
+}
+
+std::string random_frame(std::mt19937& random) {
+  auto command = pick<i32>(random, 0, MAX_COMMAND);
+  if (command == 0 || command == 4) {
+    return "SH " + std::to_string(command) + "$";
+  }
+  auto size = pick<size_t>(random, 0, 64);
+  std::string data(size, ' ');
+  for (auto& c : data) {
+    c = static_cast<char>(pick<i32>(random, 32, 126));
+  }
+  if (pick<i32>(random, 0, 3) == 0) {
+    auto zipped = Deflater::compress(data, 1);
+    return "SH " + std::to_string(command) + "z " +
+           std::to_string(zipped.size()) + " " + zipped + "$";
+  }
+  return "SH " + std::to_string(command) + " " + std::to_string(size) + " " +
+         data + "$";
+}
+
+/**
+ * @brief Flip, insert, drop or truncate a few bytes of a frame
+ */
+std::string mutate(std::string input, std::mt19937& random) {
+  static constexpr std::string_view alphabet = "SH 0123456789z$\r\n\t-x";
+  auto mutations = pick<i32>(random, 1, 3);
+  for (i32 i = 0; i < mutations && !input.empty(); i++) {
+    auto at = pick<size_t>(random, 0, input.size() - 1);
+    auto c = alphabet[pick<size_t>(random, 0, alphabet.size() - 1)];
+    switch (pick<i32>(random, 0, 3)) {
+      case 0:
+        input[at] = c;
+        break;
+      case 1:
+        input.insert(input.begin() + static_cast<long>(at), c);
+        break;
+      case 2:
+        input.erase(at, 1);
+        break;
+      default:
+        input.resize(at);
+    }
+  }
+  return input;
+}
+
+std::vector<size_t> random_cuts(size_t size, std::mt19937& random) {
+  std::vector<size_t> cuts;
+  for (size_t at = 0; at < size;) {
+    at += pick<size_t>(random, 1, 8);
+    cuts.push_back(std::min(at, size));
+  }
+  return cuts;
+}
+
+void random_inputs(u32 seed, i32 rounds) {
+  std::mt19937 random(seed);
+  for (i32 round = 0; round < rounds; round++) {
+    auto valid = random_frame(random);
+    auto whole = parse_whole(valid);
+    if (whole.status != FrameParser::Status::FRAME ||
+        whole.size != valid.size()) {
+      fail("random frame " + describe(whole), valid);
+    }
+    std::string garbage(pick<size_t>(random, 0, 32), ' ');
+    for (auto& c : garbage) {
+      c = static_cast<char>(pick<i32>(random, 0, 255));
+    }
+    for (const auto& input : {valid, mutate(valid, random), "SH " + garbage}) {
+      auto at_once = parse_whole(input);
+      auto split = parse_split(input, random_cuts(input.size(), random));
+      if (!(at_once == split)) {
+        fail("split gives " + describe(split) + " instead of " +
+                 describe(at_once),
+             input);
+      }
+      if (at_once.status == FrameParser::Status::FRAME &&
+          (at_once.size > input.size() || input[at_once.size - 1] != '$')) {
+        fail("frame does not end at its '$'", input);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+i32 main(i32 argc, char** argv) {
+  u32 seed = 2024;
+  i32 rounds = 20000;
+  if (argc > 1) {
+    std::string_view arg = argv[1];
+    std::from_chars(arg.data(), arg.data() + arg.size(), seed);
+  }
+  if (argc > 2) {
+    std::string_view arg = argv[2];
+    std::from_chars(arg.data(), arg.data() + arg.size(), rounds);
+  }
+  known_frames();
+  consecutive_frames();
+  random_inputs(seed, rounds);
+  if (failures > 0) {
+    std::cerr << failures << " checks failed (seed " << seed << ")\n";
+    return 1;
+  }
+  std::cout << "FrameParser: all checks passed (seed " << seed << ", "
+            << rounds << " rounds)\n";
+  return 0;
+}
@@ -0,0 +1,240 @@
+#include <domain/answers.hpp>
+#include <domain/coordinator.hpp>
+#include <domain/evaluator.hpp>
+#include <domain/packing.hpp>
+#include <domain/resident.hpp>
+#include <iostream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Tests of ResidentExams against scoring from scratch
+ * @details Random exams are kept while the keys of their stages get
+ *          questions added, changed and dropped. After every RESCORE the
+ *          results of the kept exams, updated with the changed ones, must be
+ *          those of scoring every kept exam again against the current keys.
+ */
+
+namespace {
+
+using json = nlohmann::json;
+using ExamId = std::pair<i32, i32>;
+
+constexpr i32 STAGES = 3;
+constexpr i32 EXAMS = 40;
+constexpr i32 QUESTIONS = 60;
+
+i32 failures = 0;
+
+void fail(std::string_view what, std::string_view detail) {
+  failures++;
+  std::cerr << "FAIL " << what << ": " << detail << "\n";
+}
+
+/**
+ * @brief Exams packed as a worker receives them
+ */
+struct Batch {
+  std::vector<MPIExamHeader> headers;
+  std::vector<u64> words;
+
+  explicit Batch(const std::vector<MPIExam>& exams) {
+    for (const auto& exam : exams) {
+      auto bits = AnswerPacking::bits_for(exam.answers);
+      headers.push_back({exam.stage, exam.id_exam,
+                         static_cast<i32>(exam.answers.size()), bits});
+      auto packed = AnswerPacking::pack(exam.answers, bits);
+      words.insert(words.end(), packed.begin(), packed.end());
+    }
+  }
+
+  MPIPackedExams packed() const { return {headers, words}; }
+};
+
+/**
+ * @brief Answers of an exam; odd exams have choices only wide lanes hold
+ */
+MPIExam random_exam(std::mt19937& random, i32 stage, i32 id_exam) {
+  auto max_choice = id_exam % 2 == 0 ? 4 : 20;
+  std::uniform_int_distribution<i32> questions(1, QUESTIONS);
+  std::uniform_int_distribution<i32> choice(0, max_choice);
+  MPIExam exam{stage, id_exam, {}};
+  exam.answers.resize(questions(random));
+  for (auto& answer : exam.answers) {
+    answer = static_cast<u8>(choice(random));
+  }
+  return exam;
+}
+
+/**
+ * @brief Key answers of a stage; some stages have wide keys
+ */
+json random_key(std::mt19937& random, i32 stage, i32 questions) {
+  auto max_choice = stage == 2 ? 20 : 4;
+  std::uniform_int_distribution<i32> choice(1, max_choice);
+  json answers = json::array();
+  for (i32 q = 1; q <= questions; q++) {
+    answers.push_back({{"qst_idx", q}, {"rans_idx", choice(random)}});
+  }
+  return {{"stage", stage}, {"answers", answers}};
+}
+
+/**
+ * @brief Patch that adds questions past the key, changes and drops some
+ */
+json random_patch(std::mt19937& random, i32 stage) {
+  auto max_choice = stage == 2 ? 20 : 4;
+  std::uniform_int_distribution<i32> question(1, QUESTIONS + 10);
+  std::uniform_int_distribution<i32> choice(0, max_choice);
+  std::uniform_int_distribution<i32> changes(1, 8);
+  json answers = json::array();
+  for (i32 i = changes(random); i > 0; i--) {
+    answers.push_back(
+        {{"qst_idx", question(random)}, {"rans_idx", choice(random)}});
+  }
+  return json::array({{{"stage", stage}, {"answers", answers}}});
+}
+
+class Harness {
+ public:
+  /**
+   * @brief Review exams, as a REVIEW_RESIDENT batch does
+   */
+  void review(const std::vector<MPIExam>& exams) {
+    Batch batch(exams);
+    auto results = Evaluator::instance().evaluate_exam_batch(batch.packed());
+    ResidentExams::instance().keep(batch.packed(), results);
+    for (size_t i = 0; i < exams.size(); i++) {
+      ExamId id{exams[i].stage, exams[i].id_exam};
+      _kept[id] = exams[i];
+      _results[id] = results[i];
+    }
+  }
+
+  /**
+   * @brief Forget exams, as a RESCORE does with those of another worker
+   */
+  void drop(const std::vector<MPIExam>& exams) {
+    Batch batch(exams);
+    ResidentExams::instance().drop(batch.headers);
+    for (const auto& exam : exams) {
+      _kept.erase({exam.stage, exam.id_exam});
+      _results.erase({exam.stage, exam.id_exam});
+    }
+  }
+
+  void rescore(std::string_view what) {
+    for (const auto& result : ResidentExams::instance().rescore()) {
+      ExamId id{result.stage, result.id_exam};
+      if (!_kept.contains(id)) {
+        fail(what, "exam " + std::to_string(result.id_exam) +
+                       " is not kept but was re-scored");
+        continue;
+      }
+      _results[id] = result;
+    }
+    check(what);
+  }
+
+  const MPIExam& exam(i32 stage, i32 id_exam) const {
+    return _kept.at({stage, id_exam});
+  }
+
+ private:
+  std::map<ExamId, MPIExam> _kept;
+  std::map<ExamId, MPIResult> _results;
+
+  void check(std::string_view what) {
+    if (ResidentExams::instance().size() != _kept.size()) {
+      fail(what, std::to_string(ResidentExams::instance().size()) +
+                     " exams kept instead of " + std::to_string(_kept.size()));
+    }
+    std::vector<MPIExam> exams;
+    for (const auto& [id, exam] : _kept) {
+      exams.push_back(exam);
+    }
+    Batch batch(exams);
+    auto expected = Evaluator::instance().evaluate_exam_batch(batch.packed());
+    for (const auto& result : expected) {
+      const auto& actual = _results.at({result.stage, result.id_exam});
+      if (actual.correct_answers != result.correct_answers ||
+          actual.wrong_answers != result.wrong_answers ||
+          actual.unscored_answers != result.unscored_answers ||
+          actual.score != result.score) {
+        fail(what, "stage " + std::to_string(result.stage) + " exam " +
+                       std::to_string(result.id_exam) + " has " +
+                       std::to_string(actual.correct_answers) + "/" +
+                       std::to_string(actual.wrong_answers) + "/" +
+                       std::to_string(actual.unscored_answers) +
+                       " instead of " +
+                       std::to_string(result.correct_answers) + "/" +
+                       std::to_string(result.wrong_answers) + "/" +
+                       std::to_string(result.unscored_answers));
+      }
+    }
+  }
+};
+
+void rescore(std::mt19937& random) {
+  auto& answers = AnswersManager::instance();
+  Harness harness;
+  // Stage 0 starts without key, the others with keys shorter than the exams
+  answers.load_from_json(json::array({random_key(random, 1, QUESTIONS / 2),
+                                      random_key(random, 2, QUESTIONS / 3)}));
+  std::vector<MPIExam> exams;
+  for (i32 stage = 0; stage < STAGES; stage++) {
+    for (i32 id_exam = 0; id_exam < EXAMS; id_exam++) {
+      exams.push_back(random_exam(random, stage, id_exam));
+    }
+  }
+  harness.review(exams);
+  harness.rescore("rescore without key changes");
+
+  answers.load_from_json(json::array({random_key(random, 0, QUESTIONS)}));
+  harness.rescore("rescore of a new key");
+
+  std::uniform_int_distribution<i32> stage_of(0, STAGES - 1);
+  std::uniform_int_distribution<i32> exam_of(0, EXAMS - 1);
+  for (i32 round = 0; round < 200; round++) {
+    auto what = "rescore round " + std::to_string(round);
+    answers.patch_from_json(random_patch(random, stage_of(random)));
+    if (round % 3 == 0) {
+      // Reviewed again against the patched key, so the stage has exams in
+      // segments of two keys until the next rescore
+      std::vector<MPIExam> again;
+      for (i32 i = 0; i < 5; i++) {
+        again.push_back(random_exam(random, stage_of(random), exam_of(random)));
+      }
+      harness.review(again);
+      answers.patch_from_json(random_patch(random, stage_of(random)));
+    }
+    if (round % 7 == 0) {
+      // Moved to another worker and back
+      auto stage = stage_of(random);
+      auto id_exam = exam_of(random);
+      harness.drop({harness.exam(stage, id_exam)});
+      harness.rescore(what + " after a drop");
+      harness.review({random_exam(random, stage, id_exam)});
+    }
+    harness.rescore(what);
+  }
+}
+
+}  // namespace
+
+i32 main() {
+  std::mt19937 random(20240617);
+  rescore(random);
+  if (failures > 0) {
+    std::cerr << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "ResidentExams: all checks passed\n";
+  return 0;
+}
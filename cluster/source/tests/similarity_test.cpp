@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <domain/answers.hpp>
+#include <domain/coordinator.hpp>
+#include <domain/packing.hpp>
+#include <domain/similarity.hpp>
+#include <iostream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Tests of SimilarityScan against a brute-force comparison
+ * @details The pairs of every part, merged with top(), must be the top_k of
+ *          comparing every pair of exams of a stage question by question,
+ *          however many parts the tile pairs are split in. Some stages span
+ *          several tiles and end in a partial one.
+ */
+
+namespace {
+
+using json = nlohmann::json;
+
+constexpr i32 QUESTIONS = 40;
+
+i32 failures = 0;
+
+void fail(std::string_view what, std::string_view detail) {
+  failures++;
+  std::cerr << "FAIL " << what << ": " << detail << "\n";
+}
+
+std::string describe(const MPISimilarPair& pair) {
+  return std::to_string(pair.stage) + ":" + std::to_string(pair.id_exam_a) +
+         "-" + std::to_string(pair.id_exam_b) + " " +
+         std::to_string(pair.matching_wrong) + "/" +
+         std::to_string(pair.matching_answers);
+}
+
+std::vector<MPISimilarPair> brute_force(const std::vector<MPIExam>& exams,
+                                        const std::map<i32, std::vector<u8>>&
+                                            keys,
+                                        size_t top_k) {
+  std::vector<MPISimilarPair> pairs;
+  for (size_t a = 0; a < exams.size(); a++) {
+    for (size_t b = a + 1; b < exams.size(); b++) {
+      if (exams[a].stage != exams[b].stage) {
+        continue;
+      }
+      const auto& key = keys.at(exams[a].stage);
+      i32 matching_wrong = 0;
+      i32 matching_answers = 0;
+      auto questions = std::min(exams[a].answers.size(),
+                                exams[b].answers.size());
+      for (size_t q = 0; q < questions; q++) {
+        auto answer = exams[a].answers[q];
+        if (answer == 0 || answer != exams[b].answers[q]) {
+          continue;
+        }
+        matching_answers++;
+        auto expected = q < key.size() ? key[q] : u8{0};
+        if (expected != 0 && expected != answer) {
+          matching_wrong++;
+        }
+      }
+      if (matching_wrong == 0) {
+        continue;
+      }
+      auto [first, second] = std::minmax(exams[a].id_exam, exams[b].id_exam);
+      pairs.push_back(
+          {exams[a].stage, first, second, matching_wrong, matching_answers});
+    }
+  }
+  SimilarityScan::top(pairs, top_k);
+  return pairs;
+}
+
+void expect_pairs(std::string_view what,
+                  const std::vector<MPISimilarPair>& actual,
+                  const std::vector<MPISimilarPair>& expected) {
+  if (actual.size() != expected.size()) {
+    fail(what, std::to_string(actual.size()) + " pairs instead of " +
+                   std::to_string(expected.size()));
+    return;
+  }
+  for (size_t i = 0; i < actual.size(); i++) {
+    const auto& lhs = actual[i];
+    const auto& rhs = expected[i];
+    if (lhs.stage != rhs.stage || lhs.id_exam_a != rhs.id_exam_a ||
+        lhs.id_exam_b != rhs.id_exam_b ||
+        lhs.matching_wrong != rhs.matching_wrong ||
+        lhs.matching_answers != rhs.matching_answers) {
+      fail(what, "pair " + std::to_string(i) + " is " + describe(lhs) +
+                     " instead of " + describe(rhs));
+      return;
+    }
+  }
+}
+
+void scan(std::mt19937& random) {
+  // Stages of several tiles, one tile and a partial tile; stage 3 has wide
+  // answers and stage 4 has no key
+  std::map<i32, size_t> stage_sizes = {
+      {1, 2 * SimilarityScan::TILE_EXAMS + 37},
+      {2, SimilarityScan::TILE_EXAMS + 1},
+      {3, 70},
+      {4, 12}};
+  std::map<i32, std::vector<u8>> keys;
+  json key_json = json::array();
+  for (const auto& [stage, size] : stage_sizes) {
+    auto max_choice = stage == 3 ? 20 : 4;
+    std::uniform_int_distribution<i32> choice(1, max_choice);
+    auto& key = keys[stage];
+    if (stage == 4) {
+      continue;
+    }
+    // Keys shorter than some exams leave their last questions unscored
+    key.resize(QUESTIONS - 5);
+    json answers = json::array();
+    for (size_t q = 0; q < key.size(); q++) {
+      key[q] = static_cast<u8>(choice(random));
+      answers.push_back({{"qst_idx", q + 1}, {"rans_idx", key[q]}});
+    }
+    key_json.push_back({{"stage", stage}, {"answers", answers}});
+  }
+  AnswersManager::instance().load_from_json(key_json);
+
+  std::vector<MPIExam> exams;
+  std::uniform_int_distribution<i32> questions(QUESTIONS / 2, QUESTIONS);
+  i32 id_exam = 0;
+  for (const auto& [stage, size] : stage_sizes) {
+    std::uniform_int_distribution<i32> choice(0, stage == 3 ? 20 : 4);
+    for (size_t i = 0; i < size; i++) {
+      MPIExam exam{stage, id_exam++, {}};
+      exam.answers.resize(questions(random));
+      for (auto& answer : exam.answers) {
+        answer = static_cast<u8>(choice(random));
+      }
+      exams.push_back(std::move(exam));
+    }
+  }
+  std::ranges::shuffle(exams, random);
+
+  std::vector<MPIExamHeader> headers;
+  std::vector<u64> words;
+  for (const auto& exam : exams) {
+    auto bits = AnswerPacking::bits_for(exam.answers);
+    headers.push_back({exam.stage, exam.id_exam,
+                       static_cast<i32>(exam.answers.size()), bits});
+    auto packed = AnswerPacking::pack(exam.answers, bits);
+    words.insert(words.end(), packed.begin(), packed.end());
+  }
+  MPIPackedExams packed{headers, words};
+
+  for (size_t top_k : {size_t{1}, size_t{25}, size_t{1000}, size_t{1} << 20}) {
+    auto expected = brute_force(exams, keys, top_k);
+    for (i32 parts : {1, 2, 3, 7, 64}) {
+      std::vector<MPISimilarPair> merged;
+      for (i32 part = 0; part < parts; part++) {
+        auto pairs = SimilarityScan::scan(packed, part, parts, top_k);
+        if (!std::ranges::is_sorted(pairs, SimilarityScan::more_similar)) {
+          fail("scan", "pairs of a part are not most similar first");
+        }
+        merged.insert(merged.end(), pairs.begin(), pairs.end());
+      }
+      SimilarityScan::top(merged, top_k);
+      expect_pairs("top " + std::to_string(top_k) + " of " +
+                       std::to_string(parts) + " parts",
+                   merged, expected);
+    }
+  }
+  if (SimilarityScan::tile_pairs(exams) != 6 + 3 + 1 + 1) {
+    fail("tile_pairs", std::to_string(SimilarityScan::tile_pairs(exams)));
+  }
+}
+
+}  // namespace
+
+i32 main() {
+  std::mt19937 random(20240619);
+  scan(random);
+  if (failures > 0) {
+    std::cerr << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "SimilarityScan: all checks passed\n";
+  return 0;
+}
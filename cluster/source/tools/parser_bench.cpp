@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <server/parser.hpp>
+#include <server/protocol.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <vector>
+
+/**
+ * @brief Time FrameParser against the istringstream parser it replaced
+ * @details Both parsers read the same buffer of frames, once as if it had
+ *          arrived whole and once in reads of `--read` bytes (the MSS by
+ *          default). The old parser scanned the buffer for '$' again after
+ *          every read and copied each frame three times, as it did in the
+ *          server; FrameParser resumes where it stopped.
+ */
+
+namespace {
+
+using steady = std::chrono::steady_clock;
+
+constexpr u32 MAX_LENGTH = 1024 * 1024 * 10;
+
+struct Options {
+  size_t frames = 20000;
+  size_t data_bytes = 256;
+  size_t read_bytes = 1460;
+};
+
+/**
+ * @brief Parser of the server before FrameParser, kept for comparison
+ */
+ScoreHiveRequest legacy_parse(const std::string& message) {
+  ScoreHiveRequest request;
+  std::istringstream iss(message);
+  std::string token;
+  if (!std::getline(iss, token, ' ') || token != "SH") {
+    throw std::runtime_error("Invalid magic string");
+  }
+  if (!std::getline(iss, token, ' ')) {
+    throw std::runtime_error("Missing command");
+  }
+  size_t pos = token.find('$');
+  if (pos != std::string::npos) {
+    token = token.substr(0, pos);
+  }
+  u8 command = static_cast<u8>(std::stoi(token));
+  if (command > MAX_COMMAND) {
+    throw std::runtime_error("Invalid command");
+  }
+  if (command == 0 || command == 4) {
+    request.command = static_cast<ScoreHiveCommand>(command);
+    request.length = 0;
+    return request;
+  }
+  if (!std::getline(iss, token, ' ')) {
+    throw std::runtime_error("Missing length");
+  }
+  u32 length = static_cast<u32>(std::stoi(token));
+  if (length > MAX_LENGTH) {
+    throw std::runtime_error("Length exceeds the maximum allowed size");
+  }
+  if (!std::getline(iss, token, '$')) {
+    throw std::runtime_error("Missing delimiter");
+  }
+  if (token.size() != length) {
+    throw std::runtime_error("Data length mismatch");
+  }
+  request.command = static_cast<ScoreHiveCommand>(command);
+  request.length = length;
+  request.data = token;
+  return request;
+}
+
+/**
+ * @brief Frames of the old loop of the server, reading `read_bytes` at a
+ *        time
+ * @return Bytes of data of the parsed frames
+ */
+size_t legacy_loop(std::string_view stream, size_t read_bytes) {
+  std::string input;
+  size_t data_bytes = 0;
+  for (size_t received = 0; received < stream.size();) {
+    auto read = std::min(read_bytes, stream.size() - received);
+    input.append(stream.substr(received, read));
+    received += read;
+    size_t begin = 0;
+    while (true) {
+      while (begin < input.size() &&
+             (input[begin] == '\r' || input[begin] == '\n')) {
+        begin++;
+      }
+      auto end = input.find('$', begin);
+      if (end == std::string::npos) {
+        break;
+      }
+      auto message = input.substr(begin, end - begin + 1);
+      begin = end + 1;
+      auto request = legacy_parse(message);
+      data_bytes += request.data.size();
+    }
+    input.erase(0, begin);
+  }
+  return data_bytes;
+}
+
+size_t frame_parser_loop(std::string_view stream, size_t read_bytes) {
+  std::string input;
+  size_t data_bytes = 0;
+  FrameParser parser(MAX_LENGTH);
+  for (size_t received = 0; received < stream.size();) {
+    auto read = std::min(read_bytes, stream.size() - received);
+    input.append(stream.substr(received, read));
+    received += read;
+    size_t begin = 0;
+    while (true) {
+      auto status = parser.parse(std::string_view(input).substr(begin));
+      if (status == FrameParser::Status::INCOMPLETE) {
+        break;
+      }
+      if (status == FrameParser::Status::INVALID) {
+        throw std::runtime_error(parser.error());
+      }
+      // The server copies the data once into the queued request
+      std::string data(parser.frame().data);
+      data_bytes += data.size();
+      begin += parser.frame_size();
+      parser.reset();
+    }
+    input.erase(0, begin);
+  }
+  return data_bytes;
+}
+
+/**
+ * @brief REVIEW frames with `data_bytes` of JSON-like data each
+ */
+std::string make_frames(const Options& options) {
+  std::string data = "[";
+  while (data.size() + 2 < options.data_bytes) {
+    data += "{\"id_exam\":1,\"stage\":1},";
+  }
+  data.resize(std::max<size_t>(options.data_bytes, 2) - 1, ' ');
+  data += "]";
+  std::string stream;
+  for (size_t i = 0; i < options.frames; i++) {
+    stream += "SH 2 " + std::to_string(data.size()) + " " + data + "$\r\n";
+  }
+  return stream;
+}
+
+template <typename Loop>
+double time_ms(Loop loop, std::string_view stream, size_t read_bytes,
+               size_t expected) {
+  auto start = steady::now();
+  auto data_bytes = loop(stream, read_bytes);
+  auto elapsed = std::chrono::duration<double, std::milli>(steady::now() -
+                                                           start);
+  if (data_bytes != expected) {
+    throw std::runtime_error("Parsers disagree on the data");
+  }
+  return elapsed.count();
+}
+
+Options parse_options(i32 argc, char** argv) {
+  Options options;
+  for (i32 i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (i + 1 >= argc) {
+      throw std::runtime_error("Missing value of " + std::string(arg));
+    }
+    std::string_view value = argv[++i];
+    size_t parsed = 0;
+    auto [ptr, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), parsed);
+    if (ec != std::errc() || ptr != value.data() + value.size() ||
+        parsed == 0) {
+      throw std::runtime_error("Invalid value for " + std::string(arg));
+    }
+    if (arg == "--frames") {
+      options.frames = parsed;
+    } else if (arg == "--data") {
+      options.data_bytes = parsed;
+    } else if (arg == "--read") {
+      options.read_bytes = parsed;
+    } else {
+      throw std::runtime_error("Unknown option " + std::string(arg));
+    }
+  }
+  return options;
+}
+
+}  // namespace
+
+i32 main(i32 argc, char** argv) {
+  Options options;
+  try {
+    options = parse_options(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n"
+              << "Usage: ScoreHiveParserBench [--frames <n>] [--data <bytes>]"
+                 " [--read <bytes>]\n";
+    return 1;
+  }
+  auto stream = make_frames(options);
+  auto expected = frame_parser_loop(stream, stream.size());
+  std::cout << options.frames << " frames of " << options.data_bytes
+            << " bytes of data\n";
+  std::cout << std::left << std::setw(14) << "reads" << std::setw(20)
+            << "istringstream (ms)" << std::setw(18) << "FrameParser (ms)"
+            << "speedup\n";
+  std::cout << std::fixed << std::setprecision(2);
+  for (auto read_bytes : {stream.size(), options.read_bytes}) {
+    auto legacy = time_ms(legacy_loop, stream, read_bytes, expected);
+    auto parser = time_ms(frame_parser_loop, stream, read_bytes, expected);
+    auto label = read_bytes == stream.size()
+                     ? std::string("whole")
+                     : std::to_string(read_bytes) + " bytes";
+    std::cout << std::setw(14) << label << std::setw(20) << legacy
+              << std::setw(18) << parser << legacy / parser << "x\n";
+  }
+  return 0;
+}
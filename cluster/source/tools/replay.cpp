@@ -0,0 +1,413 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <server/capture.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system/aliases.hpp>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Replay a frame capture (SH_CAPTURE) against a running cluster
+ * @details Every captured connection is replayed on a connection (and a
+ *          thread) of its own. Its frames are sent at their captured offset
+ *          divided by the speed, or right after the previous response with
+ *          --max, and never before the previous response of the connection
+ *          arrived. The latency of each request is compared with the one
+ *          the server saw when it was captured.
+ *          SHUTDOWN and DRAIN frames are not replayed.
+ */
+
+namespace {
+
+using steady = std::chrono::steady_clock;
+
+struct Options {
+  std::string capture;
+  std::string host = "127.0.0.1";
+  u16 port = 8080;
+  double speed = 1.0; /** 0 replays at maximum speed */
+  std::string report; /** CSV of every request, empty to skip it */
+};
+
+struct ReplayedRequest {
+  u32 connection;
+  u64 offset_ns;
+  std::string frame;
+  i32 command = -1;
+  i64 captured_us = -1; /** Latency seen by the server, -1 if unanswered */
+  i32 captured_code = -1;
+  i64 replayed_us = -1; /** -1 if the request failed */
+  i32 replayed_code = -1;
+};
+
+void usage() {
+  std::cerr << "Usage: ScoreHiveReplay <capture> [--host <ipv4>]"
+               " [--port <port>] [--speed <factor> | --max]"
+               " [--report <file.csv>]\n";
+}
+
+template <typename T>
+T parse_number(std::string_view value, const char* option) {
+  T parsed{};
+  auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), parsed);
+  if (ec != std::errc() || ptr != value.data() + value.size()) {
+    throw std::runtime_error("Invalid value for " + std::string(option) +
+                             ": " + std::string(value));
+  }
+  return parsed;
+}
+
+Options parse_options(i32 argc, char** argv) {
+  Options options;
+  for (i32 i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    auto value = [&]() -> std::string_view {
+      if (i + 1 >= argc) {
+        throw std::runtime_error("Missing value of " + std::string(arg));
+      }
+      return argv[++i];
+    };
+    if (arg == "--host") {
+      options.host = value();
+    } else if (arg == "--port") {
+      options.port = parse_number<u16>(value(), "--port");
+    } else if (arg == "--speed") {
+      options.speed = parse_number<double>(value(), "--speed");
+      if (options.speed <= 0) {
+        throw std::runtime_error("--speed must be positive");
+      }
+    } else if (arg == "--max") {
+      options.speed = 0;
+    } else if (arg == "--report") {
+      options.report = value();
+    } else if (options.capture.empty() && !arg.starts_with("--")) {
+      options.capture = arg;
+    } else {
+      throw std::runtime_error("Unknown option " + std::string(arg));
+    }
+  }
+  if (options.capture.empty()) {
+    throw std::runtime_error("Missing capture file");
+  }
+  in_addr address;
+  if (inet_pton(AF_INET, options.host.c_str(), &address) != 1) {
+    throw std::runtime_error("Invalid --host " + options.host);
+  }
+  return options;
+}
+
+/**
+ * @brief Command of a "SH <command>..." frame, -1 if there is none
+ */
+i32 frame_command(std::string_view frame) {
+  auto start = frame.find("SH");
+  if (start == std::string_view::npos) {
+    return -1;
+  }
+  frame.remove_prefix(start + 2);
+  frame.remove_prefix(std::min(frame.find_first_not_of(' '), frame.size()));
+  i32 command = -1;
+  std::from_chars(frame.data(), frame.data() + frame.size(), command);
+  return command;
+}
+
+/**
+ * @brief Requests of a capture, with the latency of the captured responses
+ */
+std::vector<ReplayedRequest> load(const std::string& path) {
+  auto records = FrameCapture::read(path);
+  std::vector<ReplayedRequest> requests;
+  std::map<std::pair<u32, u64>, size_t> unanswered;
+  for (auto& record : records) {
+    std::pair<u32, u64> key{record.connection, record.sequence};
+    if (record.kind == CaptureKind::REQUEST) {
+      unanswered[key] = requests.size();
+      ReplayedRequest request{record.connection, record.offset_ns,
+                              std::move(record.data)};
+      request.command = frame_command(request.frame);
+      requests.push_back(std::move(request));
+      continue;
+    }
+    // Errors of frames that could not be parsed have no request
+    auto waiting = unanswered.find(key);
+    if (waiting == unanswered.end() || record.data.empty()) {
+      continue;
+    }
+    auto& request = requests[waiting->second];
+    unanswered.erase(waiting);
+    request.captured_us =
+        static_cast<i64>(record.offset_ns - request.offset_ns) / 1000;
+    request.captured_code = static_cast<u8>(record.data[0]);
+  }
+  return requests;
+}
+
+i32 connect_to(const Options& options) {
+  auto fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(options.port);
+  inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+      -1) {
+    close(fd);
+    return -1;
+  }
+  i32 no_delay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+  return fd;
+}
+
+bool send_all(i32 fd, std::string_view bytes) {
+  while (!bytes.empty()) {
+    auto sent = send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+    if (sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes.remove_prefix(static_cast<size_t>(sent));
+  }
+  return true;
+}
+
+/**
+ * @brief Read a "SH <code>[z] <length> <data>$\r\n" response
+ * @param input Bytes received and not consumed yet; empty if nothing of the
+ *        response arrived when it fails
+ * @return Its code, or nullopt if the connection closed or it is malformed
+ */
+std::optional<i32> read_response(i32 fd, std::string& input) {
+  std::array<char, 64 * 1024> chunk;
+  while (true) {
+    // Header: "SH", the code and the length, each followed by a space
+    size_t spaces[3];
+    size_t found = 0;
+    for (size_t i = 0; i < input.size() && found < 3; i++) {
+      if (input[i] == ' ') {
+        spaces[found++] = i;
+      }
+    }
+    if (found == 3) {
+      if (!std::string_view(input).starts_with("SH")) {
+        return std::nullopt;
+      }
+      i32 code = -1;
+      size_t length = 0;
+      std::from_chars(input.data() + spaces[0] + 1, input.data() + spaces[1],
+                      code);
+      auto [ptr, ec] = std::from_chars(input.data() + spaces[1] + 1,
+                                       input.data() + spaces[2], length);
+      if (ec != std::errc() || ptr != input.data() + spaces[2]) {
+        return std::nullopt;
+      }
+      auto size = spaces[2] + 1 + length + 3;  // the data and "$\r\n"
+      if (input.size() >= size) {
+        input.erase(0, size);
+        return code;
+      }
+    }
+    auto received = recv(fd, chunk.data(), chunk.size(), 0);
+    if (received == -1 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return std::nullopt;
+    }
+    input.append(chunk.data(), static_cast<size_t>(received));
+  }
+}
+
+void replay_connection(const Options& options,
+                       const std::vector<ReplayedRequest*>& requests,
+                       steady::time_point start) {
+  i32 fd = -1;
+  std::string input;
+  for (auto* request : requests) {
+    if (options.speed > 0) {
+      std::this_thread::sleep_until(
+          start + std::chrono::nanoseconds(static_cast<i64>(
+                      static_cast<double>(request->offset_ns) /
+                      options.speed)));
+    }
+    // Without keep-alive the server closes the connection after each
+    // response: the request is sent again on a new one, as it was not read
+    for (i32 attempt = 0; attempt < 2; attempt++) {
+      if (fd == -1) {
+        input.clear();
+        fd = connect_to(options);
+        if (fd == -1) {
+          break;
+        }
+      }
+      auto sent = steady::now();
+      std::optional<i32> code;
+      if (send_all(fd, request->frame)) {
+        code = read_response(fd, input);
+      }
+      if (code) {
+        request->replayed_us =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                steady::now() - sent)
+                .count();
+        request->replayed_code = *code;
+        break;
+      }
+      close(fd);
+      fd = -1;
+      if (!input.empty()) {
+        break;  // part of the response arrived, it must not be sent twice
+      }
+    }
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+/**
+ * @brief Nearest-rank percentile of sorted values
+ */
+i64 percentile(const std::vector<i64>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto rank =
+      static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size()));
+  return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void print_row(const char* name, std::vector<i64> values) {
+  std::ranges::sort(values);
+  std::cout << std::left << std::setw(10) << name << std::right;
+  for (auto p : {50.0, 95.0, 99.0, 100.0}) {
+    std::cout << std::setw(12) << percentile(values, p);
+  }
+  std::cout << "\n";
+}
+
+void write_report(const std::string& path,
+                  const std::vector<ReplayedRequest>& requests) {
+  std::ofstream report(path);
+  if (!report) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  report << "connection,offset_ms,command,captured_us,replayed_us,delta_us,"
+            "captured_code,replayed_code\n";
+  for (const auto& request : requests) {
+    auto delta = request.captured_us >= 0 && request.replayed_us >= 0
+                     ? request.replayed_us - request.captured_us
+                     : 0;
+    report << request.connection << ','
+           << static_cast<double>(request.offset_ns) / 1e6 << ','
+           << request.command << ',' << request.captured_us << ','
+           << request.replayed_us << ',' << delta << ','
+           << request.captured_code << ',' << request.replayed_code << '\n';
+  }
+}
+
+}  // namespace
+
+i32 main(i32 argc, char** argv) {
+  Options options;
+  std::vector<ReplayedRequest> requests;
+  try {
+    options = parse_options(argc, argv);
+    requests = load(options.capture);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    usage();
+    return 1;
+  }
+  std::map<u32, std::vector<ReplayedRequest*>> connections;
+  size_t skipped = 0;
+  for (auto& request : requests) {
+    if (request.command == static_cast<i32>(ScoreHiveCommand::SHUTDOWN) ||
+        request.command == static_cast<i32>(ScoreHiveCommand::DRAIN)) {
+      skipped++;
+      continue;
+    }
+    connections[request.connection].push_back(&request);
+  }
+
+  auto start = steady::now();
+  std::vector<std::thread> threads;
+  threads.reserve(connections.size());
+  for (const auto& [connection, replayed] : connections) {
+    threads.emplace_back(replay_connection, std::cref(options),
+                         std::cref(replayed), start);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      steady::now() - start);
+
+  std::vector<i64> captured, replayed, delta;
+  size_t failed = 0, changed = 0;
+  for (const auto& [connection, sent] : connections) {
+    for (const auto* request : sent) {
+      if (request->replayed_us < 0) {
+        failed++;
+        continue;
+      }
+      replayed.push_back(request->replayed_us);
+      if (request->captured_us < 0) {
+        continue;
+      }
+      captured.push_back(request->captured_us);
+      delta.push_back(request->replayed_us - request->captured_us);
+      if (request->captured_code != request->replayed_code) {
+        changed++;
+      }
+    }
+  }
+  std::cout << "Replayed " << replayed.size() << " requests on "
+            << connections.size() << " connections in " << elapsed.count()
+            << " ms (";
+  if (options.speed > 0) {
+    std::cout << options.speed << "x";
+  } else {
+    std::cout << "max";
+  }
+  std::cout << ")\n"
+            << "Failed: " << failed << ", response code changed: " << changed
+            << ", skipped (SHUTDOWN, DRAIN): " << skipped << "\n\n";
+  std::cout << std::left << std::setw(10) << "latency" << std::right
+            << std::setw(12) << "p50 us" << std::setw(12) << "p95 us"
+            << std::setw(12) << "p99 us" << std::setw(12) << "max us" << "\n";
+  print_row("captured", captured);
+  print_row("replayed", replayed);
+  print_row("delta", delta);
+  if (!options.report.empty()) {
+    try {
+      write_report(options.report, requests);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}